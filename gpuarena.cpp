@@ -0,0 +1,221 @@
+/**
+\file gpuarena.cpp
+\brief The cpp file of gpuarena.h
+*/
+
+#include "gpuarena.h"
+
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+
+using namespace lib3ds_qt;
+
+GpuArena::GpuArena(int pageBytes)
+    : _pageBytes(pageBytes), _isResolved(false), _drawElementsBaseVertex(0), _drawElementsInstancedBaseVertex(0)
+{
+}
+
+GpuArena::~GpuArena()
+{
+    QOpenGLContext *context = QOpenGLContext::currentContext();
+    if (!context)
+        return;
+    for (int i = 0; i < _pools.size(); ++i) {
+        foreach (const Page &page, _pools[i].pages) {
+            if (page.buffer)
+                GL_CHECK( context->functions()->glDeleteBuffers(1, &page.buffer));
+        }
+    }
+}
+
+// base vertex draws are core since OpenGL 3.2, GL_ARB_draw_elements_base_vertex names them the same
+bool GpuArena::isSupported()
+{
+    if (_isResolved)
+        return _drawElementsBaseVertex && _drawElementsInstancedBaseVertex;
+    QOpenGLContext *context = QOpenGLContext::currentContext();
+    if (!context)
+        return false;
+    _isResolved = true;
+    if (context->format().version() >= qMakePair(3, 2) || context->hasExtension("GL_ARB_draw_elements_base_vertex")) {
+        _drawElementsBaseVertex = reinterpret_cast<DrawElementsBaseVertexFunction>(
+                    context->getProcAddress("glDrawElementsBaseVertex"));
+        _drawElementsInstancedBaseVertex = reinterpret_cast<DrawElementsInstancedBaseVertexFunction>(
+                    context->getProcAddress("glDrawElementsInstancedBaseVertex"));
+    }
+    return _drawElementsBaseVertex && _drawElementsInstancedBaseVertex;
+}
+
+GpuArenaBlock GpuArena::allocateVertices(quint32 layout, int stride, const void *data, int count)
+{
+    return allocate(poolIndex(GL_ARRAY_BUFFER, layout, stride), data, count);
+}
+
+GpuArenaBlock GpuArena::allocateIndices(GLenum type, const void *data, int count)
+{
+    const int indexSize = type == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+    return allocate(poolIndex(GL_ELEMENT_ARRAY_BUFFER, type, indexSize), data, count);
+}
+
+int GpuArena::poolIndex(GLenum target, quint32 key, int unitSize)
+{
+    for (int i = 0; i < _pools.size(); ++i) {
+        const Pool &pool = _pools[i];
+        if (pool.target == target && pool.key == key && pool.unitSize == unitSize)
+            return i;
+    }
+    Pool pool;
+    pool.target = target;
+    pool.key = key;
+    pool.unitSize = unitSize;
+    _pools << pool;
+    return _pools.size() - 1;
+}
+
+int GpuArena::addPage(Pool &pool, int units)
+{
+    int index = 0;
+    while (index < pool.pages.size() && pool.pages[index].buffer)
+        ++index;
+    if (index == pool.pages.size())
+        pool.pages << Page();
+
+    Page &page = pool.pages[index];
+    page.capacity = units;
+    page.freeBlocks.clear();
+    page.freeBlocks.insert(0, units);
+    // uploads go through GL_ARRAY_BUFFER, whose binding isn't part of a vertex array object
+    QOpenGLFunctions *gl = QOpenGLContext::currentContext()->functions();
+    GL_CHECK( gl->glGenBuffers(1, &page.buffer));
+    GL_CHECK( gl->glBindBuffer(GL_ARRAY_BUFFER, page.buffer));
+    GL_CHECK( gl->glBufferData(GL_ARRAY_BUFFER, GLsizeiptr(units) * pool.unitSize, 0, GL_STATIC_DRAW));
+    GL_CHECK( gl->glBindBuffer(GL_ARRAY_BUFFER, 0));
+    return index;
+}
+
+// first fit over the pages of the pool, a new page if none has room
+GpuArenaBlock GpuArena::allocate(int poolIndex, const void *data, int count)
+{
+    GpuArenaBlock block;
+    if (count <= 0)
+        return block;
+    Pool &pool = _pools[poolIndex];
+
+    int pageIndex = -1;
+    QMap<int, int>::iterator freeBlock;
+    for (int i = 0; i < pool.pages.size() && pageIndex < 0; ++i) {
+        QMap<int, int> &freeBlocks = pool.pages[i].freeBlocks;
+        for (freeBlock = freeBlocks.begin(); freeBlock != freeBlocks.end(); ++freeBlock) {
+            if (freeBlock.value() >= count) {
+                pageIndex = i;
+                break;
+            }
+        }
+    }
+    if (pageIndex < 0) {
+        pageIndex = addPage(pool, qMax(count, _pageBytes / pool.unitSize));
+        freeBlock = pool.pages[pageIndex].freeBlocks.begin();
+    }
+
+    Page &page = pool.pages[pageIndex];
+    const int offset = freeBlock.key();
+    const int remaining = freeBlock.value() - count;
+    page.freeBlocks.erase(freeBlock);
+    if (remaining > 0)
+        page.freeBlocks.insert(offset + count, remaining);
+    pool.usedUnits += count;
+
+    QOpenGLFunctions *gl = QOpenGLContext::currentContext()->functions();
+    GL_CHECK( gl->glBindBuffer(GL_ARRAY_BUFFER, page.buffer));
+    GL_CHECK( gl->glBufferSubData(GL_ARRAY_BUFFER, GLintptr(offset) * pool.unitSize,
+                                  GLsizeiptr(count) * pool.unitSize, data));
+    GL_CHECK( gl->glBindBuffer(GL_ARRAY_BUFFER, 0));
+
+    block.pool = poolIndex;
+    block.page = pageIndex;
+    block.buffer = page.buffer;
+    block.offset = offset;
+    block.count = count;
+    return block;
+}
+
+void GpuArena::release(const GpuArenaBlock &block)
+{
+    if (block.isNull())
+        return;
+    Pool &pool = _pools[block.pool];
+    Page &page = pool.pages[block.page];
+    Q_ASSERT(page.buffer == block.buffer);
+    pool.usedUnits -= block.count;
+
+    int offset = block.offset;
+    int count = block.count;
+    QMap<int, int>::iterator next = page.freeBlocks.lowerBound(offset);
+    if (next != page.freeBlocks.begin()) {
+        QMap<int, int>::iterator previous = next - 1;
+        if (previous.key() + previous.value() == offset) {
+            offset = previous.key();
+            count += previous.value();
+            page.freeBlocks.erase(previous);
+        }
+    }
+    if (next != page.freeBlocks.end() && offset + count == next.key()) {
+        count += next.value();
+        page.freeBlocks.erase(next);
+    }
+    page.freeBlocks.insert(offset, count);
+
+    // an empty page gives its memory back, unless it is the last one of the pool
+    if (count < page.capacity)
+        return;
+    int livePages = 0;
+    foreach (const Page &other, pool.pages)
+        livePages += other.buffer != 0;
+    if (livePages <= 1)
+        return;
+    QOpenGLContext *context = QOpenGLContext::currentContext();
+    if (context)
+        GL_CHECK( context->functions()->glDeleteBuffers(1, &page.buffer));
+    page.buffer = 0;
+    page.capacity = 0;
+    page.freeBlocks.clear();
+}
+
+void GpuArena::drawElementsBaseVertex(GLenum mode, GLsizei count, GLenum type, const GLvoid *indices, GLint baseVertex)
+{
+    GL_CHECK( _drawElementsBaseVertex(mode, count, type, indices, baseVertex));
+}
+
+void GpuArena::drawElementsInstancedBaseVertex(GLenum mode, GLsizei count, GLenum type, const GLvoid *indices,
+                                               GLsizei instanceCount, GLint baseVertex)
+{
+    GL_CHECK( _drawElementsInstancedBaseVertex(mode, count, type, indices, instanceCount, baseVertex));
+}
+
+int GpuArena::bufferCount() const
+{
+    int count = 0;
+    foreach (const Pool &pool, _pools) {
+        foreach (const Page &page, pool.pages)
+            count += page.buffer != 0;
+    }
+    return count;
+}
+
+qint64 GpuArena::usedBytes() const
+{
+    qint64 bytes = 0;
+    foreach (const Pool &pool, _pools)
+        bytes += qint64(pool.usedUnits) * pool.unitSize;
+    return bytes;
+}
+
+qint64 GpuArena::capacityBytes() const
+{
+    qint64 bytes = 0;
+    foreach (const Pool &pool, _pools) {
+        foreach (const Page &page, pool.pages)
+            bytes += qint64(page.capacity) * pool.unitSize;
+    }
+    return bytes;
+}
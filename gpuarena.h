@@ -0,0 +1,107 @@
+#ifndef GPUARENA_H
+#define GPUARENA_H
+
+/**
+\file gpuarena.h
+\brief Sub-allocation of vertex and index data in a few large buffer objects
+
+The meshes of every model sharing an arena are packed into pages of a
+few megabytes. Vertices of the same layout share their pages, so the
+meshes are drawn from one vertex array object with base vertex draws
+instead of binding buffers of their own.
+*/
+
+#include "lib3ds_qt_global.h"
+
+#include <qopengl.h>
+
+#include <QMap>
+#include <QVector>
+
+namespace lib3ds_qt {
+
+/// Range of a page of a GpuArena, counted in vertices or indices
+struct GpuArenaBlock
+{
+    int pool; /**< -1 for the null block */
+    int page;
+    GLuint buffer; /**< Buffer object of the page */
+    int offset; /**< First vertex or index of the block, the base vertex of the draws */
+    int count;
+
+    GpuArenaBlock() : pool(-1), page(-1), buffer(0), offset(0), count(0) {}
+    bool isNull() const { return pool < 0; }
+};
+
+/// Pages of vertex and index data shared by the meshes of several models.
+/// All the calls need the GL context the arena was first used with to be current.
+class LIB3DS_QTSHARED_EXPORT GpuArena
+{
+public:
+    /// Pages are pageBytes large, bigger allocations get a page of their own
+    explicit GpuArena(int pageBytes = 16 << 20);
+    ~GpuArena();
+
+    /// True if the context can draw with a base vertex, resolves the entry points on the first call
+    bool isSupported();
+
+    /// Copies count vertices of stride bytes into a page holding the vertex layout 'layout' only
+    GpuArenaBlock allocateVertices(quint32 layout, int stride, const void *data, int count);
+    /// Copies count indices of type GL_UNSIGNED_SHORT or GL_UNSIGNED_INT into an index page
+    GpuArenaBlock allocateIndices(GLenum type, const void *data, int count);
+    /// Returns the block to the free list of its page, merged with its free neighbours
+    void release(const GpuArenaBlock &block);
+
+    void drawElementsBaseVertex(GLenum mode, GLsizei count, GLenum type, const GLvoid *indices, GLint baseVertex);
+    void drawElementsInstancedBaseVertex(GLenum mode, GLsizei count, GLenum type, const GLvoid *indices,
+                                         GLsizei instanceCount, GLint baseVertex);
+
+    /// Buffer objects currently held by the arena
+    int bufferCount() const;
+    /// Bytes in use by the blocks and bytes of the pages
+    qint64 usedBytes() const;
+    qint64 capacityBytes() const;
+
+private:
+    Q_DISABLE_COPY(GpuArena)
+
+    struct Page
+    {
+        GLuint buffer; /**< 0 for a slot whose page was freed */
+        int capacity; /**< In units of the pool */
+        QMap<int, int> freeBlocks; /**< Offset to count, neighbours are always merged */
+
+        Page() : buffer(0), capacity(0) {}
+    };
+
+    struct Pool
+    {
+        GLenum target;
+        quint32 key; /**< Vertex layout or index type */
+        int unitSize; /**< Bytes of a vertex or an index */
+        int usedUnits;
+        QVector<Page> pages;
+
+        Pool() : target(0), key(0), unitSize(0), usedUnits(0) {}
+    };
+
+    int poolIndex(GLenum target, quint32 key, int unitSize);
+    GpuArenaBlock allocate(int pool, const void *data, int count);
+    int addPage(Pool &pool, int units);
+
+    typedef void (QOPENGLF_APIENTRYP DrawElementsBaseVertexFunction)(GLenum mode, GLsizei count, GLenum type,
+                                                                    const GLvoid *indices, GLint baseVertex);
+    typedef void (QOPENGLF_APIENTRYP DrawElementsInstancedBaseVertexFunction)(GLenum mode, GLsizei count,
+                                                                             GLenum type, const GLvoid *indices,
+                                                                             GLsizei instanceCount, GLint baseVertex);
+
+    QVector<Pool> _pools;
+    int _pageBytes;
+    bool _isResolved;
+    DrawElementsBaseVertexFunction _drawElementsBaseVertex;
+    DrawElementsInstancedBaseVertexFunction _drawElementsInstancedBaseVertex;
+};
+
+} // namespace lib3ds_qt
+
+#endif // GPUARENA_H
@@ -0,0 +1,957 @@
+/*
+ * The 3D Studio File Format Library
+ * Copyright (C) 1996-2007 by Jan Eric Kyprianidis <www.kyprianidis.com>
+ * All rights reserved.
+ *
+ * This program is  free  software;  you can redistribute it and/or modify it
+ * under the terms of the  GNU Lesser General Public License  as published by
+ * the  Free Software Foundation;  either version 2.1 of the License,  or (at
+ * your option) any later version.
+ *
+ * This  program  is  distributed in  the  hope that it will  be useful,  but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or  FITNESS FOR A  PARTICULAR PURPOSE.  See the  GNU Lesser General Public
+ * License for more details.
+ *
+ * You should  have received  a copy of the GNU Lesser General Public License
+ * along with  this program;  if not, write to the  Free Software Foundation,
+ * Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+#include <lib3ds/bake.h>
+#include <lib3ds/file.h>
+#include <lib3ds/matrix.h>
+#include <lib3ds/quat.h>
+#include <lib3ds/vector.h>
+#include <lib3ds/vecmath.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+
+/*!
+ * \defgroup bake Baked Animation
+ */
+
+
+static Lib3dsDword
+bake_count_nodes(Lib3dsNode *node)
+{
+  Lib3dsDword n=0;
+
+  for (; node!=0; node=node->next) {
+    n+=1+bake_count_nodes(node->childs);
+  }
+  return(n);
+}
+
+
+static Lib3dsBool
+bake_node_setup(Lib3dsBakedNode *b, Lib3dsNode *node, Lib3dsDword samples)
+{
+  b->node=node;
+  switch (node->type) {
+    case LIB3DS_UNKNOWN_NODE:
+      break;
+    case LIB3DS_AMBIENT_NODE:
+      b->colL=(Lib3dsRgb*)calloc(sizeof(Lib3dsRgb), samples);
+      return(b->colL!=0);
+    case LIB3DS_OBJECT_NODE:
+      b->posL=(Lib3dsVector*)calloc(sizeof(Lib3dsVector), samples);
+      b->rotL=(Lib3dsQuat*)calloc(sizeof(Lib3dsQuat), samples);
+      b->sclL=(Lib3dsVector*)calloc(sizeof(Lib3dsVector), samples);
+      b->hideL=(Lib3dsBool*)calloc(sizeof(Lib3dsBool), samples);
+      return(b->posL && b->rotL && b->sclL && b->hideL);
+    case LIB3DS_CAMERA_NODE:
+      b->posL=(Lib3dsVector*)calloc(sizeof(Lib3dsVector), samples);
+      b->fovL=(Lib3dsFloat*)calloc(sizeof(Lib3dsFloat), samples);
+      b->rollL=(Lib3dsFloat*)calloc(sizeof(Lib3dsFloat), samples);
+      return(b->posL && b->fovL && b->rollL);
+    case LIB3DS_TARGET_NODE:
+    case LIB3DS_SPOT_NODE:
+      b->posL=(Lib3dsVector*)calloc(sizeof(Lib3dsVector), samples);
+      return(b->posL!=0);
+    case LIB3DS_LIGHT_NODE:
+      b->posL=(Lib3dsVector*)calloc(sizeof(Lib3dsVector), samples);
+      b->colL=(Lib3dsRgb*)calloc(sizeof(Lib3dsRgb), samples);
+      b->hotspotL=(Lib3dsFloat*)calloc(sizeof(Lib3dsFloat), samples);
+      b->falloffL=(Lib3dsFloat*)calloc(sizeof(Lib3dsFloat), samples);
+      b->rollL=(Lib3dsFloat*)calloc(sizeof(Lib3dsFloat), samples);
+      return(b->posL && b->colL && b->hotspotL && b->falloffL && b->rollL);
+  }
+  return(LIB3DS_TRUE);
+}
+
+
+static Lib3dsBool
+bake_nodes_setup(Lib3dsBakedAnimation *anim, Lib3dsNode *node, Lib3dsDword *index)
+{
+  for (; node!=0; node=node->next) {
+    if (!bake_node_setup(&anim->nodeL[(*index)++], node, anim->samples)) {
+      return(LIB3DS_FALSE);
+    }
+    if (!bake_nodes_setup(anim, node->childs, index)) {
+      return(LIB3DS_FALSE);
+    }
+  }
+  return(LIB3DS_TRUE);
+}
+
+
+static void
+bake_node_sample(Lib3dsBakedNode *b, Lib3dsDword s)
+{
+  Lib3dsNode *node=b->node;
+
+  switch (node->type) {
+    case LIB3DS_UNKNOWN_NODE:
+      break;
+    case LIB3DS_AMBIENT_NODE:
+      lib3ds_vector_copy_inline(b->colL[s], node->data.ambient.col);
+      break;
+    case LIB3DS_OBJECT_NODE:
+      {
+        Lib3dsObjectData *n=&node->data.object;
+        lib3ds_vector_copy_inline(b->posL[s], n->pos);
+        lib3ds_quat_copy(b->rotL[s], n->rot);
+        lib3ds_vector_copy_inline(b->sclL[s], n->scl);
+        b->hideL[s]=n->hide;
+        /* keep neighbouring samples on the same side so that nlerp takes the short arc */
+        if (s && (lib3ds_quat_dot_inline(b->rotL[s-1], b->rotL[s])<0)) {
+          lib3ds_quat_neg_inline(b->rotL[s]);
+        }
+      }
+      break;
+    case LIB3DS_CAMERA_NODE:
+      lib3ds_vector_copy_inline(b->posL[s], node->data.camera.pos);
+      b->fovL[s]=node->data.camera.fov;
+      b->rollL[s]=node->data.camera.roll;
+      break;
+    case LIB3DS_TARGET_NODE:
+      lib3ds_vector_copy_inline(b->posL[s], node->data.target.pos);
+      break;
+    case LIB3DS_LIGHT_NODE:
+      {
+        Lib3dsLightData *n=&node->data.light;
+        lib3ds_vector_copy_inline(b->posL[s], n->pos);
+        lib3ds_vector_copy_inline(b->colL[s], n->col);
+        b->hotspotL[s]=n->hotspot;
+        b->falloffL[s]=n->falloff;
+        b->rollL[s]=n->roll;
+      }
+      break;
+    case LIB3DS_SPOT_NODE:
+      lib3ds_vector_copy_inline(b->posL[s], node->data.spot.pos);
+      break;
+  }
+}
+
+
+/*!
+ * Sample the animation of all nodes at a fixed rate.
+ *
+ * The tracks are evaluated every LIB3DS_FRAMES_PER_SECOND/fps frames from
+ * frame 0 past file->frames. Morph tracks aren't sampled, the baked
+ * evaluator leaves them at the value of the current frame. The nodes are
+ * evaluated at file->current_frame afterwards.
+ *
+ * \param file The Lib3dsFile object to be baked.
+ * \param fps Samples per second of animation.
+ *
+ * \return The baked animation, which references the nodes of file, or NULL
+ *         on failure. Free it with lib3ds_baked_animation_free() before the
+ *         file.
+ *
+ * \ingroup bake
+ */
+Lib3dsBakedAnimation*
+lib3ds_file_bake_animation(Lib3dsFile *file, Lib3dsFloat fps)
+{
+  Lib3dsBakedAnimation *anim;
+  Lib3dsDword i,s;
+
+  ASSERT(file);
+  ASSERT(fps>0);
+  anim=(Lib3dsBakedAnimation*)calloc(sizeof(Lib3dsBakedAnimation), 1);
+  if (!anim) {
+    return(0);
+  }
+  anim->rate=fps/LIB3DS_FRAMES_PER_SECOND;
+  anim->samples=(Lib3dsDword)ceil(file->frames*anim->rate)+1;
+  if (anim->samples<2) {
+    anim->samples=2;
+  }
+  anim->nodes=bake_count_nodes(file->nodes);
+  anim->nodeL=(Lib3dsBakedNode*)calloc(sizeof(Lib3dsBakedNode), anim->nodes ? anim->nodes : 1);
+  if (!anim->nodeL) {
+    free(anim);
+    return(0);
+  }
+  i=0;
+  if (!bake_nodes_setup(anim, file->nodes, &i)) {
+    lib3ds_baked_animation_free(anim);
+    return(0);
+  }
+
+  for (s=0; s<anim->samples; ++s) {
+    lib3ds_file_eval(file, s/anim->rate);
+    for (i=0; i<anim->nodes; ++i) {
+      bake_node_sample(&anim->nodeL[i], s);
+    }
+  }
+  lib3ds_file_eval(file, (Lib3dsFloat)file->current_frame);
+  return(anim);
+}
+
+
+/*!
+ * \ingroup bake
+ */
+void
+lib3ds_baked_animation_free(Lib3dsBakedAnimation *anim)
+{
+  Lib3dsBakedNode *b;
+  Lib3dsDword i;
+
+  ASSERT(anim);
+  for (i=0; i<anim->nodes; ++i) {
+    b=&anim->nodeL[i];
+    free(b->posL);
+    free(b->rotL);
+    free(b->sclL);
+    free(b->colL);
+    free(b->fovL);
+    free(b->rollL);
+    free(b->hotspotL);
+    free(b->falloffL);
+    free(b->hideL);
+  }
+  free(anim->nodeL);
+  free(anim);
+}
+
+
+/*
+ * a is a sample of a vector array, the next sample follows it.
+ */
+static void
+bake_lerp3(Lib3dsFloat *c, const Lib3dsFloat *a, Lib3dsFloat u)
+{
+  c[0]=a[0] + u*(a[3] - a[0]);
+  c[1]=a[1] + u*(a[4] - a[1]);
+  c[2]=a[2] + u*(a[5] - a[2]);
+}
+
+
+static void
+bake_node_matrix(Lib3dsNode *node, Lib3dsVector pos)
+{
+  if (node->parent) {
+    lib3ds_matrix_copy(node->matrix, node->parent->matrix);
+  }
+  else {
+    lib3ds_matrix_identity(node->matrix);
+  }
+  if (pos) {
+    lib3ds_matrix_translate(node->matrix, pos);
+  }
+}
+
+
+static void
+bake_object_matrix(Lib3dsNode *node)
+{
+  Lib3dsObjectData *n=&node->data.object;
+  Lib3dsMatrix M;
+
+  lib3ds_matrix_from_trs(M, n->pos, n->rot, n->scl);
+  if (node->parent) {
+    lib3ds_matrix_copy(node->matrix, node->parent->matrix);
+    lib3ds_matrix_mult(node->matrix, M);
+  }
+  else {
+    lib3ds_matrix_copy(node->matrix, M);
+  }
+}
+
+
+/*!
+ * Set all nodes of a baked animation to their values at time t.
+ *
+ * Same as lib3ds_file_eval(), except that the values are interpolated
+ * linearly between the two samples around t, rotations are normalized
+ * after the interpolation.
+ *
+ * \param anim The baked animation.
+ * \param t time value in frames, clamped to the sampled range
+ *
+ * \ingroup bake
+ */
+void
+lib3ds_baked_animation_eval(Lib3dsBakedAnimation *anim, Lib3dsFloat t)
+{
+  Lib3dsFloat x,u;
+  Lib3dsDword i,s;
+
+  ASSERT(anim);
+  x=t*anim->rate;
+  if (x<0) {
+    x=0;
+  }
+  if (x>(Lib3dsFloat)(anim->samples-1)) {
+    x=(Lib3dsFloat)(anim->samples-1);
+  }
+  s=(Lib3dsDword)x;
+  if (s>anim->samples-2) {
+    s=anim->samples-2;
+  }
+  u=x-s;
+
+  for (i=0; i<anim->nodes; ++i) {
+    Lib3dsBakedNode *b=&anim->nodeL[i];
+    Lib3dsNode *node=b->node;
+
+    switch (node->type) {
+      case LIB3DS_UNKNOWN_NODE:
+        break;
+      case LIB3DS_AMBIENT_NODE:
+        bake_lerp3(node->data.ambient.col, b->colL[s], u);
+        bake_node_matrix(node, 0);
+        break;
+      case LIB3DS_OBJECT_NODE:
+        {
+          Lib3dsObjectData *n=&node->data.object;
+          const Lib3dsFloat *q=b->rotL[s];
+          int k;
+
+          bake_lerp3(n->pos, b->posL[s], u);
+          bake_lerp3(n->scl, b->sclL[s], u);
+          for (k=0; k<4; ++k) {
+            n->rot[k]=q[k] + u*(q[k+4] - q[k]);
+          }
+          lib3ds_quat_normalize(n->rot);
+          n->hide=b->hideL[(Lib3dsDword)x];
+          bake_object_matrix(node);
+        }
+        break;
+      case LIB3DS_CAMERA_NODE:
+        {
+          Lib3dsCameraData *n=&node->data.camera;
+          bake_lerp3(n->pos, b->posL[s], u);
+          n->fov=b->fovL[s] + u*(b->fovL[s+1] - b->fovL[s]);
+          n->roll=b->rollL[s] + u*(b->rollL[s+1] - b->rollL[s]);
+          bake_node_matrix(node, n->pos);
+        }
+        break;
+      case LIB3DS_TARGET_NODE:
+        bake_lerp3(node->data.target.pos, b->posL[s], u);
+        bake_node_matrix(node, node->data.target.pos);
+        break;
+      case LIB3DS_LIGHT_NODE:
+        {
+          Lib3dsLightData *n=&node->data.light;
+          bake_lerp3(n->pos, b->posL[s], u);
+          bake_lerp3(n->col, b->colL[s], u);
+          n->hotspot=b->hotspotL[s] + u*(b->hotspotL[s+1] - b->hotspotL[s]);
+          n->falloff=b->falloffL[s] + u*(b->falloffL[s+1] - b->falloffL[s]);
+          n->roll=b->rollL[s] + u*(b->rollL[s+1] - b->rollL[s]);
+          bake_node_matrix(node, n->pos);
+        }
+        break;
+      case LIB3DS_SPOT_NODE:
+        bake_lerp3(node->data.spot.pos, b->posL[s], u);
+        bake_node_matrix(node, node->data.spot.pos);
+        break;
+    }
+  }
+}
+
+
+/*
+ * Words per key of a channel with comps components, rotations have 4.
+ */
+#define COMPRESS_WORDS(comps) ((comps)==1 ? 1 : 3)
+
+#define COMPRESS_SQRT1_2 0.70710678118654752440
+
+
+static Lib3dsWord
+compress_quantize(Lib3dsDouble x, Lib3dsDouble offset, Lib3dsDouble scale, int max)
+{
+  int q;
+
+  if (scale<=0) {
+    return(0);
+  }
+  q=(int)floor((x-offset)/scale + 0.5);
+  if (q<0) {
+    q=0;
+  }
+  if (q>max) {
+    q=max;
+  }
+  return((Lib3dsWord)q);
+}
+
+
+/*
+ * Smallest three encoding: the largest component is dropped and made
+ * positive by negating the quaternion, the others are in
+ * [-sqrt(1/2), sqrt(1/2)].
+ */
+static void
+compress_quat_encode(Lib3dsWord *w, const Lib3dsFloat *q)
+{
+  Lib3dsQuat n;
+  Lib3dsDouble c[3];
+  int m,i,j;
+
+  n[0]=q[0];
+  n[1]=q[1];
+  n[2]=q[2];
+  n[3]=q[3];
+  lib3ds_quat_normalize(n);
+  m=0;
+  for (i=1; i<4; ++i) {
+    if (fabs(n[i])>fabs(n[m])) {
+      m=i;
+    }
+  }
+  for (i=0,j=0; i<4; ++i) {
+    if (i!=m) {
+      c[j++]=(n[m]<0) ? -n[i] : n[i];
+    }
+  }
+  w[0]=(Lib3dsWord)(((m>>1)<<15) | compress_quantize(c[0], -COMPRESS_SQRT1_2, 2*COMPRESS_SQRT1_2/32767, 32767));
+  w[1]=(Lib3dsWord)(((m&1)<<15) | compress_quantize(c[1], -COMPRESS_SQRT1_2, 2*COMPRESS_SQRT1_2/32767, 32767));
+  w[2]=compress_quantize(c[2], -COMPRESS_SQRT1_2, 2*COMPRESS_SQRT1_2/65535, 65535);
+}
+
+
+static void
+compress_quat_decode(Lib3dsFloat *q, const Lib3dsWord *w)
+{
+  Lib3dsDouble c[3],l;
+  int m,i,j;
+
+  m=((w[0]>>15)<<1) | (w[1]>>15);
+  c[0]=(w[0]&0x7fff)*(2*COMPRESS_SQRT1_2/32767) - COMPRESS_SQRT1_2;
+  c[1]=(w[1]&0x7fff)*(2*COMPRESS_SQRT1_2/32767) - COMPRESS_SQRT1_2;
+  c[2]=w[2]*(2*COMPRESS_SQRT1_2/65535) - COMPRESS_SQRT1_2;
+  l=1.0 - c[0]*c[0] - c[1]*c[1] - c[2]*c[2];
+  for (i=0,j=0; i<4; ++i) {
+    q[i]=(i==m) ? (Lib3dsFloat)sqrt(l>0 ? l : 0) : (Lib3dsFloat)c[j++];
+  }
+}
+
+
+static void
+compress_encode(const Lib3dsCompressedChannel *ch, Lib3dsWord *w, const Lib3dsFloat *v, int comps)
+{
+  int i;
+
+  if (comps==4) {
+    compress_quat_encode(w, v);
+    return;
+  }
+  for (i=0; i<comps; ++i) {
+    w[i]=compress_quantize(v[i], ch->offset[i], ch->scale[i], 65535);
+  }
+}
+
+
+static void
+compress_decode(const Lib3dsCompressedChannel *ch, Lib3dsFloat *v, const Lib3dsWord *w, int comps)
+{
+  int i;
+
+  if (comps==4) {
+    compress_quat_decode(v, w);
+    return;
+  }
+  for (i=0; i<comps; ++i) {
+    v[i]=ch->offset[i] + w[i]*ch->scale[i];
+  }
+}
+
+
+/*
+ * Value of sample k as the keys hold it, decoded from w or taken from v for
+ * float keys, w is 0 then.
+ */
+static void
+compress_sample(const Lib3dsCompressedChannel *ch, Lib3dsFloat *a, const Lib3dsFloat *v, const Lib3dsWord *w,
+  Lib3dsDword k, int comps)
+{
+  if (w) {
+    compress_decode(ch, a, &w[k*COMPRESS_WORDS(comps)], comps);
+  }
+  else {
+    memcpy(a, &v[k*comps], comps*sizeof(Lib3dsFloat));
+  }
+}
+
+
+/*
+ * Linear interpolation, normalized and along the short arc for rotations.
+ */
+static void
+compress_lerp(Lib3dsFloat *c, const Lib3dsFloat *a, const Lib3dsFloat *b, int comps, Lib3dsFloat u)
+{
+  Lib3dsFloat s=1.0f;
+  int i;
+
+  if ((comps==4) && (a[0]*b[0] + a[1]*b[1] + a[2]*b[2] + a[3]*b[3]<0)) {
+    s=-1.0f;
+  }
+  for (i=0; i<comps; ++i) {
+    c[i]=a[i] + u*(s*b[i] - a[i]);
+  }
+  if (comps==4) {
+    lib3ds_quat_normalize(c);
+  }
+}
+
+
+/*
+ * For rotations limit is the distance of unit quaternions that far apart,
+ * 2*sin(angle/4), which unlike their dot product is accurate for small
+ * angles.
+ */
+static Lib3dsBool
+compress_within(const Lib3dsFloat *a, const Lib3dsFloat *b, int comps, Lib3dsFloat limit)
+{
+  Lib3dsFloat d,e;
+  int i;
+
+  if (comps==4) {
+    d=e=0;
+    for (i=0; i<4; ++i) {
+      d+=(a[i]-b[i])*(a[i]-b[i]);
+      e+=(a[i]+b[i])*(a[i]+b[i]);
+    }
+    return(((d<e) ? d : e)<=limit*limit);
+  }
+  for (i=0; i<comps; ++i) {
+    if (fabs(a[i]-b[i])>limit) {
+      return(LIB3DS_FALSE);
+    }
+  }
+  return(LIB3DS_TRUE);
+}
+
+
+/*
+ * True if the samples between first and last are reconstructed within the
+ * limit by interpolating the key values of first and last.
+ */
+static Lib3dsBool
+compress_segment_fits(const Lib3dsCompressedChannel *ch, const Lib3dsFloat *v, const Lib3dsWord *w,
+  int comps, Lib3dsFloat limit, Lib3dsDword first, Lib3dsDword last)
+{
+  Lib3dsFloat a[4],b[4],c[4];
+  Lib3dsDword k;
+
+  compress_sample(ch, a, v, w, first, comps);
+  compress_sample(ch, b, v, w, last, comps);
+  for (k=first+1; k<last; ++k) {
+    compress_lerp(c, a, b, comps, (Lib3dsFloat)(k-first)/(last-first));
+    if (!compress_within(c, &v[k*comps], comps, limit)) {
+      return(LIB3DS_FALSE);
+    }
+  }
+  return(LIB3DS_TRUE);
+}
+
+
+/*
+ * Quantizes the samples of a channel and keeps the keys linear
+ * interpolation needs, greedily extending every segment as far as it fits.
+ * If a quantized sample is off by more than the limit, a range too wide
+ * for 16 bits, the channel keeps float keys instead.
+ */
+static Lib3dsBool
+compress_channel(Lib3dsCompressedChannel *ch, const Lib3dsFloat *v, Lib3dsDword samples, int comps,
+  Lib3dsFloat limit)
+{
+  Lib3dsWord *w;
+  Lib3dsFloat a[4];
+  Lib3dsDword i,j,k;
+  int n=COMPRESS_WORDS(comps),c;
+
+  if (comps!=4) {
+    for (c=0; c<comps; ++c) {
+      Lib3dsFloat lo=v[c],hi=v[c];
+      for (k=1; k<samples; ++k) {
+        if (v[k*comps+c]<lo) {
+          lo=v[k*comps+c];
+        }
+        if (v[k*comps+c]>hi) {
+          hi=v[k*comps+c];
+        }
+      }
+      ch->offset[c]=lo;
+      ch->scale[c]=(hi-lo)/65535;
+    }
+  }
+  w=(Lib3dsWord*)calloc(sizeof(Lib3dsWord), samples*n);
+  ch->sampleL=(Lib3dsWord*)calloc(sizeof(Lib3dsWord), samples);
+  if (!w || !ch->sampleL) {
+    free(w);
+    return(LIB3DS_FALSE);
+  }
+  for (k=0; k<samples; ++k) {
+    compress_encode(ch, &w[k*n], &v[k*comps], comps);
+    compress_decode(ch, a, &w[k*n], comps);
+    if (!compress_within(a, &v[k*comps], comps, limit)) {
+      break;
+    }
+  }
+  if (k<samples) {
+    free(w);
+    w=0;
+  }
+
+  /* constant channels keep a single key */
+  compress_sample(ch, a, v, w, 0, comps);
+  for (k=1; k<samples; ++k) {
+    if (!compress_within(a, &v[k*comps], comps, limit)) {
+      break;
+    }
+  }
+  ch->keys=1;
+  if (k<samples) {
+    for (i=0; i<samples-1; i=j) {
+      j=i+1;
+      while ((j+1<samples) && compress_segment_fits(ch, v, w, comps, limit, i, j+1)) {
+        ++j;
+      }
+      ch->sampleL[ch->keys++]=(Lib3dsWord)j;
+      if (w) {
+        memmove(&w[(ch->keys-1)*n], &w[j*n], n*sizeof(Lib3dsWord));
+      }
+    }
+  }
+  if (!w) {
+    ch->floatL=(Lib3dsFloat*)malloc(ch->keys*comps*sizeof(Lib3dsFloat));
+    if (!ch->floatL) {
+      return(LIB3DS_FALSE);
+    }
+    for (k=0; k<ch->keys; ++k) {
+      memcpy(&ch->floatL[k*comps], &v[ch->sampleL[k]*comps], comps*sizeof(Lib3dsFloat));
+    }
+    return(LIB3DS_TRUE);
+  }
+  ch->valueL=(Lib3dsWord*)realloc(w, ch->keys*n*sizeof(Lib3dsWord));
+  if (!ch->valueL) {
+    ch->valueL=w;
+  }
+  return(LIB3DS_TRUE);
+}
+
+
+/*!
+ * Compress a baked animation.
+ *
+ * Samples that linear interpolation between their neighbouring keys
+ * reconstructs within the tolerance are dropped. The remaining keys are
+ * quantized to 16 bits per component, rotations to 48 bits, the dropped
+ * samples are checked against the quantized keys. Channels whose range is
+ * too wide for 16 bit steps within the tolerance keep float keys.
+ *
+ * \param anim The baked animation, at most 65535 samples long. It can be
+ *        freed afterwards.
+ * \param pos_error Tolerance of positions, also used for scale, colours,
+ *        fov, roll, hotspot and falloff.
+ * \param rot_error Tolerance of rotations in radians.
+ *
+ * \return The compressed animation, or NULL on failure.
+ *
+ * \ingroup bake
+ */
+Lib3dsCompressedAnimation*
+lib3ds_baked_animation_compress(Lib3dsBakedAnimation *anim, Lib3dsFloat pos_error, Lib3dsFloat rot_error)
+{
+  Lib3dsCompressedAnimation *c;
+  Lib3dsFloat *hide;
+  Lib3dsFloat rot_limit;
+  Lib3dsDword i,k;
+  Lib3dsBool ok=LIB3DS_TRUE;
+
+  ASSERT(anim);
+  if (anim->samples>65535) {
+    return(0);
+  }
+  c=(Lib3dsCompressedAnimation*)calloc(sizeof(Lib3dsCompressedAnimation), 1);
+  hide=(Lib3dsFloat*)calloc(sizeof(Lib3dsFloat), anim->samples);
+  if (!c || !hide) {
+    free(c);
+    free(hide);
+    return(0);
+  }
+  c->rate=anim->rate;
+  c->samples=anim->samples;
+  c->nodes=anim->nodes;
+  c->nodeL=(Lib3dsCompressedNode*)calloc(sizeof(Lib3dsCompressedNode), anim->nodes ? anim->nodes : 1);
+  if (!c->nodeL) {
+    free(c);
+    free(hide);
+    return(0);
+  }
+  rot_limit=(Lib3dsFloat)(2*sin(rot_error/4));
+
+  for (i=0; ok && (i<anim->nodes); ++i) {
+    Lib3dsBakedNode *b=&anim->nodeL[i];
+    Lib3dsCompressedNode *n=&c->nodeL[i];
+
+    n->node=b->node;
+    if (b->posL) {
+      ok=ok && compress_channel(&n->pos, b->posL[0], anim->samples, 3, pos_error);
+    }
+    if (b->rotL) {
+      ok=ok && compress_channel(&n->rot, b->rotL[0], anim->samples, 4, rot_limit);
+    }
+    if (b->sclL) {
+      ok=ok && compress_channel(&n->scl, b->sclL[0], anim->samples, 3, pos_error);
+    }
+    if (b->colL) {
+      ok=ok && compress_channel(&n->col, b->colL[0], anim->samples, 3, pos_error);
+    }
+    if (b->fovL) {
+      ok=ok && compress_channel(&n->fov, b->fovL, anim->samples, 1, pos_error);
+    }
+    if (b->rollL) {
+      ok=ok && compress_channel(&n->roll, b->rollL, anim->samples, 1, pos_error);
+    }
+    if (b->hotspotL) {
+      ok=ok && compress_channel(&n->hotspot, b->hotspotL, anim->samples, 1, pos_error);
+    }
+    if (b->falloffL) {
+      ok=ok && compress_channel(&n->falloff, b->falloffL, anim->samples, 1, pos_error);
+    }
+    if (b->hideL) {
+      for (k=0; k<anim->samples; ++k) {
+        hide[k]=b->hideL[k] ? 1.0f : 0.0f;
+      }
+      ok=ok && compress_channel(&n->hide, hide, anim->samples, 1, 0);
+    }
+  }
+  free(hide);
+  if (!ok) {
+    lib3ds_compressed_animation_free(c);
+    return(0);
+  }
+  return(c);
+}
+
+
+static void
+compress_channel_free(Lib3dsCompressedChannel *ch)
+{
+  free(ch->sampleL);
+  free(ch->valueL);
+  free(ch->floatL);
+}
+
+
+/*!
+ * \ingroup bake
+ */
+void
+lib3ds_compressed_animation_free(Lib3dsCompressedAnimation *anim)
+{
+  Lib3dsDword i;
+
+  ASSERT(anim);
+  for (i=0; i<anim->nodes; ++i) {
+    Lib3dsCompressedNode *n=&anim->nodeL[i];
+    compress_channel_free(&n->pos);
+    compress_channel_free(&n->rot);
+    compress_channel_free(&n->scl);
+    compress_channel_free(&n->col);
+    compress_channel_free(&n->fov);
+    compress_channel_free(&n->roll);
+    compress_channel_free(&n->hotspot);
+    compress_channel_free(&n->falloff);
+    compress_channel_free(&n->hide);
+  }
+  free(anim->nodeL);
+  free(anim);
+}
+
+
+static Lib3dsDword
+compress_channel_size(const Lib3dsCompressedChannel *ch, int comps)
+{
+  if (ch->floatL) {
+    return(ch->keys*(sizeof(Lib3dsWord) + comps*sizeof(Lib3dsFloat)));
+  }
+  return(ch->keys*sizeof(Lib3dsWord)*(1 + COMPRESS_WORDS(comps)));
+}
+
+
+/*!
+ * Memory taken by a compressed animation, in bytes.
+ *
+ * \ingroup bake
+ */
+Lib3dsDword
+lib3ds_compressed_animation_size(Lib3dsCompressedAnimation *anim)
+{
+  Lib3dsDword i,size;
+
+  ASSERT(anim);
+  size=sizeof(Lib3dsCompressedAnimation) + anim->nodes*sizeof(Lib3dsCompressedNode);
+  for (i=0; i<anim->nodes; ++i) {
+    Lib3dsCompressedNode *n=&anim->nodeL[i];
+    size+=compress_channel_size(&n->pos, 3);
+    size+=compress_channel_size(&n->rot, 4);
+    size+=compress_channel_size(&n->scl, 3);
+    size+=compress_channel_size(&n->col, 3);
+    size+=compress_channel_size(&n->fov, 1);
+    size+=compress_channel_size(&n->roll, 1);
+    size+=compress_channel_size(&n->hotspot, 1);
+    size+=compress_channel_size(&n->falloff, 1);
+    size+=compress_channel_size(&n->hide, 1);
+  }
+  return(size);
+}
+
+
+/*
+ * Finds the keys around sample position x, the cursor of the channel
+ * remembers them for the next frame.
+ */
+static Lib3dsDword
+compress_channel_segment(Lib3dsCompressedChannel *ch, Lib3dsFloat x, Lib3dsFloat *u)
+{
+  const Lib3dsWord *s=ch->sampleL;
+  Lib3dsDword i,lo,hi,mid;
+
+  if (ch->keys<2) {
+    *u=0;
+    return(0);
+  }
+  i=(Lib3dsDword)ch->cursor.index;
+  if ((i+1>=ch->keys) || (x<s[i]) || (x>=s[i+1])) {
+    if ((i+2<ch->keys) && (x>=s[i+1]) && (x<s[i+2])) {
+      ++i;
+    }
+    else {
+      lo=0;
+      hi=ch->keys;
+      while (lo<hi) {
+        mid=lo+(hi-lo)/2;
+        if (x>=s[mid]) {
+          lo=mid+1;
+        }
+        else {
+          hi=mid;
+        }
+      }
+      i=lo ? lo-1 : 0;
+      if (i>ch->keys-2) {
+        i=ch->keys-2;
+      }
+    }
+    ch->cursor.index=(Lib3dsIntd)i;
+  }
+  *u=(x-s[i])/(Lib3dsFloat)(s[i+1]-s[i]);
+  return(i);
+}
+
+
+static void
+compress_channel_eval(Lib3dsCompressedChannel *ch, Lib3dsFloat *v, Lib3dsFloat x, int comps)
+{
+  Lib3dsFloat a[4],b[4],u;
+  Lib3dsDword i;
+
+  i=compress_channel_segment(ch, x, &u);
+  compress_sample(ch, a, ch->floatL, ch->valueL, i, comps);
+  if (ch->keys<2) {
+    memcpy(v, a, comps*sizeof(Lib3dsFloat));
+    return;
+  }
+  compress_sample(ch, b, ch->floatL, ch->valueL, i+1, comps);
+  compress_lerp(v, a, b, comps, u);
+}
+
+
+/*!
+ * Set all nodes of a compressed animation to their values at time t.
+ *
+ * \see lib3ds_baked_animation_eval
+ *
+ * \ingroup bake
+ */
+void
+lib3ds_compressed_animation_eval(Lib3dsCompressedAnimation *anim, Lib3dsFloat t)
+{
+  Lib3dsFloat x;
+  Lib3dsDword i;
+
+  ASSERT(anim);
+  x=t*anim->rate;
+  if (x<0) {
+    x=0;
+  }
+  if (x>(Lib3dsFloat)(anim->samples-1)) {
+    x=(Lib3dsFloat)(anim->samples-1);
+  }
+
+  for (i=0; i<anim->nodes; ++i) {
+    Lib3dsCompressedNode *c=&anim->nodeL[i];
+    Lib3dsNode *node=c->node;
+
+    switch (node->type) {
+      case LIB3DS_UNKNOWN_NODE:
+        break;
+      case LIB3DS_AMBIENT_NODE:
+        compress_channel_eval(&c->col, node->data.ambient.col, x, 3);
+        bake_node_matrix(node, 0);
+        break;
+      case LIB3DS_OBJECT_NODE:
+        {
+          Lib3dsObjectData *n=&node->data.object;
+          Lib3dsFloat hide;
+
+          compress_channel_eval(&c->pos, n->pos, x, 3);
+          compress_channel_eval(&c->rot, n->rot, x, 4);
+          compress_channel_eval(&c->scl, n->scl, x, 3);
+          /* the baked hide samples hold until the next one */
+          compress_channel_eval(&c->hide, &hide, (Lib3dsFloat)floor(x), 1);
+          n->hide=(hide>0.5f) ? LIB3DS_TRUE : LIB3DS_FALSE;
+          bake_object_matrix(node);
+        }
+        break;
+      case LIB3DS_CAMERA_NODE:
+        {
+          Lib3dsCameraData *n=&node->data.camera;
+          compress_channel_eval(&c->pos, n->pos, x, 3);
+          compress_channel_eval(&c->fov, &n->fov, x, 1);
+          compress_channel_eval(&c->roll, &n->roll, x, 1);
+          bake_node_matrix(node, n->pos);
+        }
+        break;
+      case LIB3DS_TARGET_NODE:
+        compress_channel_eval(&c->pos, node->data.target.pos, x, 3);
+        bake_node_matrix(node, node->data.target.pos);
+        break;
+      case LIB3DS_LIGHT_NODE:
+        {
+          Lib3dsLightData *n=&node->data.light;
+          compress_channel_eval(&c->pos, n->pos, x, 3);
+          compress_channel_eval(&c->col, n->col, x, 3);
+          compress_channel_eval(&c->hotspot, &n->hotspot, x, 1);
+          compress_channel_eval(&c->falloff, &n->falloff, x, 1);
+          compress_channel_eval(&c->roll, &n->roll, x, 1);
+          bake_node_matrix(node, n->pos);
+        }
+        break;
+      case LIB3DS_SPOT_NODE:
+        compress_channel_eval(&c->pos, node->data.spot.pos, x, 3);
+        bake_node_matrix(node, node->data.spot.pos);
+        break;
+    }
+  }
+}
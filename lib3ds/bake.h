@@ -0,0 +1,129 @@
+/* -*- c -*- */
+#ifndef INCLUDED_LIB3DS_BAKE_H
+#define INCLUDED_LIB3DS_BAKE_H
+/*
+ * The 3D Studio File Format Library
+ * Copyright (C) 1996-2007 by Jan Eric Kyprianidis <www.kyprianidis.com>
+ * All rights reserved.
+ *
+ * This program is  free  software;  you can redistribute it and/or modify it
+ * under the terms of the  GNU Lesser General Public License  as published by
+ * the  Free Software Foundation;  either version 2.1 of the License,  or (at
+ * your option) any later version.
+ *
+ * This  program  is  distributed in  the  hope that it will  be useful,  but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or  FITNESS FOR A  PARTICULAR PURPOSE.  See the  GNU Lesser General Public
+ * License for more details.
+ *
+ * You should  have received  a copy of the GNU Lesser General Public License
+ * along with  this program;  if not, write to the  Free Software Foundation,
+ * Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef INCLUDED_LIB3DS_NODE_H
+#include <lib3ds/node.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!
+ * Playback rate of the 3D Studio keyframer, converts the frames of the
+ * tracks to seconds.
+ * \ingroup bake
+ */
+#define LIB3DS_FRAMES_PER_SECOND 30
+
+/**
+ * Sampled tracks of a node, arrays the node type doesn't have are 0
+ * \ingroup bake
+ */
+typedef struct Lib3dsBakedNode {
+    Lib3dsNode *node;
+    Lib3dsVector *posL;
+    Lib3dsQuat *rotL;
+    Lib3dsVector *sclL;
+    Lib3dsRgb *colL;
+    Lib3dsFloat *fovL;
+    Lib3dsFloat *rollL;
+    Lib3dsFloat *hotspotL;
+    Lib3dsFloat *falloffL;
+    Lib3dsBool *hideL;
+} Lib3dsBakedNode;
+
+/**
+ * Animation of a file sampled at a fixed rate. Parents precede their
+ * children in nodeL.
+ * \ingroup bake
+ */
+typedef struct Lib3dsBakedAnimation {
+    Lib3dsFloat rate;
+    Lib3dsDword samples;
+    Lib3dsDword nodes;
+    Lib3dsBakedNode *nodeL;
+} Lib3dsBakedAnimation;
+
+/**
+ * Keys left of a baked channel by lib3ds_baked_animation_compress(). Vector
+ * and scalar values are stored as 16 bit fractions of the range of the
+ * channel, value = offset + q*scale. Rotations take three words, the
+ * smallest three components of the quaternion and the index of the
+ * largest one. Channels that 16 bits can't hold within the tolerance keep
+ * float keys in floatL, valueL is 0 then.
+ * \ingroup bake
+ */
+typedef struct Lib3dsCompressedChannel {
+    Lib3dsDword keys;
+    Lib3dsWord *sampleL;
+    Lib3dsWord *valueL;
+    Lib3dsFloat *floatL;
+    Lib3dsFloat offset[3];
+    Lib3dsFloat scale[3];
+    Lib3dsTrackCursor cursor;
+} Lib3dsCompressedChannel;
+
+/**
+ * Compressed channels of a node, the ones the node type doesn't have are
+ * empty
+ * \ingroup bake
+ */
+typedef struct Lib3dsCompressedNode {
+    Lib3dsNode *node;
+    Lib3dsCompressedChannel pos;
+    Lib3dsCompressedChannel rot;
+    Lib3dsCompressedChannel scl;
+    Lib3dsCompressedChannel col;
+    Lib3dsCompressedChannel fov;
+    Lib3dsCompressedChannel roll;
+    Lib3dsCompressedChannel hotspot;
+    Lib3dsCompressedChannel falloff;
+    Lib3dsCompressedChannel hide;
+} Lib3dsCompressedNode;
+
+/**
+ * Baked animation with the keys that linear interpolation can't
+ * reconstruct within a tolerance
+ * \ingroup bake
+ */
+typedef struct Lib3dsCompressedAnimation {
+    Lib3dsFloat rate;
+    Lib3dsDword samples;
+    Lib3dsDword nodes;
+    Lib3dsCompressedNode *nodeL;
+} Lib3dsCompressedAnimation;
+
+extern LIB3DSAPI Lib3dsBakedAnimation* lib3ds_file_bake_animation(Lib3dsFile *file, Lib3dsFloat fps);
+extern LIB3DSAPI void lib3ds_baked_animation_free(Lib3dsBakedAnimation *anim);
+extern LIB3DSAPI void lib3ds_baked_animation_eval(Lib3dsBakedAnimation *anim, Lib3dsFloat t);
+extern LIB3DSAPI Lib3dsCompressedAnimation* lib3ds_baked_animation_compress(Lib3dsBakedAnimation *anim,
+  Lib3dsFloat pos_error, Lib3dsFloat rot_error);
+extern LIB3DSAPI void lib3ds_compressed_animation_free(Lib3dsCompressedAnimation *anim);
+extern LIB3DSAPI Lib3dsDword lib3ds_compressed_animation_size(Lib3dsCompressedAnimation *anim);
+extern LIB3DSAPI void lib3ds_compressed_animation_eval(Lib3dsCompressedAnimation *anim, Lib3dsFloat t);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -27,6 +27,7 @@
 #include <lib3ds/camera.h>
 #include <lib3ds/light.h>
 #include <lib3ds/node.h>
+#include <lib3ds/nodetable.h>
 #include <lib3ds/matrix.h>
 #include <lib3ds/vector.h>
 #include <stdlib.h>
@@ -315,6 +316,87 @@ lib3ds_file_eval(Lib3dsFile *file, Lib3dsFloat t)
 }
 
 
+/*!
+ * Evaluate the world matrices of all nodes at several times in one pass.
+ *
+ * The nodes are numbered in depth-first order, parents before their
+ * children, as in lib3ds_node_table_new(). The file is evaluated at
+ * file->current_frame again afterwards.
+ *
+ * \param file The Lib3dsFile object to be evaluated.
+ * \param times Sample times, in any order.
+ * \param n Number of samples.
+ * \param out Returned matrices, allocated by the caller with room for n
+ *        times the number of nodes. The matrix of node i at times[s] is
+ *        out[s*nodes+i].
+ *
+ * \return LIB3DS_FALSE if out of memory.
+ *
+ * \see lib3ds_node_table_eval_times
+ *
+ * \ingroup file
+ */
+Lib3dsBool
+lib3ds_file_eval_times(Lib3dsFile *file, const Lib3dsFloat *times, Lib3dsDword n, Lib3dsMatrix *out)
+{
+  Lib3dsNodeTable *table;
+  Lib3dsBool result;
+
+  ASSERT(file);
+  table=lib3ds_node_table_new(file);
+  if (!table) {
+    return(LIB3DS_FALSE);
+  }
+  result=lib3ds_node_table_eval_times(table, times, n, out);
+  lib3ds_node_table_free(table);
+  lib3ds_file_eval(file, (Lib3dsFloat)file->current_frame);
+  return(result);
+}
+
+
+/*!
+ * Classify all nodes as static or animated, lib3ds_file_eval() then skips
+ * the static ones after their first evaluation. Files are classified when
+ * they are read.
+ *
+ * \param file The Lib3dsFile object whose nodes are classified.
+ *
+ * \see lib3ds_node_classify
+ *
+ * \ingroup file
+ */
+void
+lib3ds_file_classify_nodes(Lib3dsFile *file)
+{
+  Lib3dsNode *p;
+
+  for (p=file->nodes; p!=0; p=p->next) {
+    lib3ds_node_classify(p);
+  }
+}
+
+
+/*!
+ * Precompute the track segments of all nodes, which speeds up
+ * lib3ds_file_eval() for the price of some memory.
+ *
+ * \param file The Lib3dsFile object to be prepared.
+ *
+ * \see lib3ds_node_precompute_tracks
+ *
+ * \ingroup file
+ */
+void
+lib3ds_file_precompute_tracks(Lib3dsFile *file)
+{
+  Lib3dsNode *p;
+
+  for (p=file->nodes; p!=0; p=p->next) {
+    lib3ds_node_precompute_tracks(p);
+  }
+}
+
+
 static Lib3dsBool
 named_object_read(Lib3dsFile *file, Lib3dsIo *io)
 {
@@ -805,6 +887,7 @@ lib3ds_file_read(Lib3dsFile *file, Lib3dsIo *io)
   }
 
   lib3ds_chunk_read_end(&c, io);
+  lib3ds_file_classify_nodes(file);
   return(LIB3DS_TRUE);
 }
 
@@ -1337,6 +1420,51 @@ lib3ds_file_mesh_by_name(Lib3dsFile *file, const char *name)
 }
 
 
+/*!
+ * Interpolate the morph targets of an object node.
+ *
+ * Blends the point lists of the meshes named by the keys of the node's
+ * morph track around t. The morph cursor of the node is updated.
+ *
+ * \param file The Lib3dsFile holding the target meshes.
+ * \param node The object node.
+ * \param t Time value.
+ * \param pointL Returned points, allocated by the caller.
+ * \param points Size of pointL, every target must have this many points.
+ *
+ * \return LIB3DS_FALSE if the node has no morph keys or a target is missing
+ *         or doesn't match points, pointL is left alone then.
+ *
+ * \see lib3ds_morph_track_eval_blend
+ * \ingroup file
+ */
+Lib3dsBool
+lib3ds_file_morph_node(Lib3dsFile *file, Lib3dsNode *node, Lib3dsFloat t,
+  Lib3dsPoint *pointL, Lib3dsDword points)
+{
+  Lib3dsObjectData *n;
+  char a[64],b[64];
+  Lib3dsFloat u;
+  Lib3dsMesh *ma,*mb;
+
+  ASSERT(file && node);
+  if (node->type!=LIB3DS_OBJECT_NODE) {
+    return(LIB3DS_FALSE);
+  }
+  n=&node->data.object;
+  if (!lib3ds_morph_track_eval_blend(&n->morph_track, &n->morph_cursor, a, b, &u, t)) {
+    return(LIB3DS_FALSE);
+  }
+  ma=lib3ds_file_mesh_by_name(file, a);
+  mb=(strcmp(a,b)==0) ? ma : lib3ds_file_mesh_by_name(file, b);
+  if (!ma || !mb || (ma->points!=points) || (mb->points!=points)) {
+    return(LIB3DS_FALSE);
+  }
+  lib3ds_mesh_lerp_points(pointL, ma->pointL, mb->pointL, points, u);
+  return(LIB3DS_TRUE);
+}
+
+
 /*!
  * Dump all Lib3dsMesh objects found in a Lib3dsFile object.
  *
@@ -1721,6 +1849,20 @@ lib3ds_file_node_by_id(Lib3dsFile *file, Lib3dsWord node_id)
 }
 
 
+/*
+ * Drops the classification of nodes when the hierarchy changes, they are
+ * evaluated every time until lib3ds_file_classify_nodes() is called again.
+ */
+static void
+file_unclassify_nodes(Lib3dsNode *node)
+{
+  for (; node!=0; node=node->next) {
+    node->eval_flags=0;
+    file_unclassify_nodes(node->childs);
+  }
+}
+
+
 /*!
  * Insert a new node into a Lib3dsFile object.
  *
@@ -1749,6 +1891,8 @@ lib3ds_file_insert_node(Lib3dsFile *file, Lib3dsNode *node)
   ASSERT(!node->next);
   ASSERT(!node->parent);
 
+  file_unclassify_nodes(file->nodes);
+  file_unclassify_nodes(node);
   parent=0;
   if (node->parent_id!=LIB3DS_NO_PARENT) {
     parent=lib3ds_file_node_by_id(file, node->parent_id);
@@ -1813,6 +1957,7 @@ lib3ds_file_remove_node(Lib3dsFile *file, Lib3dsNode *node)
 {
   Lib3dsNode *p,*n;
 
+  file_unclassify_nodes(file->nodes);
   if (node->parent) {
     for (p=0,n=node->parent->childs; n; p=n,n=n->next) {
       if (n==node) {
@@ -1923,19 +2068,16 @@ file_bounding_box_of_nodes_impl(Lib3dsNode *node, Lib3dsFile *file, Lib3dsBool i
           mesh = lib3ds_file_mesh_by_name(file, node->name);
         if (mesh) {
           Lib3dsMatrix inv_matrix, M;
-          Lib3dsVector v;
-          unsigned i;
 
           lib3ds_matrix_copy(inv_matrix, mesh->matrix);
-          lib3ds_matrix_inv(inv_matrix);
+          lib3ds_matrix_inv_affine(inv_matrix);
           lib3ds_matrix_copy(M, node->matrix);
           lib3ds_matrix_translate_xyz(M, -node->data.object.pivot[0], -node->data.object.pivot[1], -node->data.object.pivot[2]);
           lib3ds_matrix_mult(M, inv_matrix);
 
-          for (i=0; i<mesh->points; ++i) {
-            lib3ds_vector_transform(v, M, mesh->pointL[i].pos);
-            lib3ds_vector_min(bmin, v);
-            lib3ds_vector_max(bmax, v);
+          if (mesh->points) {
+            lib3ds_vector_transform_bounds(M, mesh->pointL[0].pos, sizeof(Lib3dsPoint), mesh->points,
+              bmin, bmax);
           }
         }
       }
@@ -35,6 +35,9 @@
 #ifndef INCLUDED_LIB3DS_VIEWPORT_H
 #include <lib3ds/viewport.h>
 #endif
+#ifndef INCLUDED_LIB3DS_MESH_H
+#include <lib3ds/mesh.h>
+#endif
 
 #ifdef __cplusplus
 extern "C" {
@@ -72,6 +75,10 @@ extern LIB3DSAPI Lib3dsBool lib3ds_file_save(Lib3dsFile *file, const char *filen
 extern LIB3DSAPI Lib3dsFile* lib3ds_file_new();
 extern LIB3DSAPI void lib3ds_file_free(Lib3dsFile *file);
 extern LIB3DSAPI void lib3ds_file_eval(Lib3dsFile *file, Lib3dsFloat t);
+extern LIB3DSAPI Lib3dsBool lib3ds_file_eval_times(Lib3dsFile *file, const Lib3dsFloat *times, Lib3dsDword n,
+  Lib3dsMatrix *out);
+extern LIB3DSAPI void lib3ds_file_precompute_tracks(Lib3dsFile *file);
+extern LIB3DSAPI void lib3ds_file_classify_nodes(Lib3dsFile *file);
 extern LIB3DSAPI Lib3dsBool lib3ds_file_read(Lib3dsFile *file, Lib3dsIo *io);
 extern LIB3DSAPI Lib3dsBool lib3ds_file_write(Lib3dsFile *file, Lib3dsIo *io);
 extern LIB3DSAPI void lib3ds_file_insert_material(Lib3dsFile *file, Lib3dsMaterial *material);
@@ -81,6 +88,8 @@ extern LIB3DSAPI void lib3ds_file_dump_materials(Lib3dsFile *file);
 extern LIB3DSAPI void lib3ds_file_insert_mesh(Lib3dsFile *file, Lib3dsMesh *mesh);
 extern LIB3DSAPI void lib3ds_file_remove_mesh(Lib3dsFile *file, Lib3dsMesh *mesh);
 extern LIB3DSAPI Lib3dsMesh* lib3ds_file_mesh_by_name(Lib3dsFile *file, const char *name);
+extern LIB3DSAPI Lib3dsBool lib3ds_file_morph_node(Lib3dsFile *file, Lib3dsNode *node, Lib3dsFloat t,
+  Lib3dsPoint *pointL, Lib3dsDword points);
 extern LIB3DSAPI void lib3ds_file_dump_meshes(Lib3dsFile *file);
 extern LIB3DSAPI void lib3ds_file_dump_instances(Lib3dsFile *file);
 extern LIB3DSAPI void lib3ds_file_insert_camera(Lib3dsFile *file, Lib3dsCamera *camera);
@@ -21,7 +21,9 @@
  */
 #include <lib3ds/matrix.h>
 #include <lib3ds/quat.h>
+#include <lib3ds/simd.h>
 #include <lib3ds/vector.h>
+#include <lib3ds/vecmath.h>
 #include <string.h>
 #include <math.h>
 
@@ -192,17 +194,9 @@ void
 lib3ds_matrix_mult(Lib3dsMatrix m, Lib3dsMatrix n)
 {
   Lib3dsMatrix tmp;
-  int i,j,k;
-  Lib3dsFloat ab;
 
   memcpy(tmp, m, sizeof(Lib3dsMatrix)); 
-  for (j=0; j<4; j++) {
-    for (i=0; i<4; i++) {
-      ab=0.0f;
-      for (k=0; k<4; k++) ab+=tmp[k][i]*n[j][k];
-      m[j][i]=ab;
-    }
-  }
+  lib3ds_simd_matrix_mult(m, tmp, n);
 }
 
 
@@ -437,6 +431,57 @@ lib3ds_matrix_inv(Lib3dsMatrix m)
 }
 
 
+/*!
+ * Invert an affine matrix, whose last row is 0 0 0 1.
+ *
+ * Faster than lib3ds_matrix_inv() for the matrices of meshes and nodes.
+ * The 3x3 part is inverted by cofactors and the translation is
+ * transformed by the result.
+ *
+ * \param m Matrix to invert.
+ *
+ * \return LIB3DS_TRUE on success, LIB3DS_FALSE on failure.
+ *
+ * \see lib3ds_matrix_inv
+ * \ingroup matrix
+ */
+Lib3dsBool
+lib3ds_matrix_inv_affine(Lib3dsMatrix m)
+{
+  Lib3dsMatrix a;
+  Lib3dsFloat det,d;
+  int i;
+
+  a[0][0]=m[1][1]*m[2][2] - m[2][1]*m[1][2];
+  a[0][1]=m[2][1]*m[0][2] - m[0][1]*m[2][2];
+  a[0][2]=m[0][1]*m[1][2] - m[1][1]*m[0][2];
+  det=m[0][0]*a[0][0] + m[1][0]*a[0][1] + m[2][0]*a[0][2];
+  if (fabs(det)<LIB3DS_EPSILON) {
+    return(LIB3DS_FALSE);
+  }
+  a[1][0]=m[2][0]*m[1][2] - m[1][0]*m[2][2];
+  a[1][1]=m[0][0]*m[2][2] - m[2][0]*m[0][2];
+  a[1][2]=m[1][0]*m[0][2] - m[0][0]*m[1][2];
+  a[2][0]=m[1][0]*m[2][1] - m[2][0]*m[1][1];
+  a[2][1]=m[2][0]*m[0][1] - m[0][0]*m[2][1];
+  a[2][2]=m[0][0]*m[1][1] - m[1][0]*m[0][1];
+
+  d=1.0f/det;
+  for (i=0; i<3; i++) {
+    a[i][0]*=d;
+    a[i][1]*=d;
+    a[i][2]*=d;
+    a[i][3]=0.0f;
+  }
+  for (i=0; i<3; i++) {
+    a[3][i]=-(a[0][i]*m[3][0] + a[1][i]*m[3][1] + a[2][i]*m[3][2]);
+  }
+  a[3][3]=1.0f;
+  memcpy(m, a, sizeof(Lib3dsMatrix));
+  return(LIB3DS_TRUE);
+}
+
+
 /*!
  * Apply a translation to a matrix.
  *
@@ -505,6 +550,41 @@ lib3ds_matrix_scale(Lib3dsMatrix m, Lib3dsVector s)
 }
 
 
+/*
+ * Rotation matrix of a quaternion, which needn't be normalized.
+ */
+static void
+matrix_quat_rotation(Lib3dsMatrix R, Lib3dsQuat q)
+{
+  Lib3dsFloat s,xs,ys,zs,wx,wy,wz,xx,xy,xz,yy,yz,zz,l;
+
+  l=q[0]*q[0] + q[1]*q[1] + q[2]*q[2] + q[3]*q[3];
+  if (fabs(l)<LIB3DS_EPSILON) {
+    s=1.0f;
+  }
+  else {
+    s=2.0f/l;
+  }
+
+  xs = q[0] * s;   ys = q[1] * s;  zs = q[2] * s;
+  wx = q[3] * xs;  wy = q[3] * ys; wz = q[3] * zs;
+  xx = q[0] * xs;  xy = q[0] * ys; xz = q[0] * zs;
+  yy = q[1] * ys;  yz = q[1] * zs; zz = q[2] * zs;
+
+  R[0][0]=1.0f - (yy +zz);
+  R[1][0]=xy - wz;
+  R[2][0]=xz + wy;
+  R[0][1]=xy + wz;
+  R[1][1]=1.0f - (xx +zz);
+  R[2][1]=yz - wx;
+  R[0][2]=xz - wy;
+  R[1][2]=yz + wx;
+  R[2][2]=1.0f - (xx + yy);
+  R[3][0]=R[3][1]=R[3][2]=R[0][3]=R[1][3]=R[2][3]=0.0f;
+  R[3][3]=1.0f;
+}
+
+
 /*!
  * Apply a rotation about the x axis to a matrix.
  *
@@ -591,35 +671,40 @@ lib3ds_matrix_rotate_z(Lib3dsMatrix m, Lib3dsFloat phi)
 void
 lib3ds_matrix_rotate(Lib3dsMatrix m, Lib3dsQuat q)
 {
-  Lib3dsFloat s,xs,ys,zs,wx,wy,wz,xx,xy,xz,yy,yz,zz,l;
   Lib3dsMatrix R;
 
-  l=q[0]*q[0] + q[1]*q[1] + q[2]*q[2] + q[3]*q[3];
-  if (fabs(l)<LIB3DS_EPSILON) {
-    s=1.0f;
-  }
-  else {
-    s=2.0f/l;
-  }
+  matrix_quat_rotation(R, q);
+  lib3ds_matrix_mult(m,R);
+}
 
-  xs = q[0] * s;   ys = q[1] * s;  zs = q[2] * s;
-  wx = q[3] * xs;  wy = q[3] * ys; wz = q[3] * zs;
-  xx = q[0] * xs;  xy = q[0] * ys; xz = q[0] * zs;
-  yy = q[1] * ys;  yz = q[1] * zs; zz = q[2] * zs;
 
-  R[0][0]=1.0f - (yy +zz);
-  R[1][0]=xy - wz;
-  R[2][0]=xz + wy;
-  R[0][1]=xy + wz;
-  R[1][1]=1.0f - (xx +zz);
-  R[2][1]=yz - wx;
-  R[0][2]=xz - wy;
-  R[1][2]=yz + wx;
-  R[2][2]=1.0f - (xx + yy);
-  R[3][0]=R[3][1]=R[3][2]=R[0][3]=R[1][3]=R[2][3]=0.0f;
-  R[3][3]=1.0f;
+/*!
+ * Build the matrix that scales by s, then rotates by q and then
+ * translates by t.
+ *
+ * Same as lib3ds_matrix_identity() followed by lib3ds_matrix_translate(),
+ * lib3ds_matrix_rotate() and lib3ds_matrix_scale(), without the matrix
+ * products.
+ *
+ * \param m Returned matrix.
+ * \param t Translation.
+ * \param q Rotation.
+ * \param s Scale factors.
+ *
+ * \ingroup matrix
+ */
+void
+lib3ds_matrix_from_trs(Lib3dsMatrix m, Lib3dsVector t, Lib3dsQuat q, Lib3dsVector s)
+{
+  int i;
 
-  lib3ds_matrix_mult(m,R);
+  matrix_quat_rotation(m, q);
+  for (i=0; i<3; i++) {
+    m[0][i]*=s[0];
+    m[1][i]*=s[1];
+    m[2][i]*=s[2];
+    m[3][i]=t[i];
+  }
 }
 
 
@@ -659,8 +744,8 @@ lib3ds_matrix_camera(Lib3dsMatrix matrix, Lib3dsVector pos,
   Lib3dsMatrix M;
   Lib3dsVector x, y, z;
 
-  lib3ds_vector_sub(y, tgt, pos);
-  lib3ds_vector_normalize(y);
+  lib3ds_vector_sub_inline(y, tgt, pos);
+  lib3ds_vector_normalize_inline(y);
 
   if (y[0] != 0. || y[1] != 0) {
     z[0] = 0;
@@ -673,10 +758,10 @@ lib3ds_matrix_camera(Lib3dsMatrix matrix, Lib3dsVector pos,
     z[2] = 0;
   }
 
-  lib3ds_vector_cross(x, y, z);
-  lib3ds_vector_cross(z, x, y);
-  lib3ds_vector_normalize(x);
-  lib3ds_vector_normalize(z);
+  lib3ds_vector_cross_inline(x, y, z);
+  lib3ds_vector_cross_inline(z, x, y);
+  lib3ds_vector_normalize_inline(x);
+  lib3ds_vector_normalize_inline(z);
 
   lib3ds_matrix_identity(M);
   M[0][0] = x[0];
@@ -24,10 +24,14 @@
 #include <lib3ds/chunk.h>
 #include <lib3ds/vector.h>
 #include <lib3ds/matrix.h>
+#include <lib3ds/vecmath.h>
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
 #include <float.h>
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
 
 
 /*!
@@ -443,8 +447,51 @@ lib3ds_mesh_bounding_box(Lib3dsMesh *mesh, Lib3dsVector bmin, Lib3dsVector bmax)
   bmax[0] = bmax[1] = bmax[2] = FLT_MIN; 
 
   for (i=0; i<mesh->points; ++i) {
-    lib3ds_vector_min(bmin, mesh->pointL[i].pos);
-    lib3ds_vector_max(bmax, mesh->pointL[i].pos);
+    lib3ds_vector_min_inline(bmin, mesh->pointL[i].pos);
+    lib3ds_vector_max_inline(bmax, mesh->pointL[i].pos);
+  }
+}
+
+
+/*!
+ * Blend two point lists, out = a + (b-a)*u.
+ *
+ * Used to interpolate between the morph targets of a mesh. out may be
+ * a or b.
+ *
+ * \param out Returned points.
+ * \param a Points for u=0.
+ * \param b Points for u=1.
+ * \param points Number of points in out, a and b.
+ * \param u Blend factor.
+ *
+ * \ingroup mesh
+ */
+void
+lib3ds_mesh_lerp_points(Lib3dsPoint *out, const Lib3dsPoint *a, const Lib3dsPoint *b,
+  Lib3dsDword points, Lib3dsFloat u)
+{
+  Lib3dsFloat *o=out[0].pos;
+  const Lib3dsFloat *p=a[0].pos;
+  const Lib3dsFloat *q=b[0].pos;
+  Lib3dsDword n=3*points;
+  Lib3dsDword i=0;
+
+  if (!points) {
+    return;
+  }
+#ifdef __SSE__
+  {
+    __m128 u4=_mm_set1_ps(u);
+    for (; i+4<=n; i+=4) {
+      __m128 p4=_mm_loadu_ps(p+i);
+      __m128 q4=_mm_loadu_ps(q+i);
+      _mm_storeu_ps(o+i, _mm_add_ps(p4, _mm_mul_ps(_mm_sub_ps(q4, p4), u4)));
+    }
+  }
+#endif
+  for (; i<n; ++i) {
+    o[i]=p[i]+(q[i]-p[i])*u;
   }
 }
 
@@ -518,33 +565,33 @@ lib3ds_mesh_calculate_normals(Lib3dsMesh *mesh, Lib3dsVector *normalL)
       ASSERT(f->points[j]<mesh->points);
 
       if (f->smoothing) {
-        lib3ds_vector_zero(n);
+        lib3ds_vector_zero_inline(n);
         k=0;
         for (p=fl[f->points[j]]; p; p=p->next) {
           found=0;
           for (l=0; l<k; ++l) {
 	    if( l >= 128 )
 	      printf("array N overflow: i=%d, j=%d, k=%d\n", i,j,k);
-            if (fabs(lib3ds_vector_dot(N[l], p->face->normal)-1.0)<1e-5) {
+            if (fabs(lib3ds_vector_dot_inline(N[l], p->face->normal)-1.0)<1e-5) {
               found=1;
               break;
             }
           }
           if (!found) {
             if (f->smoothing & p->face->smoothing) {
-              lib3ds_vector_add(n,n, p->face->normal);
-              lib3ds_vector_copy(N[k], p->face->normal);
+              lib3ds_vector_add_inline(n,n, p->face->normal);
+              lib3ds_vector_copy_inline(N[k], p->face->normal);
               ++k;
             }
           }
         }
       } 
       else {
-        lib3ds_vector_copy(n, f->normal);
+        lib3ds_vector_copy_inline(n, f->normal);
       }
-      lib3ds_vector_normalize(n);
+      lib3ds_vector_normalize_inline(n);
 
-      lib3ds_vector_copy(normalL[3*i+j], n);
+      lib3ds_vector_copy_inline(normalL[3*i+j], n);
     }
   }
 
@@ -581,7 +628,7 @@ lib3ds_mesh_dump(Lib3dsMesh *mesh)
   lib3ds_matrix_dump(mesh->matrix);
   printf("  point list:\n");
   for (i=0; i<mesh->points; ++i) {
-    lib3ds_vector_copy(p, mesh->pointL[i].pos);
+    lib3ds_vector_copy_inline(p, mesh->pointL[i].pos);
     printf ("    %8f %8f %8f\n", p[0], p[1], p[2]);
   }
   printf("  facelist:\n");
@@ -736,7 +783,7 @@ lib3ds_mesh_read(Lib3dsMesh *mesh, Lib3dsIo *io)
       ASSERT(mesh->faceL[j].points[0]<mesh->points);
       ASSERT(mesh->faceL[j].points[1]<mesh->points);
       ASSERT(mesh->faceL[j].points[2]<mesh->points);
-      lib3ds_vector_normal(
+      lib3ds_vector_normal_inline(
         mesh->faceL[j].normal,
         mesh->pointL[mesh->faceL[j].points[0]].pos,
         mesh->pointL[mesh->faceL[j].points[1]].pos,
@@ -750,19 +797,17 @@ lib3ds_mesh_read(Lib3dsMesh *mesh, Lib3dsIo *io)
     /* Flip X coordinate of vertices if mesh matrix 
        has negative determinant */
     Lib3dsMatrix inv_matrix, M;
-    Lib3dsVector tmp;
-    unsigned i;
 
     lib3ds_matrix_copy(inv_matrix, mesh->matrix);
-    lib3ds_matrix_inv(inv_matrix);
+    lib3ds_matrix_inv_affine(inv_matrix);
 
     lib3ds_matrix_copy(M, mesh->matrix);
     lib3ds_matrix_scale_xyz(M, -1.0f, 1.0f, 1.0f);
     lib3ds_matrix_mult(M, inv_matrix);
 
-    for (i=0; i<mesh->points; ++i) {
-      lib3ds_vector_transform(tmp, M, mesh->pointL[i].pos);
-      lib3ds_vector_copy(mesh->pointL[i].pos, tmp);
+    if (mesh->points) {
+      lib3ds_vector_transform_array(mesh->pointL[0].pos, sizeof(Lib3dsPoint), M,
+        mesh->pointL[0].pos, sizeof(Lib3dsPoint), mesh->points);
     }
   }
 
@@ -800,7 +845,7 @@ point_array_write(Lib3dsMesh *mesh, Lib3dsIo *io)
     Lib3dsVector tmp;
 
     lib3ds_matrix_copy(inv_matrix, mesh->matrix);
-    lib3ds_matrix_inv(inv_matrix);
+    lib3ds_matrix_inv_affine(inv_matrix);
     lib3ds_matrix_copy(M, mesh->matrix);
     lib3ds_matrix_scale_xyz(M, -1.0f, 1.0f, 1.0f);
     lib3ds_matrix_mult(M, inv_matrix);
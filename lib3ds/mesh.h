@@ -149,6 +149,8 @@ extern LIB3DSAPI void lib3ds_mesh_free_texel_list(Lib3dsMesh *mesh);
 extern LIB3DSAPI Lib3dsBool lib3ds_mesh_new_face_list(Lib3dsMesh *mesh, Lib3dsDword flags);
 extern LIB3DSAPI void lib3ds_mesh_free_face_list(Lib3dsMesh *mesh);
 extern LIB3DSAPI void lib3ds_mesh_bounding_box(Lib3dsMesh *mesh, Lib3dsVector bmin, Lib3dsVector bmax);
+extern LIB3DSAPI void lib3ds_mesh_lerp_points(Lib3dsPoint *out, const Lib3dsPoint *a, const Lib3dsPoint *b,
+  Lib3dsDword points, Lib3dsFloat u);
 extern LIB3DSAPI void lib3ds_mesh_calculate_normals(Lib3dsMesh *mesh, Lib3dsVector *normalL);
 extern LIB3DSAPI void lib3ds_mesh_dump(Lib3dsMesh *mesh);
 extern LIB3DSAPI Lib3dsBool lib3ds_mesh_read(Lib3dsMesh *mesh, Lib3dsIo *io);
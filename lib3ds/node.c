@@ -236,11 +236,173 @@ lib3ds_node_free(Lib3dsNode *node)
 }
 
 
+static void
+node_eval_data(Lib3dsNode *node, Lib3dsFloat t)
+{
+  switch (node->type) {
+    case LIB3DS_UNKNOWN_NODE:
+      {
+        ASSERT(LIB3DS_FALSE);
+      }
+      break;
+    case LIB3DS_AMBIENT_NODE:
+      {
+        Lib3dsAmbientData *n=&node->data.ambient;
+        lib3ds_lin3_track_eval_cursor(&n->col_track, &n->col_cursor, n->col, t);
+      }
+      break;
+    case LIB3DS_OBJECT_NODE:
+      {
+        Lib3dsObjectData *n=&node->data.object;
+
+        lib3ds_lin3_track_eval_cursor(&n->pos_track, &n->pos_cursor, n->pos, t);
+        lib3ds_quat_track_eval_cursor(&n->rot_track, &n->rot_cursor, n->rot, t);
+        if (n->scl_track.keys) {
+          lib3ds_lin3_track_eval_cursor(&n->scl_track, &n->scl_cursor, n->scl, t);
+        }
+        else {
+          n->scl[0] = n->scl[1] = n->scl[2] = 1.0f;
+        }
+        lib3ds_bool_track_eval_cursor(&n->hide_track, &n->hide_cursor, &n->hide, t);
+        lib3ds_morph_track_eval_cursor(&n->morph_track, &n->morph_cursor, n->morph, t);
+      }
+      break;
+    case LIB3DS_CAMERA_NODE:
+      {
+        Lib3dsCameraData *n=&node->data.camera;
+        lib3ds_lin3_track_eval_cursor(&n->pos_track, &n->pos_cursor, n->pos, t);
+        lib3ds_lin1_track_eval_cursor(&n->fov_track, &n->fov_cursor, &n->fov, t);
+        lib3ds_lin1_track_eval_cursor(&n->roll_track, &n->roll_cursor, &n->roll, t);
+      }
+      break;
+    case LIB3DS_TARGET_NODE:
+      {
+        Lib3dsTargetData *n=&node->data.target;
+        lib3ds_lin3_track_eval_cursor(&n->pos_track, &n->pos_cursor, n->pos, t);
+      }
+      break;
+    case LIB3DS_LIGHT_NODE:
+      {
+        Lib3dsLightData *n=&node->data.light;
+        lib3ds_lin3_track_eval_cursor(&n->pos_track, &n->pos_cursor, n->pos, t);
+        lib3ds_lin3_track_eval_cursor(&n->col_track, &n->col_cursor, n->col, t);
+        lib3ds_lin1_track_eval_cursor(&n->hotspot_track, &n->hotspot_cursor, &n->hotspot, t);
+        lib3ds_lin1_track_eval_cursor(&n->falloff_track, &n->falloff_cursor, &n->falloff, t);
+        lib3ds_lin1_track_eval_cursor(&n->roll_track, &n->roll_cursor, &n->roll, t);
+      }
+      break;
+    case LIB3DS_SPOT_NODE:
+      {
+        Lib3dsSpotData *n=&node->data.spot;
+        lib3ds_lin3_track_eval_cursor(&n->pos_track, &n->pos_cursor, n->pos, t);
+      }
+      break;
+  }
+}
+
+
+/*
+ * Position of camera, target, light and spot nodes, 0 for the others.
+ */
+static Lib3dsFloat*
+node_position(Lib3dsNode *node)
+{
+  switch (node->type) {
+    case LIB3DS_CAMERA_NODE:
+      return(node->data.camera.pos);
+    case LIB3DS_TARGET_NODE:
+      return(node->data.target.pos);
+    case LIB3DS_LIGHT_NODE:
+      return(node->data.light.pos);
+    case LIB3DS_SPOT_NODE:
+      return(node->data.spot.pos);
+    default:
+      break;
+  }
+  return(0);
+}
+
+
+static void
+node_object_matrix(Lib3dsNode *node, Lib3dsMatrix M)
+{
+  Lib3dsObjectData *n=&node->data.object;
+
+  lib3ds_matrix_from_trs(M, n->pos, n->rot, n->scl);
+}
+
+
+static void
+node_eval_tracks(Lib3dsNode *node, Lib3dsFloat t)
+{
+  Lib3dsFloat *pos;
+
+  node_eval_data(node, t);
+  if (node->type==LIB3DS_OBJECT_NODE) {
+    Lib3dsMatrix M;
+
+    node_object_matrix(node, M);
+    if (node->parent) {
+      lib3ds_matrix_copy(node->matrix, node->parent->matrix);
+      lib3ds_matrix_mult(node->matrix, M);
+    }
+    else {
+      lib3ds_matrix_copy(node->matrix, M);
+    }
+    return;
+  }
+
+  if (node->parent) {
+    lib3ds_matrix_copy(node->matrix, node->parent->matrix);
+  }
+  else {
+    lib3ds_matrix_identity(node->matrix);
+  }
+  pos=node_position(node);
+  if (pos) {
+    lib3ds_matrix_translate(node->matrix, pos);
+  }
+}
+
+
+/*!
+ * Evaluate the tracks of a single node.
+ *
+ * Unlike lib3ds_node_eval() the children and node->matrix are left alone,
+ * the transformation of the node relative to its parent is returned in M.
+ *
+ * \param node Node to be evaluated.
+ * \param t time value, between 0. and file->frames
+ * \param M Returned local transformation.
+ *
+ * \ingroup node
+ */
+void
+lib3ds_node_eval_local(Lib3dsNode *node, Lib3dsFloat t, Lib3dsMatrix M)
+{
+  Lib3dsFloat *pos;
+
+  ASSERT(node);
+  node_eval_data(node, t);
+  if (node->type==LIB3DS_OBJECT_NODE) {
+    node_object_matrix(node, M);
+    return;
+  }
+  lib3ds_matrix_identity(M);
+  pos=node_position(node);
+  if (pos) {
+    lib3ds_matrix_translate(M, pos);
+  }
+}
+
+
 /*!
  * Evaluate an animation node.
  *
  * Recursively sets node and its children to their appropriate values
- * for this point in the animation.
+ * for this point in the animation. Nodes that lib3ds_node_classify() found
+ * static below a static parent are evaluated once, static subtrees aren't
+ * visited after that.
  *
  * \param node Node to be evaluated.
  * \param t time value, between 0. and file->frames
@@ -251,110 +413,168 @@ void
 lib3ds_node_eval(Lib3dsNode *node, Lib3dsFloat t)
 {
   ASSERT(node);
+  if (node->eval_flags&LIB3DS_NODE_CACHED) {
+    if (node->eval_flags&LIB3DS_NODE_SUBTREE_STATIC) {
+      return;
+    }
+  }
+  else {
+    node_eval_tracks(node, t);
+    if ((node->eval_flags&LIB3DS_NODE_STATIC) &&
+      (!node->parent || (node->parent->eval_flags&LIB3DS_NODE_CACHED))) {
+      node->eval_flags|=LIB3DS_NODE_CACHED;
+    }
+  }
+  {
+    Lib3dsNode *p;
+
+    for (p=node->childs; p!=0; p=p->next) {
+      lib3ds_node_eval(p, t);
+    }
+  }
+}
+
+
+static Lib3dsBool
+node_is_static(Lib3dsNode *node)
+{
   switch (node->type) {
     case LIB3DS_UNKNOWN_NODE:
+      break;
+    case LIB3DS_AMBIENT_NODE:
       {
-        ASSERT(LIB3DS_FALSE);
+        Lib3dsAmbientData *n=&node->data.ambient;
+        return(n->col_track.keys<=1);
       }
+    case LIB3DS_OBJECT_NODE:
+      {
+        Lib3dsObjectData *n=&node->data.object;
+        return((n->pos_track.keys<=1) && (n->rot_track.keys<=1) && (n->scl_track.keys<=1) &&
+          (n->hide_track.keys<=1) && (n->morph_track.keys<=1));
+      }
+    case LIB3DS_CAMERA_NODE:
+      {
+        Lib3dsCameraData *n=&node->data.camera;
+        return((n->pos_track.keys<=1) && (n->fov_track.keys<=1) && (n->roll_track.keys<=1));
+      }
+    case LIB3DS_TARGET_NODE:
+      {
+        Lib3dsTargetData *n=&node->data.target;
+        return(n->pos_track.keys<=1);
+      }
+    case LIB3DS_LIGHT_NODE:
+      {
+        Lib3dsLightData *n=&node->data.light;
+        return((n->pos_track.keys<=1) && (n->col_track.keys<=1) && (n->hotspot_track.keys<=1) &&
+          (n->falloff_track.keys<=1) && (n->roll_track.keys<=1));
+      }
+    case LIB3DS_SPOT_NODE:
+      {
+        Lib3dsSpotData *n=&node->data.spot;
+        return(n->pos_track.keys<=1);
+      }
+  }
+  return(LIB3DS_TRUE);
+}
+
+
+/*!
+ * Classify a node and its children as static or animated.
+ *
+ * A node is static if none of its tracks has more than one key. The
+ * classification has to be repeated after keys are inserted or removed,
+ * or the hierarchy is changed.
+ *
+ * \param node Node to be classified.
+ *
+ * \return LIB3DS_TRUE if the node and all of its children are static.
+ *
+ * \see Lib3dsNodeEvalFlags
+ *
+ * \ingroup node
+ */
+Lib3dsBool
+lib3ds_node_classify(Lib3dsNode *node)
+{
+  Lib3dsNode *p;
+  Lib3dsBool subtree;
+
+  ASSERT(node);
+  node->eval_flags=0;
+  subtree=node_is_static(node);
+  if (subtree) {
+    node->eval_flags|=LIB3DS_NODE_STATIC;
+  }
+  for (p=node->childs; p!=0; p=p->next) {
+    if (!lib3ds_node_classify(p)) {
+      subtree=LIB3DS_FALSE;
+    }
+  }
+  if (subtree) {
+    node->eval_flags|=LIB3DS_NODE_SUBTREE_STATIC;
+  }
+  return(subtree);
+}
+
+
+/*!
+ * Precompute the track segments of a node and its children.
+ *
+ * \param node Node whose tracks will be evaluated many times.
+ *
+ * \see lib3ds_lin3_track_precompute
+ *
+ * \ingroup node
+ */
+void
+lib3ds_node_precompute_tracks(Lib3dsNode *node)
+{
+  ASSERT(node);
+  switch (node->type) {
+    case LIB3DS_UNKNOWN_NODE:
       break;
     case LIB3DS_AMBIENT_NODE:
       {
         Lib3dsAmbientData *n=&node->data.ambient;
-        if (node->parent) {
-          lib3ds_matrix_copy(node->matrix, node->parent->matrix);
-        }
-        else {
-          lib3ds_matrix_identity(node->matrix);
-        }
-        lib3ds_lin3_track_eval(&n->col_track, n->col, t);
+        lib3ds_lin3_track_precompute(&n->col_track);
       }
       break;
     case LIB3DS_OBJECT_NODE:
       {
-        Lib3dsMatrix M;
         Lib3dsObjectData *n=&node->data.object;
-
-        lib3ds_lin3_track_eval(&n->pos_track, n->pos, t);
-        lib3ds_quat_track_eval(&n->rot_track, n->rot, t);
-        if (n->scl_track.keyL) {
-          lib3ds_lin3_track_eval(&n->scl_track, n->scl, t);
-        }
-        else {
-          n->scl[0] = n->scl[1] = n->scl[2] = 1.0f;
-        }
-        lib3ds_bool_track_eval(&n->hide_track, &n->hide, t);
-        lib3ds_morph_track_eval(&n->morph_track, n->morph, t);
-
-        lib3ds_matrix_identity(M);
-        lib3ds_matrix_translate(M, n->pos);
-        lib3ds_matrix_rotate(M, n->rot);
-        lib3ds_matrix_scale(M, n->scl);
-        
-        if (node->parent) {
-          lib3ds_matrix_copy(node->matrix, node->parent->matrix);
-          lib3ds_matrix_mult(node->matrix, M);
-        }
-        else {
-          lib3ds_matrix_copy(node->matrix, M);
-        }
+        lib3ds_lin3_track_precompute(&n->pos_track);
+        lib3ds_quat_track_precompute(&n->rot_track);
+        lib3ds_lin3_track_precompute(&n->scl_track);
       }
       break;
     case LIB3DS_CAMERA_NODE:
       {
         Lib3dsCameraData *n=&node->data.camera;
-        lib3ds_lin3_track_eval(&n->pos_track, n->pos, t);
-        lib3ds_lin1_track_eval(&n->fov_track, &n->fov, t);
-        lib3ds_lin1_track_eval(&n->roll_track, &n->roll, t);
-        if (node->parent) {
-          lib3ds_matrix_copy(node->matrix, node->parent->matrix);
-        }
-        else {
-          lib3ds_matrix_identity(node->matrix);
-        }
-        lib3ds_matrix_translate(node->matrix, n->pos);
+        lib3ds_lin3_track_precompute(&n->pos_track);
+        lib3ds_lin1_track_precompute(&n->fov_track);
+        lib3ds_lin1_track_precompute(&n->roll_track);
       }
       break;
     case LIB3DS_TARGET_NODE:
       {
         Lib3dsTargetData *n=&node->data.target;
-        lib3ds_lin3_track_eval(&n->pos_track, n->pos, t);
-        if (node->parent) {
-          lib3ds_matrix_copy(node->matrix, node->parent->matrix);
-        }
-        else {
-          lib3ds_matrix_identity(node->matrix);
-        }
-        lib3ds_matrix_translate(node->matrix, n->pos);
+        lib3ds_lin3_track_precompute(&n->pos_track);
       }
       break;
     case LIB3DS_LIGHT_NODE:
       {
         Lib3dsLightData *n=&node->data.light;
-        lib3ds_lin3_track_eval(&n->pos_track, n->pos, t);
-        lib3ds_lin3_track_eval(&n->col_track, n->col, t);
-        lib3ds_lin1_track_eval(&n->hotspot_track, &n->hotspot, t);
-        lib3ds_lin1_track_eval(&n->falloff_track, &n->falloff, t);
-        lib3ds_lin1_track_eval(&n->roll_track, &n->roll, t);
-        if (node->parent) {
-          lib3ds_matrix_copy(node->matrix, node->parent->matrix);
-        }
-        else {
-          lib3ds_matrix_identity(node->matrix);
-        }
-        lib3ds_matrix_translate(node->matrix, n->pos);
+        lib3ds_lin3_track_precompute(&n->pos_track);
+        lib3ds_lin3_track_precompute(&n->col_track);
+        lib3ds_lin1_track_precompute(&n->hotspot_track);
+        lib3ds_lin1_track_precompute(&n->falloff_track);
+        lib3ds_lin1_track_precompute(&n->roll_track);
       }
       break;
     case LIB3DS_SPOT_NODE:
       {
         Lib3dsSpotData *n=&node->data.spot;
-        lib3ds_lin3_track_eval(&n->pos_track, n->pos, t);
-        if (node->parent) {
-          lib3ds_matrix_copy(node->matrix, node->parent->matrix);
-        }
-        else {
-          lib3ds_matrix_identity(node->matrix);
-        }
-        lib3ds_matrix_translate(node->matrix, n->pos);
+        lib3ds_lin3_track_precompute(&n->pos_track);
       }
       break;
   }
@@ -362,7 +582,7 @@ lib3ds_node_eval(Lib3dsNode *node, Lib3dsFloat t)
     Lib3dsNode *p;
 
     for (p=node->childs; p!=0; p=p->next) {
-      lib3ds_node_eval(p, t);
+      lib3ds_node_precompute_tracks(p);
     }
   }
 }
@@ -889,7 +1109,7 @@ lib3ds_node_write(Lib3dsNode *node, Lib3dsFile *file, Lib3dsIo *io)
           return(LIB3DS_FALSE);
         }
       }
-      if (node->data.object.hide_track.keyL) { /*---- LIB3DS_HIDE_TRACK_TAG ----*/
+      if (node->data.object.hide_track.keys) { /*---- LIB3DS_HIDE_TRACK_TAG ----*/
         Lib3dsChunk c;
         c.chunk=LIB3DS_HIDE_TRACK_TAG;
         if (!lib3ds_chunk_write_start(&c,io)) {
@@ -31,6 +31,11 @@
 extern "C" {
 #endif
 
+/*
+ * Every track of the node data is followed by the cursor used when the node
+ * is evaluated, see lib3ds_node_eval().
+ */
+
 /**
  * Scene graph ambient color node data
  * \ingroup node
@@ -38,6 +43,7 @@ extern "C" {
 typedef struct Lib3dsAmbientData {
     Lib3dsRgb col;
     Lib3dsLin3Track col_track;
+    Lib3dsTrackCursor col_cursor;
 } Lib3dsAmbientData;
 
 /**
@@ -51,15 +57,20 @@ typedef struct Lib3dsObjectData {
     Lib3dsVector bbox_max;
     Lib3dsVector pos;
     Lib3dsLin3Track pos_track;
+    Lib3dsTrackCursor pos_cursor;
     Lib3dsQuat rot;
     Lib3dsQuatTrack rot_track;
+    Lib3dsTrackCursor rot_cursor;
     Lib3dsVector scl;
     Lib3dsLin3Track scl_track;
+    Lib3dsTrackCursor scl_cursor;
     Lib3dsFloat morph_smooth;
     char morph[64];
     Lib3dsMorphTrack morph_track;
+    Lib3dsTrackCursor morph_cursor;
     Lib3dsBool hide;
     Lib3dsBoolTrack hide_track;
+    Lib3dsTrackCursor hide_cursor;
 } Lib3dsObjectData;
 
 /**
@@ -69,10 +80,13 @@ typedef struct Lib3dsObjectData {
 typedef struct Lib3dsCameraData {
     Lib3dsVector pos;
     Lib3dsLin3Track pos_track;
+    Lib3dsTrackCursor pos_cursor;
     Lib3dsFloat fov;
     Lib3dsLin1Track fov_track;
+    Lib3dsTrackCursor fov_cursor;
     Lib3dsFloat roll;
     Lib3dsLin1Track roll_track;
+    Lib3dsTrackCursor roll_cursor;
 } Lib3dsCameraData;
 
 /**
@@ -82,6 +96,7 @@ typedef struct Lib3dsCameraData {
 typedef struct Lib3dsTargetData {
     Lib3dsVector pos;
     Lib3dsLin3Track pos_track;
+    Lib3dsTrackCursor pos_cursor;
 } Lib3dsTargetData;
 
 /**
@@ -91,14 +106,19 @@ typedef struct Lib3dsTargetData {
 typedef struct Lib3dsLightData {
     Lib3dsVector pos;
     Lib3dsLin3Track pos_track;
+    Lib3dsTrackCursor pos_cursor;
     Lib3dsRgb col;
     Lib3dsLin3Track col_track;
+    Lib3dsTrackCursor col_cursor;
     Lib3dsFloat hotspot;
     Lib3dsLin1Track hotspot_track;
+    Lib3dsTrackCursor hotspot_cursor;
     Lib3dsFloat falloff;
     Lib3dsLin1Track falloff_track;
+    Lib3dsTrackCursor falloff_cursor;
     Lib3dsFloat roll;
     Lib3dsLin1Track roll_track;
+    Lib3dsTrackCursor roll_cursor;
 } Lib3dsLightData;
 
 /**
@@ -108,6 +128,7 @@ typedef struct Lib3dsLightData {
 typedef struct Lib3dsSpotData {
     Lib3dsVector pos;
     Lib3dsLin3Track pos_track;
+    Lib3dsTrackCursor pos_cursor;
 } Lib3dsSpotData;
 
 /**
@@ -143,6 +164,7 @@ struct Lib3dsNode {
     Lib3dsWord flags1;
     Lib3dsWord flags2;
     Lib3dsWord parent_id;
+    Lib3dsDword eval_flags;
     Lib3dsMatrix matrix;
     Lib3dsNodeData data;
 };
@@ -166,6 +188,17 @@ typedef enum {
   LIB3DS_MORPH_MATERIALS = 0x40
 } Lib3dsNodeFlags2;
 
+/**
+ * Evaluation state of a node, set by lib3ds_node_classify() and
+ * lib3ds_node_eval()
+ * \ingroup node
+ */
+typedef enum {
+  LIB3DS_NODE_STATIC          =0x0001, /*!< None of the tracks is animated */
+  LIB3DS_NODE_SUBTREE_STATIC  =0x0002, /*!< The node and all of its children are static */
+  LIB3DS_NODE_CACHED          =0x0004  /*!< Static below a cached parent and already evaluated */
+} Lib3dsNodeEvalFlags;
+
 extern LIB3DSAPI Lib3dsNode* lib3ds_node_new_ambient();
 extern LIB3DSAPI Lib3dsNode* lib3ds_node_new_object();
 extern LIB3DSAPI Lib3dsNode* lib3ds_node_new_camera();
@@ -174,6 +207,9 @@ extern LIB3DSAPI Lib3dsNode* lib3ds_node_new_light();
 extern LIB3DSAPI Lib3dsNode* lib3ds_node_new_spot();
 extern LIB3DSAPI void lib3ds_node_free(Lib3dsNode *node);
 extern LIB3DSAPI void lib3ds_node_eval(Lib3dsNode *node, Lib3dsFloat t);
+extern LIB3DSAPI void lib3ds_node_eval_local(Lib3dsNode *node, Lib3dsFloat t, Lib3dsMatrix M);
+extern LIB3DSAPI Lib3dsBool lib3ds_node_classify(Lib3dsNode *node);
+extern LIB3DSAPI void lib3ds_node_precompute_tracks(Lib3dsNode *node);
 extern LIB3DSAPI Lib3dsNode* lib3ds_node_by_name(Lib3dsNode *node, const char* name,
   Lib3dsNodeTypes type);
 extern LIB3DSAPI Lib3dsNode* lib3ds_node_by_id(Lib3dsNode *node, Lib3dsWord node_id);
@@ -0,0 +1,368 @@
+/*
+ * The 3D Studio File Format Library
+ * Copyright (C) 1996-2007 by Jan Eric Kyprianidis <www.kyprianidis.com>
+ * All rights reserved.
+ *
+ * This program is  free  software;  you can redistribute it and/or modify it
+ * under the terms of the  GNU Lesser General Public License  as published by
+ * the  Free Software Foundation;  either version 2.1 of the License,  or (at
+ * your option) any later version.
+ *
+ * This  program  is  distributed in  the  hope that it will  be useful,  but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or  FITNESS FOR A  PARTICULAR PURPOSE.  See the  GNU Lesser General Public
+ * License for more details.
+ *
+ * You should  have received  a copy of the GNU Lesser General Public License
+ * along with  this program;  if not, write to the  Free Software Foundation,
+ * Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+#include <lib3ds/nodetable.h>
+#include <lib3ds/file.h>
+#include <lib3ds/matrix.h>
+#include <lib3ds/simd.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/*!
+ * \defgroup nodetable Flat Node Hierarchy
+ */
+
+
+static Lib3dsDword
+node_table_count(Lib3dsNode *node)
+{
+  Lib3dsDword n=0;
+
+  for (; node!=0; node=node->next) {
+    n+=1+node_table_count(node->childs);
+  }
+  return(n);
+}
+
+
+static void
+node_table_fill(Lib3dsNodeTable *table, Lib3dsNode *node, Lib3dsIntd parent, Lib3dsDword *index)
+{
+  Lib3dsDword i;
+
+  for (; node!=0; node=node->next) {
+    i=(*index)++;
+    table->nodeL[i]=node;
+    table->parentL[i]=parent;
+    node_table_fill(table, node->childs, (Lib3dsIntd)i, index);
+  }
+}
+
+
+/*
+ * Groups the nodes by their depth in the hierarchy.
+ */
+static Lib3dsBool
+node_table_levels(Lib3dsNodeTable *table)
+{
+  Lib3dsDword *depthL;
+  Lib3dsDword i,l;
+
+  depthL=(Lib3dsDword*)calloc(sizeof(Lib3dsDword), table->nodes);
+  if (!depthL) {
+    return(LIB3DS_FALSE);
+  }
+  table->levels=0;
+  for (i=0; i<table->nodes; ++i) {
+    depthL[i]=(table->parentL[i]<0) ? 0 : depthL[table->parentL[i]]+1;
+    if (depthL[i]>=table->levels) {
+      table->levels=depthL[i]+1;
+    }
+  }
+
+  table->levelL=(Lib3dsDword*)calloc(sizeof(Lib3dsDword), table->levels+1);
+  table->orderL=(Lib3dsDword*)calloc(sizeof(Lib3dsDword), table->nodes);
+  if (!table->levelL || !table->orderL) {
+    free(depthL);
+    return(LIB3DS_FALSE);
+  }
+  for (i=0; i<table->nodes; ++i) {
+    table->levelL[depthL[i]+1]++;
+  }
+  for (l=0; l<table->levels; ++l) {
+    table->levelL[l+1]+=table->levelL[l];
+  }
+  for (i=0; i<table->nodes; ++i) {
+    table->orderL[table->levelL[depthL[i]]++]=i;
+  }
+  for (l=table->levels; l>0; --l) {
+    table->levelL[l]=table->levelL[l-1];
+  }
+  table->levelL[0]=0;
+
+  free(depthL);
+  return(LIB3DS_TRUE);
+}
+
+
+typedef struct NodeTableSample {
+  Lib3dsFloat t;
+  Lib3dsDword index;
+} NodeTableSample;
+
+
+static int
+node_table_sample_cmp(const void *a, const void *b)
+{
+  const NodeTableSample *p=(const NodeTableSample*)a;
+  const NodeTableSample *q=(const NodeTableSample*)b;
+
+  if (p->t<q->t) return(-1);
+  if (p->t>q->t) return(1);
+  return((p->index<q->index) ? -1 : (p->index>q->index));
+}
+
+
+/*!
+ * Flatten the node hierarchy of a file.
+ *
+ * The local matrices of nodes classified as static are computed once here,
+ * the table has to be rebuilt when nodes are inserted or removed.
+ *
+ * \param file The Lib3dsFile.
+ *
+ * \return A pointer to the table or 0 on failure.
+ *
+ * \see lib3ds_node_table_eval
+ * \ingroup nodetable
+ */
+Lib3dsNodeTable*
+lib3ds_node_table_new(Lib3dsFile *file)
+{
+  Lib3dsNodeTable *table;
+  Lib3dsDword i;
+
+  ASSERT(file);
+  table=(Lib3dsNodeTable*)calloc(sizeof(Lib3dsNodeTable), 1);
+  if (!table) {
+    return(0);
+  }
+  table->nodes=node_table_count(file->nodes);
+  if (table->nodes) {
+    table->nodeL=(Lib3dsNode**)calloc(sizeof(Lib3dsNode*), table->nodes);
+    table->parentL=(Lib3dsIntd*)calloc(sizeof(Lib3dsIntd), table->nodes);
+    table->localL=(Lib3dsMatrix*)calloc(sizeof(Lib3dsMatrix), table->nodes);
+    table->worldL=(Lib3dsMatrix*)calloc(sizeof(Lib3dsMatrix), table->nodes);
+    if (!table->nodeL || !table->parentL || !table->localL || !table->worldL) {
+      lib3ds_node_table_free(table);
+      return(0);
+    }
+  }
+
+  i=0;
+  node_table_fill(table, file->nodes, -1, &i);
+  ASSERT(i==table->nodes);
+  if (table->nodes && !node_table_levels(table)) {
+    lib3ds_node_table_free(table);
+    return(0);
+  }
+
+  for (i=0; i<table->nodes; ++i) {
+    Lib3dsNode *node=table->nodeL[i];
+    if (node->eval_flags&LIB3DS_NODE_STATIC) {
+      lib3ds_node_eval_local(node, file->current_frame, table->localL[i]);
+    }
+    else {
+      lib3ds_matrix_identity(table->localL[i]);
+    }
+  }
+  return(table);
+}
+
+
+/*!
+ * Free a table created by lib3ds_node_table_new(). The nodes are not
+ * touched.
+ *
+ * \ingroup nodetable
+ */
+void
+lib3ds_node_table_free(Lib3dsNodeTable *table)
+{
+  if (!table) {
+    return;
+  }
+  free(table->nodeL);
+  free(table->parentL);
+  free(table->localL);
+  free(table->worldL);
+  free(table->levelL);
+  free(table->orderL);
+  free(table);
+}
+
+
+/*!
+ * Evaluate all nodes of the table at a given time.
+ *
+ * Same result as lib3ds_file_eval(), but the hierarchy is composed in a
+ * single pass over the table. The world matrices are also copied to the
+ * matrix of each node.
+ *
+ * \param table The table.
+ * \param t time value, between 0. and file->frames
+ *
+ * \ingroup nodetable
+ */
+void
+lib3ds_node_table_eval(Lib3dsNodeTable *table, Lib3dsFloat t)
+{
+  Lib3dsDword i;
+  Lib3dsIntd p;
+
+  ASSERT(table);
+  for (i=0; i<table->nodes; ++i) {
+    Lib3dsNode *node=table->nodeL[i];
+
+    if (!(node->eval_flags&LIB3DS_NODE_STATIC)) {
+      lib3ds_node_eval_local(node, t, table->localL[i]);
+    }
+    p=table->parentL[i];
+    if (p<0) {
+      memcpy(table->worldL[i], table->localL[i], sizeof(Lib3dsMatrix));
+    }
+    else {
+      ASSERT((Lib3dsDword)p<i);
+      lib3ds_simd_matrix_mult(table->worldL[i], table->worldL[p], table->localL[i]);
+    }
+    memcpy(node->matrix, table->worldL[i], sizeof(Lib3dsMatrix));
+  }
+}
+
+
+/*!
+ * Evaluate all nodes of the table at a given time using OpenMP threads.
+ *
+ * The tracks of all nodes are evaluated in parallel first, then the world
+ * matrices are composed one level of the hierarchy after the other. The
+ * results are identical to lib3ds_node_table_eval(). Without OpenMP
+ * support the function runs serially.
+ *
+ * \param table The table.
+ * \param t time value, between 0. and file->frames
+ *
+ * \ingroup nodetable
+ */
+void
+lib3ds_node_table_eval_parallel(Lib3dsNodeTable *table, Lib3dsFloat t)
+{
+  int nodes;
+  Lib3dsDword l;
+
+  ASSERT(table);
+  nodes=(int)table->nodes;
+
+#ifdef _OPENMP
+  #pragma omp parallel if(nodes>=LIB3DS_NODE_TABLE_PARALLEL_MIN) private(l)
+#endif
+  {
+    int i;
+
+#ifdef _OPENMP
+    #pragma omp for schedule(dynamic,64)
+#endif
+    for (i=0; i<nodes; ++i) {
+      Lib3dsNode *node=table->nodeL[i];
+      if (!(node->eval_flags&LIB3DS_NODE_STATIC)) {
+        lib3ds_node_eval_local(node, t, table->localL[i]);
+      }
+    }
+
+    for (l=0; l<table->levels; ++l) {
+      int begin=(int)table->levelL[l];
+      int end=(int)table->levelL[l+1];
+
+#ifdef _OPENMP
+      #pragma omp for schedule(static)
+#endif
+      for (i=begin; i<end; ++i) {
+        Lib3dsDword j=table->orderL[i];
+        Lib3dsIntd p=table->parentL[j];
+
+        if (p<0) {
+          memcpy(table->worldL[j], table->localL[j], sizeof(Lib3dsMatrix));
+        }
+        else {
+          lib3ds_simd_matrix_mult(table->worldL[j], table->worldL[p], table->localL[j]);
+        }
+        memcpy(table->nodeL[j]->matrix, table->worldL[j], sizeof(Lib3dsMatrix));
+      }
+    }
+  }
+}
+
+
+/*!
+ * Evaluate the world matrices of all nodes at several times.
+ *
+ * Each node is evaluated at all samples before the next one, in order of
+ * increasing time, so that the track cursors find the keys without
+ * searching. Static nodes are evaluated once. The node data is left at
+ * the last time evaluated and node->matrix is not touched.
+ *
+ * \param table The table.
+ * \param times Sample times, in any order.
+ * \param n Number of samples.
+ * \param out Returned matrices, n*table->nodes of them. The matrix of node i
+ *        at times[s] is out[s*table->nodes+i].
+ *
+ * \return LIB3DS_FALSE if out of memory.
+ *
+ * \ingroup nodetable
+ */
+Lib3dsBool
+lib3ds_node_table_eval_times(Lib3dsNodeTable *table, const Lib3dsFloat *times, Lib3dsDword n,
+  Lib3dsMatrix *out)
+{
+  NodeTableSample *sampleL;
+  Lib3dsMatrix M;
+  Lib3dsDword i,k,s;
+  Lib3dsIntd p;
+
+  ASSERT(table);
+  if (!n || !table->nodes) {
+    return(LIB3DS_TRUE);
+  }
+  ASSERT(times && out);
+  sampleL=(NodeTableSample*)calloc(sizeof(NodeTableSample), n);
+  if (!sampleL) {
+    return(LIB3DS_FALSE);
+  }
+  for (k=0; k<n; ++k) {
+    sampleL[k].t=times[k];
+    sampleL[k].index=k;
+  }
+  qsort(sampleL, n, sizeof(NodeTableSample), node_table_sample_cmp);
+
+  for (i=0; i<table->nodes; ++i) {
+    Lib3dsNode *node=table->nodeL[i];
+    Lib3dsBool is_static=(node->eval_flags&LIB3DS_NODE_STATIC) ? LIB3DS_TRUE : LIB3DS_FALSE;
+
+    p=table->parentL[i];
+    for (k=0; k<n; ++k) {
+      s=sampleL[k].index;
+      if (!is_static) {
+        lib3ds_node_eval_local(node, sampleL[k].t, M);
+      }
+      else {
+        memcpy(M, table->localL[i], sizeof(Lib3dsMatrix));
+      }
+      if (p<0) {
+        memcpy(out[s*table->nodes+i], M, sizeof(Lib3dsMatrix));
+      }
+      else {
+        lib3ds_simd_matrix_mult(out[s*table->nodes+i], out[s*table->nodes+p], M);
+      }
+    }
+  }
+
+  free(sampleL);
+  return(LIB3DS_TRUE);
+}
@@ -0,0 +1,67 @@
+/* -*- c -*- */
+#ifndef INCLUDED_LIB3DS_NODETABLE_H
+#define INCLUDED_LIB3DS_NODETABLE_H
+/*
+ * The 3D Studio File Format Library
+ * Copyright (C) 1996-2007 by Jan Eric Kyprianidis <www.kyprianidis.com>
+ * All rights reserved.
+ *
+ * This program is  free  software;  you can redistribute it and/or modify it
+ * under the terms of the  GNU Lesser General Public License  as published by
+ * the  Free Software Foundation;  either version 2.1 of the License,  or (at
+ * your option) any later version.
+ *
+ * This  program  is  distributed in  the  hope that it will  be useful,  but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or  FITNESS FOR A  PARTICULAR PURPOSE.  See the  GNU Lesser General Public
+ * License for more details.
+ *
+ * You should  have received  a copy of the GNU Lesser General Public License
+ * along with  this program;  if not, write to the  Free Software Foundation,
+ * Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef INCLUDED_LIB3DS_NODE_H
+#include <lib3ds/node.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!
+ * Tables with fewer nodes are evaluated by a single thread in
+ * lib3ds_node_table_eval_parallel().
+ * \ingroup nodetable
+ */
+#define LIB3DS_NODE_TABLE_PARALLEL_MIN 256
+
+/**
+ * Node hierarchy of a file flattened in depth-first order. A node's parent
+ * always precedes it, parentL holds its index or -1 for root nodes.
+ * orderL lists the same indices sorted by depth, level l occupies
+ * orderL[levelL[l]] up to orderL[levelL[l+1]].
+ * \ingroup nodetable
+ */
+typedef struct Lib3dsNodeTable {
+    Lib3dsDword nodes;
+    Lib3dsNode **nodeL;
+    Lib3dsIntd *parentL;
+    Lib3dsMatrix *localL;
+    Lib3dsMatrix *worldL;
+    Lib3dsDword levels;
+    Lib3dsDword *levelL;
+    Lib3dsDword *orderL;
+} Lib3dsNodeTable;
+
+extern LIB3DSAPI Lib3dsNodeTable* lib3ds_node_table_new(Lib3dsFile *file);
+extern LIB3DSAPI void lib3ds_node_table_free(Lib3dsNodeTable *table);
+extern LIB3DSAPI void lib3ds_node_table_eval(Lib3dsNodeTable *table, Lib3dsFloat t);
+extern LIB3DSAPI void lib3ds_node_table_eval_parallel(Lib3dsNodeTable *table, Lib3dsFloat t);
+extern LIB3DSAPI Lib3dsBool lib3ds_node_table_eval_times(Lib3dsNodeTable *table, const Lib3dsFloat *times,
+  Lib3dsDword n, Lib3dsMatrix *out);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
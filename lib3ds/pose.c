@@ -0,0 +1,215 @@
+/*
+ * The 3D Studio File Format Library
+ * Copyright (C) 1996-2007 by Jan Eric Kyprianidis <www.kyprianidis.com>
+ * All rights reserved.
+ *
+ * This program is  free  software;  you can redistribute it and/or modify it
+ * under the terms of the  GNU Lesser General Public License  as published by
+ * the  Free Software Foundation;  either version 2.1 of the License,  or (at
+ * your option) any later version.
+ *
+ * This  program  is  distributed in  the  hope that it will  be useful,  but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or  FITNESS FOR A  PARTICULAR PURPOSE.  See the  GNU Lesser General Public
+ * License for more details.
+ *
+ * You should  have received  a copy of the GNU Lesser General Public License
+ * along with  this program;  if not, write to the  Free Software Foundation,
+ * Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+#include <lib3ds/pose.h>
+#include <lib3ds/matrix.h>
+#include <lib3ds/simd.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/*!
+ * \defgroup pose Animation Poses
+ */
+
+
+/*
+ * Evaluates the tracks of a node into p, the node itself is only read.
+ */
+static void
+pose_eval_node(Lib3dsNode *node, Lib3dsPoseNode *p, Lib3dsFloat t)
+{
+  Lib3dsTrackCursor *c=p->cursor;
+
+  switch (node->type) {
+    case LIB3DS_UNKNOWN_NODE:
+      {
+        ASSERT(LIB3DS_FALSE);
+      }
+      break;
+    case LIB3DS_AMBIENT_NODE:
+      {
+        Lib3dsAmbientData *n=&node->data.ambient;
+        lib3ds_lin3_track_eval_cursor(&n->col_track, &c[0], p->col, t);
+      }
+      break;
+    case LIB3DS_OBJECT_NODE:
+      {
+        Lib3dsObjectData *n=&node->data.object;
+
+        lib3ds_lin3_track_eval_cursor(&n->pos_track, &c[0], p->pos, t);
+        lib3ds_quat_track_eval_cursor(&n->rot_track, &c[1], p->rot, t);
+        if (n->scl_track.keys) {
+          lib3ds_lin3_track_eval_cursor(&n->scl_track, &c[2], p->scl, t);
+        }
+        else {
+          p->scl[0] = p->scl[1] = p->scl[2] = 1.0f;
+        }
+        lib3ds_bool_track_eval_cursor(&n->hide_track, &c[3], &p->hide, t);
+        lib3ds_morph_track_eval_cursor(&n->morph_track, &c[4], p->morph, t);
+      }
+      break;
+    case LIB3DS_CAMERA_NODE:
+      {
+        Lib3dsCameraData *n=&node->data.camera;
+        lib3ds_lin3_track_eval_cursor(&n->pos_track, &c[0], p->pos, t);
+        lib3ds_lin1_track_eval_cursor(&n->fov_track, &c[1], &p->fov, t);
+        lib3ds_lin1_track_eval_cursor(&n->roll_track, &c[2], &p->roll, t);
+      }
+      break;
+    case LIB3DS_TARGET_NODE:
+      {
+        Lib3dsTargetData *n=&node->data.target;
+        lib3ds_lin3_track_eval_cursor(&n->pos_track, &c[0], p->pos, t);
+      }
+      break;
+    case LIB3DS_LIGHT_NODE:
+      {
+        Lib3dsLightData *n=&node->data.light;
+        lib3ds_lin3_track_eval_cursor(&n->pos_track, &c[0], p->pos, t);
+        lib3ds_lin3_track_eval_cursor(&n->col_track, &c[1], p->col, t);
+        lib3ds_lin1_track_eval_cursor(&n->hotspot_track, &c[2], &p->hotspot, t);
+        lib3ds_lin1_track_eval_cursor(&n->falloff_track, &c[3], &p->falloff, t);
+        lib3ds_lin1_track_eval_cursor(&n->roll_track, &c[4], &p->roll, t);
+      }
+      break;
+    case LIB3DS_SPOT_NODE:
+      {
+        Lib3dsSpotData *n=&node->data.spot;
+        lib3ds_lin3_track_eval_cursor(&n->pos_track, &c[0], p->pos, t);
+      }
+      break;
+  }
+}
+
+
+/*
+ * Same transformation as lib3ds_node_eval_local(), built from the pose.
+ */
+static void
+pose_local_matrix(Lib3dsNode *node, Lib3dsPoseNode *p, Lib3dsMatrix M)
+{
+  switch (node->type) {
+    case LIB3DS_OBJECT_NODE:
+      lib3ds_matrix_from_trs(M, p->pos, p->rot, p->scl);
+      break;
+    case LIB3DS_CAMERA_NODE:
+    case LIB3DS_TARGET_NODE:
+    case LIB3DS_LIGHT_NODE:
+    case LIB3DS_SPOT_NODE:
+      lib3ds_matrix_identity(M);
+      lib3ds_matrix_translate(M, p->pos);
+      break;
+    default:
+      lib3ds_matrix_identity(M);
+      break;
+  }
+}
+
+
+/*!
+ * Create a pose for the nodes of a table.
+ *
+ * Any number of poses may share one table and its file. The table and the
+ * file have to outlive the pose and must not be modified while poses are
+ * evaluated.
+ *
+ * \param table Table of the nodes, see lib3ds_node_table_new().
+ *
+ * \return A pointer to the pose or 0 on failure.
+ *
+ * \see lib3ds_pose_eval
+ * \ingroup pose
+ */
+Lib3dsPose*
+lib3ds_pose_new(Lib3dsNodeTable *table)
+{
+  Lib3dsPose *pose;
+
+  ASSERT(table);
+  pose=(Lib3dsPose*)calloc(sizeof(Lib3dsPose), 1);
+  if (!pose) {
+    return(0);
+  }
+  pose->table=table;
+  if (table->nodes) {
+    pose->nodeL=(Lib3dsPoseNode*)calloc(sizeof(Lib3dsPoseNode), table->nodes);
+    pose->matrixL=(Lib3dsMatrix*)calloc(sizeof(Lib3dsMatrix), table->nodes);
+    if (!pose->nodeL || !pose->matrixL) {
+      lib3ds_pose_free(pose);
+      return(0);
+    }
+  }
+  return(pose);
+}
+
+
+/*!
+ * Free a pose created by lib3ds_pose_new().
+ *
+ * \ingroup pose
+ */
+void
+lib3ds_pose_free(Lib3dsPose *pose)
+{
+  if (!pose) {
+    return;
+  }
+  free(pose->nodeL);
+  free(pose->matrixL);
+  free(pose);
+}
+
+
+/*!
+ * Evaluate the animation of the file at a given time into a pose.
+ *
+ * Unlike lib3ds_file_eval() the nodes, tracks and the table are only read,
+ * different poses of the same file may be evaluated concurrently. The
+ * results equal the ones lib3ds_node_table_eval() stores in the nodes.
+ *
+ * \param pose The pose to be set.
+ * \param t time value, between 0. and file->frames
+ *
+ * \ingroup pose
+ */
+void
+lib3ds_pose_eval(Lib3dsPose *pose, Lib3dsFloat t)
+{
+  Lib3dsNodeTable *table;
+  Lib3dsMatrix M;
+  Lib3dsDword i;
+  Lib3dsIntd p;
+
+  ASSERT(pose);
+  table=pose->table;
+  for (i=0; i<table->nodes; ++i) {
+    Lib3dsNode *node=table->nodeL[i];
+
+    pose_eval_node(node, &pose->nodeL[i], t);
+    pose_local_matrix(node, &pose->nodeL[i], M);
+    p=table->parentL[i];
+    if (p<0) {
+      memcpy(pose->matrixL[i], M, sizeof(Lib3dsMatrix));
+    }
+    else {
+      lib3ds_simd_matrix_mult(pose->matrixL[i], pose->matrixL[p], M);
+    }
+  }
+}
@@ -0,0 +1,78 @@
+/* -*- c -*- */
+#ifndef INCLUDED_LIB3DS_POSE_H
+#define INCLUDED_LIB3DS_POSE_H
+/*
+ * The 3D Studio File Format Library
+ * Copyright (C) 1996-2007 by Jan Eric Kyprianidis <www.kyprianidis.com>
+ * All rights reserved.
+ *
+ * This program is  free  software;  you can redistribute it and/or modify it
+ * under the terms of the  GNU Lesser General Public License  as published by
+ * the  Free Software Foundation;  either version 2.1 of the License,  or (at
+ * your option) any later version.
+ *
+ * This  program  is  distributed in  the  hope that it will  be useful,  but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or  FITNESS FOR A  PARTICULAR PURPOSE.  See the  GNU Lesser General Public
+ * License for more details.
+ *
+ * You should  have received  a copy of the GNU Lesser General Public License
+ * along with  this program;  if not, write to the  Free Software Foundation,
+ * Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef INCLUDED_LIB3DS_NODETABLE_H
+#include <lib3ds/nodetable.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!
+ * Number of track cursors kept per node of a pose.
+ * \ingroup pose
+ */
+#define LIB3DS_POSE_CURSORS 5
+
+/**
+ * Evaluated state of one node. Only the values of the node type are set,
+ * pos is used by all types but ambient. The cursors follow the order of
+ * the tracks in the node data: pos, rot, scl, hide, morph for objects,
+ * pos, fov, roll for cameras, pos, col, hotspot, falloff, roll for lights
+ * and col for the ambient node.
+ * \ingroup pose
+ */
+typedef struct Lib3dsPoseNode {
+    Lib3dsVector pos;
+    Lib3dsQuat rot;
+    Lib3dsVector scl;
+    Lib3dsRgb col;
+    Lib3dsFloat fov;
+    Lib3dsFloat roll;
+    Lib3dsFloat hotspot;
+    Lib3dsFloat falloff;
+    Lib3dsBool hide;
+    char morph[64];
+    Lib3dsTrackCursor cursor[LIB3DS_POSE_CURSORS];
+} Lib3dsPoseNode;
+
+/**
+ * Animation state of one instance of a file. Entries are indexed like
+ * the nodes of the table, matrixL holds the world transformations.
+ * \ingroup pose
+ */
+typedef struct Lib3dsPose {
+    Lib3dsNodeTable *table;
+    Lib3dsPoseNode *nodeL;
+    Lib3dsMatrix *matrixL;
+} Lib3dsPose;
+
+extern LIB3DSAPI Lib3dsPose* lib3ds_pose_new(Lib3dsNodeTable *table);
+extern LIB3DSAPI void lib3ds_pose_free(Lib3dsPose *pose);
+extern LIB3DSAPI void lib3ds_pose_eval(Lib3dsPose *pose, Lib3dsFloat t);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -20,6 +20,8 @@
  * $Id: quat.c,v 1.9 2007/06/20 17:04:09 jeh Exp $
  */
 #include <lib3ds/quat.h>
+#include <lib3ds/simd.h>
+#include <lib3ds/vecmath.h>
 #include <math.h>
 
 
@@ -110,10 +112,7 @@ lib3ds_quat_axis_angle(Lib3dsQuat c, Lib3dsVector axis, Lib3dsFloat angle)
 void
 lib3ds_quat_neg(Lib3dsQuat c)
 {
-  int i;
-  for (i=0; i<4; ++i) {
-    c[i]=-c[i];
-  }
+  lib3ds_quat_neg_inline(c);
 }
 
 
@@ -237,7 +236,7 @@ lib3ds_quat_inv(Lib3dsQuat c)
 Lib3dsFloat
 lib3ds_quat_dot(Lib3dsQuat a, Lib3dsQuat b)
 {
-  return(a[0]*b[0] + a[1]*b[1] + a[2]*b[2] + a[3]*b[3]);
+  return(lib3ds_quat_dot_inline(a, b));
 }
 
 
@@ -351,10 +350,7 @@ lib3ds_quat_slerp(Lib3dsQuat c, Lib3dsQuat a, Lib3dsQuat b, Lib3dsFloat t)
       sp=1.0f-t;
       sq=t;
     }
-    c[0]=(Lib3dsFloat)(sp*a[0] + sq*b[0]);
-    c[1]=(Lib3dsFloat)(sp*a[1] + sq*b[1]);
-    c[2]=(Lib3dsFloat)(sp*a[2] + sq*b[2]);
-    c[3]=(Lib3dsFloat)(sp*a[3] + sq*b[3]);
+    lib3ds_simd_quat_blend(c, a, sp, b, sq);
   }
   else {
     q[0]=-a[1];
@@ -363,10 +359,7 @@ lib3ds_quat_slerp(Lib3dsQuat c, Lib3dsQuat a, Lib3dsQuat b, Lib3dsFloat t)
     q[3]=a[2];
     sp=sin((1.0-t)*LIB3DS_HALFPI);
     sq=sin(t*LIB3DS_HALFPI);
-    c[0]=(Lib3dsFloat)(sp*a[0] + sq*q[0]);
-    c[1]=(Lib3dsFloat)(sp*a[1] + sq*q[1]);
-    c[2]=(Lib3dsFloat)(sp*a[2] + sq*q[2]);
-    c[3]=(Lib3dsFloat)(sp*a[3] + sq*q[3]);
+    lib3ds_simd_quat_blend(c, a, sp, q, sq);
   }
 }
 
@@ -387,6 +380,84 @@ lib3ds_quat_squad(Lib3dsQuat c, Lib3dsQuat a, Lib3dsQuat p, Lib3dsQuat q,
 }
 
 
+/*
+ * Below this dot product lib3ds_quat_slerp_fast() falls back to
+ * lib3ds_quat_slerp(), above it the series error is less than 1e-7.
+ */
+#define LIB3DS_QUAT_SLERP_FAST_MIN 0.7
+
+
+/*
+ * sin(t*om)/sin(om) and sin((1-t)*om)/sin(om) as a series in cos(om)-1,
+ * see D. Eberly, A Fast and Accurate Algorithm for Computing SLERP.
+ */
+static void
+quat_slerp_weights(Lib3dsDouble l, Lib3dsDouble t, Lib3dsDouble *sp, Lib3dsDouble *sq)
+{
+  static const Lib3dsDouble u[8]={
+    0, 1.0/3.0, 1.0/10.0, 1.0/21.0, 1.0/36.0, 1.0/55.0, 1.0/78.0, 1.0/105.0
+  };
+  Lib3dsDouble d,dn,bp,bq,s;
+  int i;
+
+  s=1.0-t;
+  d=l-1.0;
+  dn=1.0;
+  bp=s;
+  bq=t;
+  *sp=s;
+  *sq=t;
+  for (i=1; i<8; ++i) {
+    dn*=d;
+    bp*=(s*s - i*i)*u[i];
+    bq*=(t*t - i*i)*u[i];
+    *sp+=bp*dn;
+    *sq+=bq*dn;
+  }
+}
+
+
+/*!
+ * Same as lib3ds_quat_slerp(), l is the dot product of a and b.
+ *
+ * Quaternions less than about 90 degrees of rotation apart are interpolated
+ * without trigonometric functions.
+ *
+ * \ingroup quat
+ */
+void
+lib3ds_quat_slerp_fast(Lib3dsQuat c, Lib3dsQuat a, Lib3dsQuat b, Lib3dsFloat l, Lib3dsFloat t)
+{
+  Lib3dsDouble sp,sq;
+
+  if (l<LIB3DS_QUAT_SLERP_FAST_MIN) {
+    lib3ds_quat_slerp(c, a, b, t);
+    return;
+  }
+  quat_slerp_weights(l, t, &sp, &sq);
+  lib3ds_simd_quat_blend(c, a, sp, b, sq);
+}
+
+
+/*!
+ * Same as lib3ds_quat_squad(), ab and pq are the dot products of a and b,
+ * and of p and q.
+ *
+ * \ingroup quat
+ */
+void
+lib3ds_quat_squad_fast(Lib3dsQuat c, Lib3dsQuat a, Lib3dsQuat p, Lib3dsQuat q,
+  Lib3dsQuat b, Lib3dsFloat ab, Lib3dsFloat pq, Lib3dsFloat t)
+{
+  Lib3dsQuat x;
+  Lib3dsQuat y;
+
+  lib3ds_quat_slerp_fast(x, a, b, ab, t);
+  lib3ds_quat_slerp_fast(y, p, q, pq, t);
+  lib3ds_quat_slerp_fast(c, x, y, lib3ds_quat_dot_inline(x, y), 2*t*(1-t));
+}
+
+
 /*!
  * \ingroup quat
  */
@@ -51,6 +51,10 @@ extern LIB3DSAPI void lib3ds_quat_exp(Lib3dsQuat c);
 extern LIB3DSAPI void lib3ds_quat_slerp(Lib3dsQuat c, Lib3dsQuat a, Lib3dsQuat b, Lib3dsFloat t);
 extern LIB3DSAPI void lib3ds_quat_squad(Lib3dsQuat c, Lib3dsQuat a, Lib3dsQuat p, Lib3dsQuat q,
   Lib3dsQuat b, Lib3dsFloat t);
+extern LIB3DSAPI void lib3ds_quat_slerp_fast(Lib3dsQuat c, Lib3dsQuat a, Lib3dsQuat b, Lib3dsFloat l,
+  Lib3dsFloat t);
+extern LIB3DSAPI void lib3ds_quat_squad_fast(Lib3dsQuat c, Lib3dsQuat a, Lib3dsQuat p, Lib3dsQuat q,
+  Lib3dsQuat b, Lib3dsFloat ab, Lib3dsFloat pq, Lib3dsFloat t);
 extern LIB3DSAPI void lib3ds_quat_tangent(Lib3dsQuat c, Lib3dsQuat p, Lib3dsQuat q, Lib3dsQuat n);
 extern LIB3DSAPI void lib3ds_quat_dump(Lib3dsQuat q);
 
@@ -0,0 +1,565 @@
+/*
+ * The 3D Studio File Format Library
+ * Copyright (C) 1996-2007 by Jan Eric Kyprianidis <www.kyprianidis.com>
+ * All rights reserved.
+ *
+ * This program is  free  software;  you can redistribute it and/or modify it
+ * under the terms of the  GNU Lesser General Public License  as published by
+ * the  Free Software Foundation;  either version 2.1 of the License,  or (at
+ * your option) any later version.
+ *
+ * This  program  is  distributed in  the  hope that it will  be useful,  but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or  FITNESS FOR A  PARTICULAR PURPOSE.  See the  GNU Lesser General Public
+ * License for more details.
+ *
+ * You should  have received  a copy of the GNU Lesser General Public License
+ * along with  this program;  if not, write to the  Free Software Foundation,
+ * Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+#include <lib3ds/simd.h>
+#include <string.h>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__i386__) || defined(__x86_64__))
+#define LIB3DS_SIMD_X86
+#include <immintrin.h>
+#endif
+
+
+/*!
+ * \defgroup simd SIMD Math Kernels
+ *
+ * The kernels are selected at runtime from the instruction sets the CPU
+ * supports. All of them perform the same floating point operations in the
+ * same order as the scalar code, without fused multiply-adds, so that the
+ * results are bit-identical whatever the level.
+ *
+ * The kernels are resolved once, on first use, and may be used from any
+ * number of threads. lib3ds_simd_set_level() must not be called while
+ * other threads evaluate.
+ */
+
+
+static void
+matrix_mult_scalar(Lib3dsMatrix m, Lib3dsMatrix a, Lib3dsMatrix b)
+{
+  int i,j,k;
+  Lib3dsFloat ab;
+
+  for (j=0; j<4; j++) {
+    for (i=0; i<4; i++) {
+      ab=0.0f;
+      for (k=0; k<4; k++) ab+=a[k][i]*b[j][k];
+      m[j][i]=ab;
+    }
+  }
+}
+
+
+static void
+vector_transform_scalar(Lib3dsVector c, Lib3dsMatrix m, Lib3dsVector a)
+{
+  c[0]= m[0][0]*a[0] + m[1][0]*a[1] + m[2][0]*a[2] + m[3][0];
+  c[1]= m[0][1]*a[0] + m[1][1]*a[1] + m[2][1]*a[2] + m[3][1];
+  c[2]= m[0][2]*a[0] + m[1][2]*a[1] + m[2][2]*a[2] + m[3][2];
+}
+
+
+#define SIMD_POINT(p, stride, i) ((Lib3dsFloat*)((char*)(p) + (size_t)(i)*(stride)))
+
+
+static void
+transform_array_scalar(Lib3dsFloat *out, size_t out_stride, Lib3dsMatrix m, const Lib3dsFloat *in,
+  size_t in_stride, Lib3dsDword count)
+{
+  Lib3dsVector v;
+  Lib3dsDword i;
+
+  for (i=0; i<count; ++i) {
+    const Lib3dsFloat *a=SIMD_POINT(in, in_stride, i);
+    Lib3dsFloat *c=SIMD_POINT(out, out_stride, i);
+    v[0]= m[0][0]*a[0] + m[1][0]*a[1] + m[2][0]*a[2] + m[3][0];
+    v[1]= m[0][1]*a[0] + m[1][1]*a[1] + m[2][1]*a[2] + m[3][1];
+    v[2]= m[0][2]*a[0] + m[1][2]*a[1] + m[2][2]*a[2] + m[3][2];
+    c[0]=v[0];
+    c[1]=v[1];
+    c[2]=v[2];
+  }
+}
+
+
+static void
+transform_bounds_scalar(Lib3dsMatrix m, const Lib3dsFloat *in, size_t in_stride, Lib3dsDword count,
+  Lib3dsVector bmin, Lib3dsVector bmax)
+{
+  Lib3dsVector v;
+  Lib3dsDword i;
+  int k;
+
+  for (i=0; i<count; ++i) {
+    const Lib3dsFloat *a=SIMD_POINT(in, in_stride, i);
+    v[0]= m[0][0]*a[0] + m[1][0]*a[1] + m[2][0]*a[2] + m[3][0];
+    v[1]= m[0][1]*a[0] + m[1][1]*a[1] + m[2][1]*a[2] + m[3][1];
+    v[2]= m[0][2]*a[0] + m[1][2]*a[1] + m[2][2]*a[2] + m[3][2];
+    for (k=0; k<3; ++k) {
+      if (v[k]<bmin[k]) bmin[k]=v[k];
+      if (v[k]>bmax[k]) bmax[k]=v[k];
+    }
+  }
+}
+
+
+static void
+quat_blend_scalar(Lib3dsQuat c, Lib3dsQuat a, Lib3dsDouble sa, Lib3dsQuat b, Lib3dsDouble sb)
+{
+  c[0]=(Lib3dsFloat)(sa*a[0] + sb*b[0]);
+  c[1]=(Lib3dsFloat)(sa*a[1] + sb*b[1]);
+  c[2]=(Lib3dsFloat)(sa*a[2] + sb*b[2]);
+  c[3]=(Lib3dsFloat)(sa*a[3] + sb*b[3]);
+}
+
+
+#ifdef LIB3DS_SIMD_X86
+
+__attribute__((target("sse2")))
+static void
+matrix_mult_sse2(Lib3dsMatrix m, Lib3dsMatrix a, Lib3dsMatrix b)
+{
+  __m128 a0=_mm_loadu_ps(a[0]);
+  __m128 a1=_mm_loadu_ps(a[1]);
+  __m128 a2=_mm_loadu_ps(a[2]);
+  __m128 a3=_mm_loadu_ps(a[3]);
+  __m128 r;
+  int j;
+
+  for (j=0; j<4; j++) {
+    r=_mm_setzero_ps();
+    r=_mm_add_ps(r, _mm_mul_ps(a0, _mm_set1_ps(b[j][0])));
+    r=_mm_add_ps(r, _mm_mul_ps(a1, _mm_set1_ps(b[j][1])));
+    r=_mm_add_ps(r, _mm_mul_ps(a2, _mm_set1_ps(b[j][2])));
+    r=_mm_add_ps(r, _mm_mul_ps(a3, _mm_set1_ps(b[j][3])));
+    _mm_storeu_ps(m[j], r);
+  }
+}
+
+
+__attribute__((target("sse2")))
+static void
+vector_transform_sse2(Lib3dsVector c, Lib3dsMatrix m, Lib3dsVector a)
+{
+  Lib3dsFloat v[4];
+  __m128 r;
+
+  r=_mm_mul_ps(_mm_loadu_ps(m[0]), _mm_set1_ps(a[0]));
+  r=_mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(m[1]), _mm_set1_ps(a[1])));
+  r=_mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(m[2]), _mm_set1_ps(a[2])));
+  r=_mm_add_ps(r, _mm_loadu_ps(m[3]));
+  _mm_storeu_ps(v, r);
+  c[0]=v[0];
+  c[1]=v[1];
+  c[2]=v[2];
+}
+
+
+/*
+ * Loads the first three components of a point, the fourth lane is 0.
+ */
+__attribute__((target("sse2")))
+static __m128
+simd_load3_sse2(const Lib3dsFloat *a)
+{
+  return(_mm_setr_ps(a[0], a[1], a[2], 0.0f));
+}
+
+
+__attribute__((target("sse2")))
+static __m128
+simd_transform_sse2(__m128 m0, __m128 m1, __m128 m2, __m128 m3, const Lib3dsFloat *a)
+{
+  __m128 r;
+
+  r=_mm_mul_ps(m0, _mm_set1_ps(a[0]));
+  r=_mm_add_ps(r, _mm_mul_ps(m1, _mm_set1_ps(a[1])));
+  r=_mm_add_ps(r, _mm_mul_ps(m2, _mm_set1_ps(a[2])));
+  return(_mm_add_ps(r, m3));
+}
+
+
+__attribute__((target("sse2")))
+static void
+simd_store3_sse2(Lib3dsFloat *c, __m128 r)
+{
+  Lib3dsFloat v[4];
+
+  _mm_storeu_ps(v, r);
+  c[0]=v[0];
+  c[1]=v[1];
+  c[2]=v[2];
+}
+
+
+__attribute__((target("sse2")))
+static void
+transform_array_sse2(Lib3dsFloat *out, size_t out_stride, Lib3dsMatrix m, const Lib3dsFloat *in,
+  size_t in_stride, Lib3dsDword count)
+{
+  __m128 m0=_mm_loadu_ps(m[0]);
+  __m128 m1=_mm_loadu_ps(m[1]);
+  __m128 m2=_mm_loadu_ps(m[2]);
+  __m128 m3=_mm_loadu_ps(m[3]);
+  Lib3dsDword i;
+
+  for (i=0; i<count; ++i) {
+    simd_store3_sse2(SIMD_POINT(out, out_stride, i),
+      simd_transform_sse2(m0, m1, m2, m3, SIMD_POINT(in, in_stride, i)));
+  }
+}
+
+
+__attribute__((target("sse2")))
+static void
+transform_bounds_sse2(Lib3dsMatrix m, const Lib3dsFloat *in, size_t in_stride, Lib3dsDword count,
+  Lib3dsVector bmin, Lib3dsVector bmax)
+{
+  __m128 m0=_mm_loadu_ps(m[0]);
+  __m128 m1=_mm_loadu_ps(m[1]);
+  __m128 m2=_mm_loadu_ps(m[2]);
+  __m128 m3=_mm_loadu_ps(m[3]);
+  __m128 lo=simd_load3_sse2(bmin);
+  __m128 hi=simd_load3_sse2(bmax);
+  __m128 r;
+  Lib3dsDword i;
+
+  for (i=0; i<count; ++i) {
+    r=simd_transform_sse2(m0, m1, m2, m3, SIMD_POINT(in, in_stride, i));
+    lo=_mm_min_ps(r, lo);
+    hi=_mm_max_ps(r, hi);
+  }
+  simd_store3_sse2(bmin, lo);
+  simd_store3_sse2(bmax, hi);
+}
+
+
+__attribute__((target("sse2")))
+static void
+quat_blend_sse2(Lib3dsQuat c, Lib3dsQuat a, Lib3dsDouble sa, Lib3dsQuat b, Lib3dsDouble sb)
+{
+  __m128 fa=_mm_loadu_ps(a);
+  __m128 fb=_mm_loadu_ps(b);
+  __m128d wa=_mm_set1_pd(sa);
+  __m128d wb=_mm_set1_pd(sb);
+  __m128d lo,hi;
+
+  lo=_mm_add_pd(_mm_mul_pd(wa, _mm_cvtps_pd(fa)), _mm_mul_pd(wb, _mm_cvtps_pd(fb)));
+  hi=_mm_add_pd(_mm_mul_pd(wa, _mm_cvtps_pd(_mm_movehl_ps(fa, fa))),
+    _mm_mul_pd(wb, _mm_cvtps_pd(_mm_movehl_ps(fb, fb))));
+  _mm_storeu_ps(c, _mm_movelh_ps(_mm_cvtpd_ps(lo), _mm_cvtpd_ps(hi)));
+}
+
+
+/*
+ * Two columns of the product per iteration.
+ */
+__attribute__((target("avx2")))
+static void
+matrix_mult_avx2(Lib3dsMatrix m, Lib3dsMatrix a, Lib3dsMatrix b)
+{
+  __m256 a0=_mm256_broadcast_ps((const __m128*)a[0]);
+  __m256 a1=_mm256_broadcast_ps((const __m128*)a[1]);
+  __m256 a2=_mm256_broadcast_ps((const __m128*)a[2]);
+  __m256 a3=_mm256_broadcast_ps((const __m128*)a[3]);
+  __m256 r;
+  int j;
+
+  for (j=0; j<4; j+=2) {
+    r=_mm256_setzero_ps();
+    r=_mm256_add_ps(r, _mm256_mul_ps(a0, _mm256_setr_ps(b[j][0], b[j][0], b[j][0], b[j][0],
+      b[j+1][0], b[j+1][0], b[j+1][0], b[j+1][0])));
+    r=_mm256_add_ps(r, _mm256_mul_ps(a1, _mm256_setr_ps(b[j][1], b[j][1], b[j][1], b[j][1],
+      b[j+1][1], b[j+1][1], b[j+1][1], b[j+1][1])));
+    r=_mm256_add_ps(r, _mm256_mul_ps(a2, _mm256_setr_ps(b[j][2], b[j][2], b[j][2], b[j][2],
+      b[j+1][2], b[j+1][2], b[j+1][2], b[j+1][2])));
+    r=_mm256_add_ps(r, _mm256_mul_ps(a3, _mm256_setr_ps(b[j][3], b[j][3], b[j][3], b[j][3],
+      b[j+1][3], b[j+1][3], b[j+1][3], b[j+1][3])));
+    _mm256_storeu_ps(m[j], r);
+  }
+}
+
+
+/*
+ * Two points per iteration, one in each half of the registers.
+ */
+__attribute__((target("avx2")))
+static __m256
+simd_transform2_avx2(__m256 m0, __m256 m1, __m256 m2, __m256 m3, const Lib3dsFloat *a,
+  const Lib3dsFloat *b)
+{
+  __m256 r;
+
+  r=_mm256_mul_ps(m0, _mm256_setr_ps(a[0], a[0], a[0], a[0], b[0], b[0], b[0], b[0]));
+  r=_mm256_add_ps(r, _mm256_mul_ps(m1, _mm256_setr_ps(a[1], a[1], a[1], a[1], b[1], b[1], b[1], b[1])));
+  r=_mm256_add_ps(r, _mm256_mul_ps(m2, _mm256_setr_ps(a[2], a[2], a[2], a[2], b[2], b[2], b[2], b[2])));
+  return(_mm256_add_ps(r, m3));
+}
+
+
+__attribute__((target("avx2")))
+static void
+transform_array_avx2(Lib3dsFloat *out, size_t out_stride, Lib3dsMatrix m, const Lib3dsFloat *in,
+  size_t in_stride, Lib3dsDword count)
+{
+  __m256 m0=_mm256_broadcast_ps((const __m128*)m[0]);
+  __m256 m1=_mm256_broadcast_ps((const __m128*)m[1]);
+  __m256 m2=_mm256_broadcast_ps((const __m128*)m[2]);
+  __m256 m3=_mm256_broadcast_ps((const __m128*)m[3]);
+  __m256 r;
+  Lib3dsDword i;
+
+  for (i=0; i+2<=count; i+=2) {
+    r=simd_transform2_avx2(m0, m1, m2, m3, SIMD_POINT(in, in_stride, i), SIMD_POINT(in, in_stride, i+1));
+    simd_store3_sse2(SIMD_POINT(out, out_stride, i), _mm256_castps256_ps128(r));
+    simd_store3_sse2(SIMD_POINT(out, out_stride, i+1), _mm256_extractf128_ps(r, 1));
+  }
+  if (i<count) {
+    transform_array_sse2(SIMD_POINT(out, out_stride, i), out_stride, m, SIMD_POINT(in, in_stride, i),
+      in_stride, count-i);
+  }
+}
+
+
+__attribute__((target("avx2")))
+static void
+transform_bounds_avx2(Lib3dsMatrix m, const Lib3dsFloat *in, size_t in_stride, Lib3dsDword count,
+  Lib3dsVector bmin, Lib3dsVector bmax)
+{
+  __m256 m0=_mm256_broadcast_ps((const __m128*)m[0]);
+  __m256 m1=_mm256_broadcast_ps((const __m128*)m[1]);
+  __m256 m2=_mm256_broadcast_ps((const __m128*)m[2]);
+  __m256 m3=_mm256_broadcast_ps((const __m128*)m[3]);
+  __m128 l=simd_load3_sse2(bmin);
+  __m128 h=simd_load3_sse2(bmax);
+  __m256 lo=_mm256_insertf128_ps(_mm256_castps128_ps256(l), l, 1);
+  __m256 hi=_mm256_insertf128_ps(_mm256_castps128_ps256(h), h, 1);
+  __m256 r;
+  Lib3dsDword i;
+
+  for (i=0; i+2<=count; i+=2) {
+    r=simd_transform2_avx2(m0, m1, m2, m3, SIMD_POINT(in, in_stride, i), SIMD_POINT(in, in_stride, i+1));
+    lo=_mm256_min_ps(r, lo);
+    hi=_mm256_max_ps(r, hi);
+  }
+  simd_store3_sse2(bmin, _mm_min_ps(_mm256_extractf128_ps(lo, 1), _mm256_castps256_ps128(lo)));
+  simd_store3_sse2(bmax, _mm_max_ps(_mm256_extractf128_ps(hi, 1), _mm256_castps256_ps128(hi)));
+  if (i<count) {
+    transform_bounds_sse2(m, SIMD_POINT(in, in_stride, i), in_stride, count-i, bmin, bmax);
+  }
+}
+
+
+__attribute__((target("avx2")))
+static void
+quat_blend_avx2(Lib3dsQuat c, Lib3dsQuat a, Lib3dsDouble sa, Lib3dsQuat b, Lib3dsDouble sb)
+{
+  __m256d r;
+
+  r=_mm256_add_pd(_mm256_mul_pd(_mm256_set1_pd(sa), _mm256_cvtps_pd(_mm_loadu_ps(a))),
+    _mm256_mul_pd(_mm256_set1_pd(sb), _mm256_cvtps_pd(_mm_loadu_ps(b))));
+  _mm_storeu_ps(c, _mm256_cvtpd_ps(r));
+}
+
+#endif
+
+
+typedef struct SimdKernels {
+  void (*matrix_mult)(Lib3dsMatrix m, Lib3dsMatrix a, Lib3dsMatrix b);
+  void (*vector_transform)(Lib3dsVector c, Lib3dsMatrix m, Lib3dsVector a);
+  void (*transform_array)(Lib3dsFloat *out, size_t out_stride, Lib3dsMatrix m, const Lib3dsFloat *in,
+    size_t in_stride, Lib3dsDword count);
+  void (*transform_bounds)(Lib3dsMatrix m, const Lib3dsFloat *in, size_t in_stride, Lib3dsDword count,
+    Lib3dsVector bmin, Lib3dsVector bmax);
+  void (*quat_blend)(Lib3dsQuat c, Lib3dsQuat a, Lib3dsDouble sa, Lib3dsQuat b, Lib3dsDouble sb);
+} SimdKernels;
+
+static const SimdKernels simd_kernels[]={
+  {matrix_mult_scalar, vector_transform_scalar, transform_array_scalar, transform_bounds_scalar,
+    quat_blend_scalar},
+#ifdef LIB3DS_SIMD_X86
+  {matrix_mult_sse2, vector_transform_sse2, transform_array_sse2, transform_bounds_sse2,
+    quat_blend_sse2},
+  {matrix_mult_avx2, vector_transform_sse2, transform_array_avx2, transform_bounds_avx2,
+    quat_blend_avx2}
+#endif
+};
+
+#ifdef LIB3DS_SIMD_X86
+
+/*
+ * The kernels in use, published with a single atomic pointer, the level is
+ * its index in simd_kernels. Threads racing on the first use store the same
+ * pointer.
+ */
+static const SimdKernels *simd_current=0;
+
+
+static const SimdKernels*
+simd_get()
+{
+  const SimdKernels *kernels=__atomic_load_n(&simd_current, __ATOMIC_ACQUIRE);
+
+  if (!kernels) {
+    kernels=&simd_kernels[lib3ds_simd_detect()];
+    __atomic_store_n(&simd_current, kernels, __ATOMIC_RELEASE);
+  }
+  return(kernels);
+}
+
+
+static void
+simd_set(const SimdKernels *kernels)
+{
+  __atomic_store_n(&simd_current, kernels, __ATOMIC_RELEASE);
+}
+
+#else
+
+/* only the scalar kernels, nothing to resolve */
+static const SimdKernels *simd_current=&simd_kernels[0];
+
+
+static const SimdKernels*
+simd_get()
+{
+  return(simd_current);
+}
+
+
+static void
+simd_set(const SimdKernels *kernels)
+{
+}
+
+#endif
+
+
+/*!
+ * Best instruction set supported by the CPU.
+ *
+ * \ingroup simd
+ */
+Lib3dsSimdLevel
+lib3ds_simd_detect()
+{
+#ifdef LIB3DS_SIMD_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return(LIB3DS_SIMD_AVX2);
+  }
+  if (__builtin_cpu_supports("sse2")) {
+    return(LIB3DS_SIMD_SSE2);
+  }
+#endif
+  return(LIB3DS_SIMD_NONE);
+}
+
+
+/*!
+ * Instruction set of the kernels in use, lib3ds_simd_detect() until
+ * lib3ds_simd_set_level() is called.
+ *
+ * \ingroup simd
+ */
+Lib3dsSimdLevel
+lib3ds_simd_level()
+{
+  return((Lib3dsSimdLevel)(simd_get()-simd_kernels));
+}
+
+
+/*!
+ * Select the kernels of an instruction set, to compare them with the scalar
+ * code for example. Levels the CPU doesn't support are lowered.
+ *
+ * Not synchronized with evaluation, call it before any other thread uses
+ * lib3ds or while none does.
+ *
+ * \param level Requested instruction set.
+ *
+ * \return The instruction set selected.
+ *
+ * \ingroup simd
+ */
+Lib3dsSimdLevel
+lib3ds_simd_set_level(Lib3dsSimdLevel level)
+{
+  Lib3dsSimdLevel best=lib3ds_simd_detect();
+
+  if (level>best) {
+    level=best;
+  }
+  simd_set(&simd_kernels[level]);
+  return(level);
+}
+
+
+/*!
+ * Multiply two matrices, m = a*b. m must not be a or b.
+ *
+ * \ingroup simd
+ */
+void
+lib3ds_simd_matrix_mult(Lib3dsMatrix m, Lib3dsMatrix a, Lib3dsMatrix b)
+{
+  simd_get()->matrix_mult(m, a, b);
+}
+
+
+/*!
+ * Same as lib3ds_vector_transform().
+ *
+ * \ingroup simd
+ */
+void
+lib3ds_simd_vector_transform(Lib3dsVector c, Lib3dsMatrix m, Lib3dsVector a)
+{
+  simd_get()->vector_transform(c, m, a);
+}
+
+
+/*!
+ * Transform count points, see lib3ds_vector_transform_array().
+ *
+ * \ingroup simd
+ */
+void
+lib3ds_simd_transform_array(Lib3dsFloat *out, size_t out_stride, Lib3dsMatrix m, const Lib3dsFloat *in,
+  size_t in_stride, Lib3dsDword count)
+{
+  simd_get()->transform_array(out, out_stride, m, in, in_stride, count);
+}
+
+
+/*!
+ * Grow a bounding box by count transformed points, see
+ * lib3ds_vector_transform_bounds().
+ *
+ * \ingroup simd
+ */
+void
+lib3ds_simd_transform_bounds(Lib3dsMatrix m, const Lib3dsFloat *in, size_t in_stride, Lib3dsDword count,
+  Lib3dsVector bmin, Lib3dsVector bmax)
+{
+  simd_get()->transform_bounds(m, in, in_stride, count, bmin, bmax);
+}
+
+
+/*!
+ * Weighted sum of two quaternions, c = sa*a + sb*b, computed in double
+ * precision.
+ *
+ * \ingroup simd
+ */
+void
+lib3ds_simd_quat_blend(Lib3dsQuat c, Lib3dsQuat a, Lib3dsDouble sa, Lib3dsQuat b, Lib3dsDouble sb)
+{
+  simd_get()->quat_blend(c, a, sa, b, sb);
+}
@@ -0,0 +1,59 @@
+/* -*- c -*- */
+#ifndef INCLUDED_LIB3DS_SIMD_H
+#define INCLUDED_LIB3DS_SIMD_H
+/*
+ * The 3D Studio File Format Library
+ * Copyright (C) 1996-2007 by Jan Eric Kyprianidis <www.kyprianidis.com>
+ * All rights reserved.
+ *
+ * This program is  free  software;  you can redistribute it and/or modify it
+ * under the terms of the  GNU Lesser General Public License  as published by
+ * the  Free Software Foundation;  either version 2.1 of the License,  or (at
+ * your option) any later version.
+ *
+ * This  program  is  distributed in  the  hope that it will  be useful,  but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or  FITNESS FOR A  PARTICULAR PURPOSE.  See the  GNU Lesser General Public
+ * License for more details.
+ *
+ * You should  have received  a copy of the GNU Lesser General Public License
+ * along with  this program;  if not, write to the  Free Software Foundation,
+ * Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef INCLUDED_LIB3DS_TYPES_H
+#include <lib3ds/types.h>
+#endif
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Instruction sets of the math kernels
+ * \ingroup simd
+ */
+typedef enum Lib3dsSimdLevel {
+  LIB3DS_SIMD_NONE=0,
+  LIB3DS_SIMD_SSE2=1,
+  LIB3DS_SIMD_AVX2=2
+} Lib3dsSimdLevel;
+
+extern LIB3DSAPI Lib3dsSimdLevel lib3ds_simd_detect();
+extern LIB3DSAPI Lib3dsSimdLevel lib3ds_simd_level();
+extern LIB3DSAPI Lib3dsSimdLevel lib3ds_simd_set_level(Lib3dsSimdLevel level);
+extern LIB3DSAPI void lib3ds_simd_matrix_mult(Lib3dsMatrix m, Lib3dsMatrix a, Lib3dsMatrix b);
+extern LIB3DSAPI void lib3ds_simd_vector_transform(Lib3dsVector c, Lib3dsMatrix m, Lib3dsVector a);
+extern LIB3DSAPI void lib3ds_simd_transform_array(Lib3dsFloat *out, size_t out_stride, Lib3dsMatrix m,
+  const Lib3dsFloat *in, size_t in_stride, Lib3dsDword count);
+extern LIB3DSAPI void lib3ds_simd_transform_bounds(Lib3dsMatrix m, const Lib3dsFloat *in, size_t in_stride,
+  Lib3dsDword count, Lib3dsVector bmin, Lib3dsVector bmax);
+extern LIB3DSAPI void lib3ds_simd_quat_blend(Lib3dsQuat c, Lib3dsQuat a, Lib3dsDouble sa,
+  Lib3dsQuat b, Lib3dsDouble sb);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -25,6 +25,7 @@
 #include <lib3ds/vector.h>
 #include <lib3ds/quat.h>
 #include <lib3ds/node.h>
+#include <lib3ds/vecmath.h>
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
@@ -35,6 +36,226 @@
  */
 
 
+/*
+ * The key arrays of all track types are handled by the functions below
+ * through their size, every key structure starts with its Lib3dsTcb.
+ */
+static Lib3dsIntd
+track_key_frame(const void *keyL, size_t size, Lib3dsDword i)
+{
+  return(((const Lib3dsTcb*)((const char*)keyL + i*size))->frame);
+}
+
+
+/*
+ * Index of the last key with a frame not after t, -1 if t is before the first key.
+ */
+static int
+track_key_index(const void *keyL, Lib3dsDword keys, size_t size, Lib3dsFloat t)
+{
+  Lib3dsDword lo=0,hi=keys,mid;
+
+  while (lo<hi) {
+    mid=lo+(hi-lo)/2;
+    if (t>=(Lib3dsFloat)track_key_frame(keyL, size, mid)) {
+      lo=mid+1;
+    }
+    else {
+      hi=mid;
+    }
+  }
+  return((int)lo-1);
+}
+
+
+/*
+ * True if index is the last key with a frame not after t, index may be -1.
+ */
+static Lib3dsBool
+track_key_contains(const void *keyL, Lib3dsDword keys, size_t size, int index, Lib3dsFloat t)
+{
+  if ((index<-1) || (index>=(int)keys)) {
+    return(LIB3DS_FALSE);
+  }
+  if ((index>=0) && (t<(Lib3dsFloat)track_key_frame(keyL, size, index))) {
+    return(LIB3DS_FALSE);
+  }
+  if ((index+1<(int)keys) && (t>=(Lib3dsFloat)track_key_frame(keyL, size, index+1))) {
+    return(LIB3DS_FALSE);
+  }
+  return(LIB3DS_TRUE);
+}
+
+
+/*
+ * Same as track_key_index, a cursor left by the previous evaluation is tried
+ * first together with the key after it, so stepping through the animation
+ * frame by frame doesn't search the keys. cursor may be NULL.
+ */
+static int
+track_key_locate(const void *keyL, Lib3dsDword keys, size_t size, Lib3dsFloat t,
+  Lib3dsTrackCursor *cursor)
+{
+  int i;
+
+  if (!cursor) {
+    return(track_key_index(keyL, keys, size, t));
+  }
+  i=cursor->index;
+  if (!track_key_contains(keyL, keys, size, i, t)) {
+    ++i;
+    if (!track_key_contains(keyL, keys, size, i, t)) {
+      i=track_key_index(keyL, keys, size, t);
+    }
+  }
+  cursor->index=i;
+  return(i);
+}
+
+
+/*
+ * Finds the segment [index, index+1] of a track with two or more keys that
+ * contains t, t wraps around the keys of repeating tracks. Returns LIB3DS_FALSE
+ * when t is outside the keys of a non repeating track.
+ */
+static Lib3dsBool
+track_key_segment(const void *keyL, Lib3dsDword keys, size_t size, Lib3dsDword flags,
+  Lib3dsFloat t, Lib3dsTrackCursor *cursor, int *index, Lib3dsFloat *u)
+{
+  Lib3dsIntd first,last,frame;
+  Lib3dsFloat nt;
+  int i;
+
+  ASSERT(keys>1);
+  first=track_key_frame(keyL, size, 0);
+  last=track_key_frame(keyL, size, keys-1);
+  if ((t>=(Lib3dsFloat)first) && (t<(Lib3dsFloat)last)) {
+    nt=t;
+    i=track_key_locate(keyL, keys, size, nt, cursor);
+  }
+  else {
+    if (!(flags&LIB3DS_REPEAT)) {
+      return(LIB3DS_FALSE);
+    }
+    nt=(Lib3dsFloat)fmod(t - first, last - first) + first;
+    i=track_key_locate(keyL, keys, size, nt, cursor);
+    if (i<0) {
+      i=0;
+    }
+  }
+  if (i>(int)keys-2) {
+    i=(int)keys-2;
+  }
+
+  frame=track_key_frame(keyL, size, i);
+  *index=i;
+  *u=nt - (Lib3dsFloat)frame;
+  *u/=(Lib3dsFloat)(track_key_frame(keyL, size, i+1) - frame);
+  return(LIB3DS_TRUE);
+}
+
+
+/*
+ * Makes room for a key at frame after the keys at the same or earlier
+ * frames, the array must have room for one more key. Returns the slot.
+ */
+static Lib3dsDword
+track_key_place(char *keyL, Lib3dsDword *keys, size_t size, Lib3dsIntd frame)
+{
+  int i;
+
+  i=track_key_index(keyL, *keys, size, (Lib3dsFloat)frame)+1;
+  memmove(keyL+(i+1)*size, keyL+i*size, (*keys-i)*size);
+  memset(keyL+i*size, 0, size);
+  ++*keys;
+  return(i);
+}
+
+
+/*
+ * Makes room for a key at frame after the keys at the same or earlier
+ * frames. Returns the reallocated array and stores the slot in *index, or
+ * returns 0 if the allocation fails, leaving the array and *keys untouched.
+ */
+static void*
+track_key_insert(void *keyL, Lib3dsDword *keys, size_t size, Lib3dsIntd frame, Lib3dsDword *index)
+{
+  char *p;
+
+  p=(char*)realloc(keyL, (*keys+1)*size);
+  if (!p) {
+    return(0);
+  }
+  *index=track_key_place(p, keys, size, frame);
+  return(p);
+}
+
+
+static void
+track_key_remove(void *keyL, Lib3dsDword *keys, size_t size, Lib3dsIntd frame)
+{
+  char *p=(char*)keyL;
+  int i;
+
+  i=track_key_index(keyL, *keys, size, (Lib3dsFloat)frame);
+  if ((i<0) || (track_key_frame(keyL, size, i)!=frame)) {
+    return;
+  }
+  while ((i>0) && (track_key_frame(keyL, size, i-1)==frame)) {
+    --i;
+  }
+  memmove(p+i*size, p+(i+1)*size, (*keys-i-1)*size);
+  --*keys;
+}
+
+
+/*
+ * Moves the keys read from a file into a track. Files written in frame order
+ * take the array as it is, anything else is inserted key by key. The key
+ * array of the track is stored in *result, the read array is consumed.
+ * Returns LIB3DS_FALSE if the allocation fails, the track keys are left
+ * untouched then.
+ */
+static Lib3dsBool
+track_key_merge(void *keyL, Lib3dsDword *keys, void *readL, Lib3dsDword n, size_t size, void **result)
+{
+  Lib3dsDword i;
+  char *p;
+
+  if (!*keys) {
+    for (i=1; i<n; ++i) {
+      if (track_key_frame(readL, size, i-1)>track_key_frame(readL, size, i)) {
+        break;
+      }
+    }
+    if ((i>=n) && n) {
+      free(keyL);
+      *keys=n;
+      *result=readL;
+      return(LIB3DS_TRUE);
+    }
+  }
+  if (!n) {
+    free(readL);
+    *result=keyL;
+    return(LIB3DS_TRUE);
+  }
+
+  p=(char*)realloc(keyL, (*keys+n)*size);
+  if (!p) {
+    free(readL);
+    return(LIB3DS_FALSE);
+  }
+  for (i=0; i<n; ++i) {
+    const char *key=(const char*)readL + i*size;
+    memcpy(p + track_key_place(p, keys, size, ((const Lib3dsTcb*)key)->frame)*size, key, size);
+  }
+  free(readL);
+  *result=p;
+  return(LIB3DS_TRUE);
+}
+
+
 /*!
  * \ingroup tracks 
  */
@@ -64,13 +285,12 @@ lib3ds_bool_key_free(Lib3dsBoolKey *key)
 void
 lib3ds_bool_track_free_keys(Lib3dsBoolTrack *track)
 {
-  Lib3dsBoolKey *p,*q;
-
   ASSERT(track);
-  for (p=track->keyL; p; p=q) {
-    q=p->next;
-    lib3ds_bool_key_free(p);
+  if (track->keyL) {
+    free(track->keyL);
   }
+  track->keyL=0;
+  track->keys=0;
 }
 
 
@@ -80,36 +300,18 @@ lib3ds_bool_track_free_keys(Lib3dsBoolTrack *track)
 void
 lib3ds_bool_track_insert(Lib3dsBoolTrack *track, Lib3dsBoolKey *key)
 {
+  Lib3dsDword index;
+  Lib3dsBoolKey *keyL;
+
   ASSERT(track);
   ASSERT(key);
-  ASSERT(!key->next);
-
-  if (!track->keyL) {
-    track->keyL=key;
-    key->next=0;
-  }
-  else {
-    Lib3dsBoolKey *k,*p;
-
-    for (p=0,k=track->keyL; k!=0; p=k, k=k->next) {
-      if (k->tcb.frame>key->tcb.frame) {
-        break;
-      }
-    }
-    if (!p) {
-      key->next=track->keyL;
-      track->keyL=key;
-    }
-    else {
-      key->next=k;
-      p->next=key;
-    }
- 
-    if (k && (key->tcb.frame==k->tcb.frame)) {
-      key->next=k->next;
-      lib3ds_bool_key_free(k);
-    }
+  keyL=(Lib3dsBoolKey*)track_key_insert(track->keyL, &track->keys,
+    sizeof(Lib3dsBoolKey), key->tcb.frame, &index);
+  if (keyL) {
+    track->keyL=keyL;
+    track->keyL[index]=*key;
   }
+  lib3ds_bool_key_free(key);
 }
 
 
@@ -119,24 +321,8 @@ lib3ds_bool_track_insert(Lib3dsBoolTrack *track, Lib3dsBoolKey *key)
 void
 lib3ds_bool_track_remove(Lib3dsBoolTrack *track, Lib3dsIntd frame)
 {
-  Lib3dsBoolKey *k,*p;
-  
   ASSERT(track);
-  if (!track->keyL) {
-    return;
-  }
-  for (p=0,k=track->keyL; k!=0; p=k, k=k->next) {
-    if (k->tcb.frame==frame) {
-      if (!p) {
-        track->keyL=track->keyL->next;
-      }
-      else {
-        p->next=k->next;
-      }
-      lib3ds_bool_key_free(k);
-      break;
-    }
-  }
+  track_key_remove(track->keyL, &track->keys, sizeof(Lib3dsBoolKey), frame);
 }
 
 
@@ -146,42 +332,28 @@ lib3ds_bool_track_remove(Lib3dsBoolTrack *track, Lib3dsIntd frame)
 void
 lib3ds_bool_track_eval(Lib3dsBoolTrack *track, Lib3dsBool *p, Lib3dsFloat t)
 {
-  Lib3dsBoolKey *k;
-  Lib3dsBool result;
+  lib3ds_bool_track_eval_cursor(track, 0, p, t);
+}
 
-  ASSERT(p);
-  if (!track->keyL) {
-    *p=LIB3DS_FALSE;
-    return;
-  }
-  if (!track->keyL->next) {
-    *p = LIB3DS_TRUE;
-    return;
-  }
 
-  result=LIB3DS_FALSE;
-  k=track->keyL;
-  while ((t<(Lib3dsFloat)k->tcb.frame) && (t>=(Lib3dsFloat)k->next->tcb.frame)) {
-    if (result) {
-      result=LIB3DS_FALSE;
-    }
-    else {
-      result=LIB3DS_TRUE;
-    }
-    if (!k->next) {
-      if (track->flags&LIB3DS_REPEAT) {
-        t-=(Lib3dsFloat)k->tcb.frame;
-        k=track->keyL;
-      }
-      else {
-        break;
-      }
-    }
-    else {
-      k=k->next;
-    }
-  }
-  *p=result;
+/*!
+ * Evaluates the track like lib3ds_bool_track_eval(), the cursor is taken for
+ * symmetry with the other tracks and left untouched.
+ *
+ * The result is the one of the original key list evaluation: LIB3DS_TRUE
+ * for a single key, LIB3DS_FALSE for no key or for several keys, whatever
+ * the time.
+ *
+ * \ingroup tracks
+ */
+void
+lib3ds_bool_track_eval_cursor(Lib3dsBoolTrack *track, Lib3dsTrackCursor *cursor, Lib3dsBool *p,
+  Lib3dsFloat t)
+{
+  (void)cursor;
+  (void)t;
+  ASSERT(p);
+  *p=(track->keys==1) ? LIB3DS_TRUE : LIB3DS_FALSE;
 }
 
 
@@ -193,21 +365,32 @@ lib3ds_bool_track_read(Lib3dsBoolTrack *track, Lib3dsIo *io)
 {
   int keys;
   int i;
-  Lib3dsBoolKey *k;
+  Lib3dsBoolKey *keyL,*k;
+  void *merged;
 
   track->flags=lib3ds_io_read_word(io);
   lib3ds_io_read_dword(io);
   lib3ds_io_read_dword(io);
   keys=lib3ds_io_read_intd(io);
+  if (keys<0) {
+    return(LIB3DS_FALSE);
+  }
 
+  keyL=(Lib3dsBoolKey*)calloc(sizeof(Lib3dsBoolKey), keys ? keys : 1);
+  if (!keyL) {
+    return(LIB3DS_FALSE);
+  }
   for (i=0; i<keys; ++i) {
-    k=lib3ds_bool_key_new();
+    k=&keyL[i];
     if (!lib3ds_tcb_read(&k->tcb, io)) {
+      free(keyL);
       return(LIB3DS_FALSE);
     }
-    lib3ds_bool_track_insert(track, k);
   }
-  
+  if (!track_key_merge(track->keyL, &track->keys, keyL, keys, sizeof(Lib3dsBoolKey), &merged)) {
+    return(LIB3DS_FALSE);
+  }
+  track->keyL=(Lib3dsBoolKey*)merged;
   return(LIB3DS_TRUE);
 }
 
@@ -219,16 +402,12 @@ Lib3dsBool
 lib3ds_bool_track_write(Lib3dsBoolTrack *track, Lib3dsIo *io)
 {
   Lib3dsBoolKey *k;
-  Lib3dsDword num=0;
-  for (k=track->keyL; k; k=k->next) {
-    ++num;
-  }
   lib3ds_io_write_word(io, (Lib3dsWord)track->flags);
   lib3ds_io_write_dword(io, 0);
   lib3ds_io_write_dword(io, 0);
-  lib3ds_io_write_dword(io, num);
+  lib3ds_io_write_dword(io, track->keys);
 
-  for (k=track->keyL; k; k=k->next) {
+  for (k=track->keyL; k<track->keyL+track->keys; ++k) {
     if (!lib3ds_tcb_write(&k->tcb,io)) {
       return(LIB3DS_FALSE);
     }
@@ -266,13 +445,16 @@ lib3ds_lin1_key_free(Lib3dsLin1Key *key)
 void
 lib3ds_lin1_track_free_keys(Lib3dsLin1Track *track)
 {
-  Lib3dsLin1Key *p,*q;
-
   ASSERT(track);
-  for (p=track->keyL; p; p=q) {
-    q=p->next;
-    lib3ds_lin1_key_free(p);
+  if (track->keyL) {
+    free(track->keyL);
+  }
+  if (track->segL) {
+    free(track->segL);
+    track->segL=0;
   }
+  track->keyL=0;
+  track->keys=0;
 }
 
 
@@ -322,87 +504,116 @@ lib3ds_lin1_key_setup(Lib3dsLin1Key *p, Lib3dsLin1Key *cp, Lib3dsLin1Key *c,
 }
 
 
+static void
+lin1_track_fill_segments(Lib3dsLin1Track *track)
+{
+  Lib3dsLin1Key *k;
+  Lib3dsLin1Segment *s;
+  Lib3dsDword i;
+
+  for (i=0; i+1<track->keys; ++i) {
+    k=&track->keyL[i];
+    s=&track->segL[i];
+    s->c[0]=k[0].value;
+    s->c[1]=k[0].dd;
+    s->c[2]=3*(k[1].value - k[0].value) - 2*k[0].dd - k[1].ds;
+    s->c[3]=2*(k[0].value - k[1].value) + k[0].dd + k[1].ds;
+  }
+}
+
+
 /*!
  * \ingroup tracks 
  */
 void
 lib3ds_lin1_track_setup(Lib3dsLin1Track *track)
 {
-  Lib3dsLin1Key *pp,*pc,*pn,*pl;
+  Lib3dsLin1Key *k,*pc;
+  Lib3dsDword n,i;
 
   ASSERT(track);
-  pc=track->keyL;
-  if (!pc) {
+  k=track->keyL;
+  n=track->keys;
+  if (!n) {
     return;
   }
-  if (!pc->next) {
+  if (n==1) {
+    pc=k;
     pc->ds=0;
     pc->dd=0;
     return;
   }
 
   if (track->flags&LIB3DS_SMOOTH) {
-    for (pl=track->keyL; pl->next->next; pl=pl->next);
-    lib3ds_lin1_key_setup(pl, pl->next, pc, 0, pc->next);
- }
- else {
-   lib3ds_lin1_key_setup(0, 0, pc, 0, pc->next);
- }
-  for (;;) {
-    pp=pc;
-    pc=pc->next;
-    pn=pc->next;
-    if (!pn) {
-      break;
-    }
-    lib3ds_lin1_key_setup(pp, 0, pc, 0, pn);
+    lib3ds_lin1_key_setup(&k[n-2], &k[n-1], &k[0], 0, &k[1]);
+  }
+  else {
+    lib3ds_lin1_key_setup(0, 0, &k[0], 0, &k[1]);
+  }
+  for (i=1; i<n-1; ++i) {
+    lib3ds_lin1_key_setup(&k[i-1], 0, &k[i], 0, &k[i+1]);
   }
 
   if (track->flags&LIB3DS_SMOOTH) {
-    lib3ds_lin1_key_setup(pp, 0, pc, track->keyL, track->keyL->next);
+    lib3ds_lin1_key_setup(&k[n-2], 0, &k[n-1], &k[0], &k[1]);
   }
   else {
-    lib3ds_lin1_key_setup(pp, 0, pc, 0, 0);
+    lib3ds_lin1_key_setup(&k[n-2], 0, &k[n-1], 0, 0);
+  }
+  if (track->segL) {
+    lin1_track_fill_segments(track);
   }
 }
 
 
+/*!
+ * Precomputes the polynomial of every segment of the track, evaluating
+ * it then takes three multiply-adds per component. Call it again after
+ * inserting or removing keys.
+ *
+ * \ingroup tracks
+ */
+void
+lib3ds_lin1_track_precompute(Lib3dsLin1Track *track)
+{
+  ASSERT(track);
+  if (track->segL) {
+    free(track->segL);
+    track->segL=0;
+  }
+  if (track->keys<2) {
+    return;
+  }
+  track->segL=(Lib3dsLin1Segment*)calloc(sizeof(Lib3dsLin1Segment), track->keys-1);
+  if (!track->segL) {
+    return;
+  }
+  lin1_track_fill_segments(track);
+}
+
+
 /*!
  * \ingroup tracks 
  */
 void
 lib3ds_lin1_track_insert(Lib3dsLin1Track *track, Lib3dsLin1Key *key)
 {
+  Lib3dsDword index;
+  Lib3dsLin1Key *keyL;
+
   ASSERT(track);
   ASSERT(key);
-  ASSERT(!key->next);
-
-  if (!track->keyL) {
-    track->keyL=key;
-    key->next=0;
+  if (track->segL) {
+    free(track->segL);
+    track->segL=0;
   }
-  else {
-    Lib3dsLin1Key *k,*p;
-
-    for (p=0,k=track->keyL; k!=0; p=k, k=k->next) {
-      if (k->tcb.frame>key->tcb.frame) {
-        break;
-      }
-    }
-    if (!p) {
-      key->next=track->keyL;
-      track->keyL=key;
-    }
-    else {
-      key->next=k;
-      p->next=key;
-    }
- 
-    if (k && (key->tcb.frame==k->tcb.frame)) {
-      key->next=k->next;
-      lib3ds_lin1_key_free(k);
-    }
+  keyL=(Lib3dsLin1Key*)track_key_insert(track->keyL, &track->keys,
+    sizeof(Lib3dsLin1Key), key->tcb.frame, &index);
+  if (keyL) {
+    track->keyL=keyL;
+    track->keyL[index]=*key;
   }
+  lib3ds_lin1_key_free(key);
 }
 
 
@@ -412,24 +623,12 @@ lib3ds_lin1_track_insert(Lib3dsLin1Track *track, Lib3dsLin1Key *key)
 void
 lib3ds_lin1_track_remove(Lib3dsLin1Track *track, Lib3dsIntd frame)
 {
-  Lib3dsLin1Key *k,*p;
-  
   ASSERT(track);
-  if (!track->keyL) {
-    return;
-  }
-  for (p=0,k=track->keyL; k!=0; p=k, k=k->next) {
-    if (k->tcb.frame==frame) {
-      if (!p) {
-        track->keyL=track->keyL->next;
-      }
-      else {
-        p->next=k->next;
-      }
-      lib3ds_lin1_key_free(k);
-      break;
-    }
+  if (track->segL) {
+    free(track->segL);
+    track->segL=0;
   }
+  track_key_remove(track->keyL, &track->keys, sizeof(Lib3dsLin1Key), frame);
 }
 
 
@@ -451,52 +650,50 @@ lib3ds_float_cubic(Lib3dsFloat a, Lib3dsFloat p, Lib3dsFloat q, Lib3dsFloat b, L
  */
 void
 lib3ds_lin1_track_eval(Lib3dsLin1Track *track, Lib3dsFloat *p, Lib3dsFloat t)
+{
+  lib3ds_lin1_track_eval_cursor(track, 0, p, t);
+}
+
+
+/*!
+ * Evaluates the track like lib3ds_lin1_track_eval(), cursor remembers the
+ * segment found for t to speed up the next evaluation at a nearby time.
+ *
+ * \ingroup tracks
+ */
+void
+lib3ds_lin1_track_eval_cursor(Lib3dsLin1Track *track, Lib3dsTrackCursor *cursor, Lib3dsFloat *p, Lib3dsFloat t)
 {
   Lib3dsLin1Key *k;
-  Lib3dsFloat nt;
   Lib3dsFloat u;
+  int i;
 
   ASSERT(p);
-  if (!track->keyL) {
+  if (!track->keys) {
     *p=0;
     return;
   }
-  if (!track->keyL->next || ((t<track->keyL->tcb.frame) && ((track->flags&LIB3DS_REPEAT) != 0))) {
-    *p = track->keyL->value;
+  if ((track->keys==1) || ((t<track->keyL[0].tcb.frame) && ((track->flags&LIB3DS_REPEAT) != 0))) {
+    *p = track->keyL[0].value;
     return;
   }
 
-  for (k=track->keyL; k->next!=0; k=k->next) {
-    if ((t>=(Lib3dsFloat)k->tcb.frame) && (t<(Lib3dsFloat)k->next->tcb.frame)) {
-      break;
-    }
-  }
-  if (!k->next) {
-    if (track->flags&LIB3DS_REPEAT) {
-      nt=(Lib3dsFloat)fmod(t - track->keyL->tcb.frame, k->tcb.frame - track->keyL->tcb.frame) + track->keyL->tcb.frame;
-      for (k=track->keyL; k->next!=0; k=k->next) {
-        if ((nt>=(Lib3dsFloat)k->tcb.frame) && (nt<(Lib3dsFloat)k->next->tcb.frame)) {
-          break;
-        }
-      }
-      ASSERT(k->next);
-    }
-    else {
-      *p = k->value;
-      return;
-    }
+  if (!track_key_segment(track->keyL, track->keys, sizeof(Lib3dsLin1Key), track->flags, t, cursor, &i, &u)) {
+    *p = track->keyL[track->keys-1].value;
+    return;
   }
-  else {
-    nt=t;
+  if (track->segL) {
+    Lib3dsFloat *c=track->segL[i].c;
+    *p=((c[3]*u + c[2])*u + c[1])*u + c[0];
+    return;
   }
-  u=nt - (Lib3dsFloat)k->tcb.frame;
-  u/=(Lib3dsFloat)(k->next->tcb.frame - k->tcb.frame);
+  k=&track->keyL[i];
 
   *p = lib3ds_float_cubic(
-    k->value,
-    k->dd,
-    k->next->ds,
-    k->next->value,
+    k[0].value,
+    k[0].dd,
+    k[1].ds,
+    k[1].value,
     u
   );
 }
@@ -510,21 +707,37 @@ lib3ds_lin1_track_read(Lib3dsLin1Track *track, Lib3dsIo *io)
 {
   int keys;
   int i;
-  Lib3dsLin1Key *k;
+  Lib3dsLin1Key *keyL,*k;
+  void *merged;
 
   track->flags=lib3ds_io_read_word(io);
   lib3ds_io_read_dword(io);
   lib3ds_io_read_dword(io);
   keys=lib3ds_io_read_intd(io);
+  if (keys<0) {
+    return(LIB3DS_FALSE);
+  }
 
+  keyL=(Lib3dsLin1Key*)calloc(sizeof(Lib3dsLin1Key), keys ? keys : 1);
+  if (!keyL) {
+    return(LIB3DS_FALSE);
+  }
   for (i=0; i<keys; ++i) {
-    k=lib3ds_lin1_key_new();
+    k=&keyL[i];
     if (!lib3ds_tcb_read(&k->tcb, io)) {
+      free(keyL);
       return(LIB3DS_FALSE);
     }
     k->value=lib3ds_io_read_float(io);
-    lib3ds_lin1_track_insert(track, k);
   }
+  if (track->segL) {
+    free(track->segL);
+    track->segL=0;
+  }
+  if (!track_key_merge(track->keyL, &track->keys, keyL, keys, sizeof(Lib3dsLin1Key), &merged)) {
+    return(LIB3DS_FALSE);
+  }
+  track->keyL=(Lib3dsLin1Key*)merged;
   lib3ds_lin1_track_setup(track);
   return(LIB3DS_TRUE);
 }
@@ -537,16 +750,12 @@ Lib3dsBool
 lib3ds_lin1_track_write(Lib3dsLin1Track *track, Lib3dsIo *io)
 {
   Lib3dsLin1Key *k;
-  Lib3dsDword num=0;
-  for (k=track->keyL; k; k=k->next) {
-    ++num;
-  }
   lib3ds_io_write_word(io, (Lib3dsWord)track->flags);
   lib3ds_io_write_dword(io, 0);
   lib3ds_io_write_dword(io, 0);
-  lib3ds_io_write_dword(io, num);
+  lib3ds_io_write_dword(io, track->keys);
 
-  for (k=track->keyL; k; k=k->next) {
+  for (k=track->keyL; k<track->keyL+track->keys; ++k) {
     if (!lib3ds_tcb_write(&k->tcb,io)) {
       return(LIB3DS_FALSE);
     }
@@ -592,13 +801,16 @@ lib3ds_lin3_key_free(Lib3dsLin3Key *key)
 void
 lib3ds_lin3_track_free_keys(Lib3dsLin3Track *track)
 {
-  Lib3dsLin3Key *p,*q;
-
   ASSERT(track);
-  for (p=track->keyL; p; p=q) {
-    q=p->next;
-    lib3ds_lin3_key_free(p);
+  if (track->keyL) {
+    free(track->keyL);
+  }
+  if (track->segL) {
+    free(track->segL);
+    track->segL=0;
   }
+  track->keyL=0;
+  track->keys=0;
 }
 
 
@@ -621,15 +833,15 @@ lib3ds_lin3_key_setup(Lib3dsLin3Key *p, Lib3dsLin3Key *cp, Lib3dsLin3Key *c,
     cn=c;
   }
   if (!p && !n) {
-    lib3ds_vector_zero(c->ds);
-    lib3ds_vector_zero(c->dd);
+    lib3ds_vector_zero_inline(c->ds);
+    lib3ds_vector_zero_inline(c->dd);
     return;
   }
 
   if (n && p) {
     lib3ds_tcb(&p->tcb, &cp->tcb, &c->tcb, &cn->tcb, &n->tcb, &ksm, &ksp, &kdm, &kdp);
-    lib3ds_vector_sub(np, c->value, p->value); 
-    lib3ds_vector_sub(nn, n->value, c->value); 
+    lib3ds_vector_sub_inline(np, c->value, p->value); 
+    lib3ds_vector_sub_inline(nn, n->value, c->value); 
 
     for(i=0; i<3; ++i) {
       c->ds[i]=ksm*np[i] + ksp*nn[i];
@@ -638,14 +850,35 @@ lib3ds_lin3_key_setup(Lib3dsLin3Key *p, Lib3dsLin3Key *cp, Lib3dsLin3Key *c,
   }
   else {
     if (p) {
-      lib3ds_vector_sub(np, c->value, p->value);
-      lib3ds_vector_copy(c->ds, np);
-      lib3ds_vector_copy(c->dd, np);
+      lib3ds_vector_sub_inline(np, c->value, p->value);
+      lib3ds_vector_copy_inline(c->ds, np);
+      lib3ds_vector_copy_inline(c->dd, np);
     }
     if (n) {
-      lib3ds_vector_sub(nn, n->value, c->value); 
-      lib3ds_vector_copy(c->ds, nn);
-      lib3ds_vector_copy(c->dd, nn);
+      lib3ds_vector_sub_inline(nn, n->value, c->value); 
+      lib3ds_vector_copy_inline(c->ds, nn);
+      lib3ds_vector_copy_inline(c->dd, nn);
+    }
+  }
+}
+
+
+static void
+lin3_track_fill_segments(Lib3dsLin3Track *track)
+{
+  Lib3dsLin3Key *k;
+  Lib3dsLin3Segment *s;
+  Lib3dsDword i;
+  int j;
+
+  for (i=0; i+1<track->keys; ++i) {
+    k=&track->keyL[i];
+    s=&track->segL[i];
+    for (j=0; j<3; ++j) {
+      s->c[0][j]=k[0].value[j];
+      s->c[1][j]=k[0].dd[j];
+      s->c[2][j]=3*(k[1].value[j] - k[0].value[j]) - 2*k[0].dd[j] - k[1].ds[j];
+      s->c[3][j]=2*(k[0].value[j] - k[1].value[j]) + k[0].dd[j] + k[1].ds[j];
     }
   }
 }
@@ -657,81 +890,92 @@ lib3ds_lin3_key_setup(Lib3dsLin3Key *p, Lib3dsLin3Key *cp, Lib3dsLin3Key *c,
 void
 lib3ds_lin3_track_setup(Lib3dsLin3Track *track)
 {
-  Lib3dsLin3Key *pp,*pc,*pn,*pl;
+  Lib3dsLin3Key *k,*pc;
+  Lib3dsDword n,i;
 
   ASSERT(track);
-  pc=track->keyL;
-  if (!pc) {
+  k=track->keyL;
+  n=track->keys;
+  if (!n) {
     return;
   }
-  if (!pc->next) {
-    lib3ds_vector_zero(pc->ds);
-    lib3ds_vector_zero(pc->dd);
+  if (n==1) {
+    pc=k;
+    lib3ds_vector_zero_inline(pc->ds);
+    lib3ds_vector_zero_inline(pc->dd);
     return;
   }
 
   if (track->flags&LIB3DS_SMOOTH) {
-    for (pl=track->keyL; pl->next->next; pl=pl->next);
-    lib3ds_lin3_key_setup(pl, pl->next, pc, 0, pc->next);
- }
- else {
-   lib3ds_lin3_key_setup(0, 0, pc, 0, pc->next);
- }
-  for (;;) {
-    pp=pc;
-    pc=pc->next;
-    pn=pc->next;
-    if (!pn) {
-      break;
-    }
-    lib3ds_lin3_key_setup(pp, 0, pc, 0, pn);
+    lib3ds_lin3_key_setup(&k[n-2], &k[n-1], &k[0], 0, &k[1]);
+  }
+  else {
+    lib3ds_lin3_key_setup(0, 0, &k[0], 0, &k[1]);
+  }
+  for (i=1; i<n-1; ++i) {
+    lib3ds_lin3_key_setup(&k[i-1], 0, &k[i], 0, &k[i+1]);
   }
 
   if (track->flags&LIB3DS_SMOOTH) {
-    lib3ds_lin3_key_setup(pp, 0, pc, track->keyL, track->keyL->next);
+    lib3ds_lin3_key_setup(&k[n-2], 0, &k[n-1], &k[0], &k[1]);
   }
   else {
-    lib3ds_lin3_key_setup(pp, 0, pc, 0, 0);
+    lib3ds_lin3_key_setup(&k[n-2], 0, &k[n-1], 0, 0);
+  }
+  if (track->segL) {
+    lin3_track_fill_segments(track);
   }
 }
 
 
+/*!
+ * Precomputes the polynomial of every segment of the track, evaluating
+ * it then takes three multiply-adds per component. Call it again after
+ * inserting or removing keys.
+ *
+ * \ingroup tracks
+ */
+void
+lib3ds_lin3_track_precompute(Lib3dsLin3Track *track)
+{
+  ASSERT(track);
+  if (track->segL) {
+    free(track->segL);
+    track->segL=0;
+  }
+  if (track->keys<2) {
+    return;
+  }
+  track->segL=(Lib3dsLin3Segment*)calloc(sizeof(Lib3dsLin3Segment), track->keys-1);
+  if (!track->segL) {
+    return;
+  }
+  lin3_track_fill_segments(track);
+}
+
+
 /*!
  * \ingroup tracks 
  */
 void
 lib3ds_lin3_track_insert(Lib3dsLin3Track *track, Lib3dsLin3Key *key)
 {
+  Lib3dsDword index;
+  Lib3dsLin3Key *keyL;
+
   ASSERT(track);
   ASSERT(key);
-  ASSERT(!key->next);
-
-  if (!track->keyL) {
-    track->keyL=key;
-    key->next=0;
+  if (track->segL) {
+    free(track->segL);
+    track->segL=0;
   }
-  else {
-    Lib3dsLin3Key *k,*p;
-
-    for (p=0,k=track->keyL; k!=0; p=k, k=k->next) {
-      if (k->tcb.frame>key->tcb.frame) {
-        break;
-      }
-    }
-    if (!p) {
-      key->next=track->keyL;
-      track->keyL=key;
-    }
-    else {
-      key->next=k;
-      p->next=key;
-    }
- 
-    if (k && (key->tcb.frame==k->tcb.frame)) {
-      key->next=k->next;
-      lib3ds_lin3_key_free(k);
-    }
+  keyL=(Lib3dsLin3Key*)track_key_insert(track->keyL, &track->keys,
+    sizeof(Lib3dsLin3Key), key->tcb.frame, &index);
+  if (keyL) {
+    track->keyL=keyL;
+    track->keyL[index]=*key;
   }
+  lib3ds_lin3_key_free(key);
 }
 
 
@@ -741,24 +985,12 @@ lib3ds_lin3_track_insert(Lib3dsLin3Track *track, Lib3dsLin3Key *key)
 void
 lib3ds_lin3_track_remove(Lib3dsLin3Track *track, Lib3dsIntd frame)
 {
-  Lib3dsLin3Key *k,*p;
-  
   ASSERT(track);
-  if (!track->keyL) {
-    return;
-  }
-  for (p=0,k=track->keyL; k!=0; p=k, k=k->next) {
-    if (k->tcb.frame==frame) {
-      if (!p) {
-        track->keyL=track->keyL->next;
-      }
-      else {
-        p->next=k->next;
-      }
-      lib3ds_lin3_key_free(k);
-      break;
-    }
+  if (track->segL) {
+    free(track->segL);
+    track->segL=0;
   }
+  track_key_remove(track->keyL, &track->keys, sizeof(Lib3dsLin3Key), frame);
 }
 
 
@@ -767,52 +999,52 @@ lib3ds_lin3_track_remove(Lib3dsLin3Track *track, Lib3dsIntd frame)
  */
 void
 lib3ds_lin3_track_eval(Lib3dsLin3Track *track, Lib3dsVector p, Lib3dsFloat t)
+{
+  lib3ds_lin3_track_eval_cursor(track, 0, p, t);
+}
+
+
+/*!
+ * Evaluates the track like lib3ds_lin3_track_eval(), cursor remembers the
+ * segment found for t to speed up the next evaluation at a nearby time.
+ *
+ * \ingroup tracks
+ */
+void
+lib3ds_lin3_track_eval_cursor(Lib3dsLin3Track *track, Lib3dsTrackCursor *cursor, Lib3dsVector p, Lib3dsFloat t)
 {
   Lib3dsLin3Key *k;
-  Lib3dsFloat nt;
   Lib3dsFloat u;
+  int i;
 
-  if (!track->keyL) {
-    lib3ds_vector_zero(p);
+  if (!track->keys) {
+    lib3ds_vector_zero_inline(p);
     return;
   }
-  if (!track->keyL->next || ((t<track->keyL->tcb.frame) && ((track->flags&LIB3DS_REPEAT) != 0))) {
-    lib3ds_vector_copy(p, track->keyL->value);
+  if ((track->keys==1) || ((t<track->keyL[0].tcb.frame) && ((track->flags&LIB3DS_REPEAT) != 0))) {
+    lib3ds_vector_copy_inline(p, track->keyL[0].value);
     return;
   }
 
-  for (k=track->keyL; k->next!=0; k=k->next) {
-    if ((t>=(Lib3dsFloat)k->tcb.frame) && (t<(Lib3dsFloat)k->next->tcb.frame)) {
-      break;
-    }
-  }
-  if (!k->next) {
-    if (track->flags&LIB3DS_REPEAT) {
-      nt=(Lib3dsFloat)fmod(t - track->keyL->tcb.frame, k->tcb.frame - track->keyL->tcb.frame) + track->keyL->tcb.frame;
-      for (k=track->keyL; k->next!=0; k=k->next) {
-        if ((nt>=(Lib3dsFloat)k->tcb.frame) && (nt<(Lib3dsFloat)k->next->tcb.frame)) {
-          break;
-        }
-      }
-      ASSERT(k->next);
-    }
-    else {
-      lib3ds_vector_copy(p, k->value);
-      return;
-    }
+  if (!track_key_segment(track->keyL, track->keys, sizeof(Lib3dsLin3Key), track->flags, t, cursor, &i, &u)) {
+    lib3ds_vector_copy_inline(p, track->keyL[track->keys-1].value);
+    return;
   }
-  else {
-    nt=t;
+  if (track->segL) {
+    Lib3dsLin3Segment *c=&track->segL[i];
+    p[0]=((c->c[3][0]*u + c->c[2][0])*u + c->c[1][0])*u + c->c[0][0];
+    p[1]=((c->c[3][1]*u + c->c[2][1])*u + c->c[1][1])*u + c->c[0][1];
+    p[2]=((c->c[3][2]*u + c->c[2][2])*u + c->c[1][2])*u + c->c[0][2];
+    return;
   }
-  u=nt - (Lib3dsFloat)k->tcb.frame;
-  u/=(Lib3dsFloat)(k->next->tcb.frame - k->tcb.frame);
-  
-  lib3ds_vector_cubic(
+  k=&track->keyL[i];
+
+  lib3ds_vector_cubic_inline(
     p,
-    k->value,
-    k->dd,
-    k->next->ds,
-    k->next->value,
+    k[0].value,
+    k[0].dd,
+    k[1].ds,
+    k[1].value,
     u
   );
 }
@@ -826,23 +1058,39 @@ lib3ds_lin3_track_read(Lib3dsLin3Track *track, Lib3dsIo *io)
 {
   int keys;
   int i,j;
-  Lib3dsLin3Key *k;
+  Lib3dsLin3Key *keyL,*k;
+  void *merged;
 
   track->flags=lib3ds_io_read_word(io);
   lib3ds_io_read_dword(io);
   lib3ds_io_read_dword(io);
   keys=lib3ds_io_read_intd(io);
+  if (keys<0) {
+    return(LIB3DS_FALSE);
+  }
 
+  keyL=(Lib3dsLin3Key*)calloc(sizeof(Lib3dsLin3Key), keys ? keys : 1);
+  if (!keyL) {
+    return(LIB3DS_FALSE);
+  }
   for (i=0; i<keys; ++i) {
-    k=lib3ds_lin3_key_new();
+    k=&keyL[i];
     if (!lib3ds_tcb_read(&k->tcb, io)) {
+      free(keyL);
       return(LIB3DS_FALSE);
     }
     for (j=0; j<3; ++j) {
       k->value[j]=lib3ds_io_read_float(io);
     }
-    lib3ds_lin3_track_insert(track, k);
   }
+  if (track->segL) {
+    free(track->segL);
+    track->segL=0;
+  }
+  if (!track_key_merge(track->keyL, &track->keys, keyL, keys, sizeof(Lib3dsLin3Key), &merged)) {
+    return(LIB3DS_FALSE);
+  }
+  track->keyL=(Lib3dsLin3Key*)merged;
   lib3ds_lin3_track_setup(track);
   return(LIB3DS_TRUE);
 }
@@ -855,16 +1103,12 @@ Lib3dsBool
 lib3ds_lin3_track_write(Lib3dsLin3Track *track, Lib3dsIo *io)
 {
   Lib3dsLin3Key *k;
-  Lib3dsDword num=0;
-  for (k=track->keyL; k; k=k->next) {
-    ++num;
-  }
   lib3ds_io_write_word(io, (Lib3dsWord)track->flags);
   lib3ds_io_write_dword(io, 0);
   lib3ds_io_write_dword(io, 0);
-  lib3ds_io_write_dword(io, num);
+  lib3ds_io_write_dword(io, track->keys);
 
-  for (k=track->keyL; k; k=k->next) {
+  for (k=track->keyL; k<track->keyL+track->keys; ++k) {
     if (!lib3ds_tcb_write(&k->tcb,io)) {
       return(LIB3DS_FALSE);
     }
@@ -903,13 +1147,16 @@ lib3ds_quat_key_free(Lib3dsQuatKey *key)
 void
 lib3ds_quat_track_free_keys(Lib3dsQuatTrack *track)
 {
-  Lib3dsQuatKey *p,*q;
-
   ASSERT(track);
-  for (p=track->keyL; p; p=q) {
-    q=p->next;
-    lib3ds_quat_key_free(p);
+  if (track->keyL) {
+    free(track->keyL);
+  }
+  if (track->segL) {
+    free(track->segL);
+    track->segL=0;
   }
+  track->keyL=0;
+  track->keys=0;
 }
 
 
@@ -944,7 +1191,7 @@ lib3ds_quat_key_setup(Lib3dsQuatKey *p, Lib3dsQuatKey *cp, Lib3dsQuatKey *c,
     }
     else {
       lib3ds_quat_copy(q, p->q);
-      if (lib3ds_quat_dot(q,c->q)<0) lib3ds_quat_neg(q);
+      if (lib3ds_quat_dot_inline(q,c->q)<0) lib3ds_quat_neg_inline(q);
       
       lib3ds_quat_ln_dif(qp, q, c->q);
     }
@@ -956,7 +1203,7 @@ lib3ds_quat_key_setup(Lib3dsQuatKey *p, Lib3dsQuatKey *cp, Lib3dsQuatKey *c,
     }
     else {
       lib3ds_quat_copy(q, n->q);
-      if (lib3ds_quat_dot(q,c->q)<0) lib3ds_quat_neg(q);
+      if (lib3ds_quat_dot_inline(q,c->q)<0) lib3ds_quat_neg_inline(q);
       lib3ds_quat_ln_dif(qn, c->q, q);
     }
   }
@@ -988,59 +1235,99 @@ lib3ds_quat_key_setup(Lib3dsQuatKey *p, Lib3dsQuatKey *cp, Lib3dsQuatKey *c,
 }
 
 
+static void
+quat_track_fill_segments(Lib3dsQuatTrack *track)
+{
+  Lib3dsQuatKey *k;
+  Lib3dsDword i;
+
+  for (i=0; i+1<track->keys; ++i) {
+    k=&track->keyL[i];
+    track->segL[i].ab=lib3ds_quat_dot_inline(k[0].q, k[1].q);
+    track->segL[i].pq=lib3ds_quat_dot_inline(k[0].dd, k[1].ds);
+  }
+}
+
+
 /*!
  * \ingroup tracks 
  */
 void
 lib3ds_quat_track_setup(Lib3dsQuatTrack *track)
 {
-  Lib3dsQuatKey *pp,*pc,*pn,*pl;
+  Lib3dsQuatKey *k,*pc;
+  Lib3dsDword n,i;
   Lib3dsQuat q;
 
   ASSERT(track);
-  for (pp=0,pc=track->keyL; pc; pp=pc,pc=pc->next) {
+  for (i=0; i<track->keys; ++i) {
+    pc=&track->keyL[i];
     lib3ds_quat_axis_angle(q, pc->axis, pc->angle);
-    if (pp) {
-      lib3ds_quat_mul(pc->q, q, pp->q);
+    if (i) {
+      lib3ds_quat_mul(pc->q, q, pc[-1].q);
     }
     else {
       lib3ds_quat_copy(pc->q, q);
     }
   }
 
-  pc=track->keyL;
-  if (!pc) {
+  k=track->keyL;
+  n=track->keys;
+  if (!n) {
     return;
   }
-  if (!pc->next) {
+  if (n==1) {
+    pc=k;
     lib3ds_quat_copy(pc->ds, pc->q);
     lib3ds_quat_copy(pc->dd, pc->q);
     return;
   }
 
   if (track->flags&LIB3DS_SMOOTH) {
-    for (pl=track->keyL; pl->next->next; pl=pl->next);
-    lib3ds_quat_key_setup(pl, pl->next, pc, 0, pc->next);
- }
+    lib3ds_quat_key_setup(&k[n-2], &k[n-1], &k[0], 0, &k[1]);
+  }
   else {
-    lib3ds_quat_key_setup(0, 0, pc, 0, pc->next);
+    lib3ds_quat_key_setup(0, 0, &k[0], 0, &k[1]);
   }
-  for (;;) {
-    pp=pc;
-    pc=pc->next;
-    pn=pc->next;
-    if (!pn) {
-      break;
-    }
-    lib3ds_quat_key_setup(pp, 0, pc, 0, pn);
+  for (i=1; i<n-1; ++i) {
+    lib3ds_quat_key_setup(&k[i-1], 0, &k[i], 0, &k[i+1]);
   }
 
   if (track->flags&LIB3DS_SMOOTH) {
-    lib3ds_quat_key_setup(pp, 0, pc, track->keyL, track->keyL->next);
+    lib3ds_quat_key_setup(&k[n-2], 0, &k[n-1], &k[0], &k[1]);
   }
   else {
-    lib3ds_quat_key_setup(pp, 0, pc, 0, 0);
+    lib3ds_quat_key_setup(&k[n-2], 0, &k[n-1], 0, 0);
+  }
+  if (track->segL) {
+    quat_track_fill_segments(track);
+  }
+}
+
+
+/*!
+ * Precomputes the dot products squad needs for every segment of the track,
+ * segments of less than about 90 degrees are then evaluated without
+ * trigonometric functions. Call it again after inserting or removing keys.
+ *
+ * \ingroup tracks
+ */
+void
+lib3ds_quat_track_precompute(Lib3dsQuatTrack *track)
+{
+  ASSERT(track);
+  if (track->segL) {
+    free(track->segL);
+    track->segL=0;
+  }
+  if (track->keys<2) {
+    return;
   }
+  track->segL=(Lib3dsQuatSegment*)calloc(sizeof(Lib3dsQuatSegment), track->keys-1);
+  if (!track->segL) {
+    return;
+  }
+  quat_track_fill_segments(track);
 }
 
 
@@ -1050,36 +1337,22 @@ lib3ds_quat_track_setup(Lib3dsQuatTrack *track)
 void
 lib3ds_quat_track_insert(Lib3dsQuatTrack *track, Lib3dsQuatKey *key)
 {
+  Lib3dsDword index;
+  Lib3dsQuatKey *keyL;
+
   ASSERT(track);
   ASSERT(key);
-  ASSERT(!key->next);
-
-  if (!track->keyL) {
-    track->keyL=key;
-    key->next=0;
+  if (track->segL) {
+    free(track->segL);
+    track->segL=0;
   }
-  else {
-    Lib3dsQuatKey *k,*p;
-
-    for (p=0,k=track->keyL; k!=0; p=k, k=k->next) {
-      if (k->tcb.frame>key->tcb.frame) {
-        break;
-      }
-    }
-    if (!p) {
-      key->next=track->keyL;
-      track->keyL=key;
-    }
-    else {
-      key->next=k;
-      p->next=key;
-    }
- 
-    if (k && (key->tcb.frame==k->tcb.frame)) {
-      key->next=k->next;
-      lib3ds_quat_key_free(k);
-    }
+  keyL=(Lib3dsQuatKey*)track_key_insert(track->keyL, &track->keys,
+    sizeof(Lib3dsQuatKey), key->tcb.frame, &index);
+  if (keyL) {
+    track->keyL=keyL;
+    track->keyL[index]=*key;
   }
+  lib3ds_quat_key_free(key);
 }
 
 
@@ -1089,24 +1362,12 @@ lib3ds_quat_track_insert(Lib3dsQuatTrack *track, Lib3dsQuatKey *key)
 void
 lib3ds_quat_track_remove(Lib3dsQuatTrack *track, Lib3dsIntd frame)
 {
-  Lib3dsQuatKey *k,*p;
-  
   ASSERT(track);
-  if (!track->keyL) {
-    return;
-  }
-  for (p=0,k=track->keyL; k!=0; p=k, k=k->next) {
-    if (k->tcb.frame==frame) {
-      if (!p) {
-        track->keyL=track->keyL->next;
-      }
-      else {
-        p->next=k->next;
-      }
-      lib3ds_quat_key_free(k);
-      break;
-    }
+  if (track->segL) {
+    free(track->segL);
+    track->segL=0;
   }
+  track_key_remove(track->keyL, &track->keys, sizeof(Lib3dsQuatKey), frame);
 }
 
 
@@ -1115,52 +1376,49 @@ lib3ds_quat_track_remove(Lib3dsQuatTrack *track, Lib3dsIntd frame)
  */
 void
 lib3ds_quat_track_eval(Lib3dsQuatTrack *track, Lib3dsQuat q, Lib3dsFloat t)
+{
+  lib3ds_quat_track_eval_cursor(track, 0, q, t);
+}
+
+
+/*!
+ * Evaluates the track like lib3ds_quat_track_eval(), cursor remembers the
+ * segment found for t to speed up the next evaluation at a nearby time.
+ *
+ * \ingroup tracks
+ */
+void
+lib3ds_quat_track_eval_cursor(Lib3dsQuatTrack *track, Lib3dsTrackCursor *cursor, Lib3dsQuat q, Lib3dsFloat t)
 {
   Lib3dsQuatKey *k;
-  Lib3dsFloat nt;
   Lib3dsFloat u;
+  int i;
 
-  if (!track->keyL) {
+  if (!track->keys) {
     lib3ds_quat_identity(q);
     return;
   }
-  if (!track->keyL->next || ((t<track->keyL->tcb.frame) && ((track->flags&LIB3DS_REPEAT) != 0))) {
-    lib3ds_quat_copy(q, track->keyL->q);
+  if ((track->keys==1) || ((t<track->keyL[0].tcb.frame) && ((track->flags&LIB3DS_REPEAT) != 0))) {
+    lib3ds_quat_copy(q, track->keyL[0].q);
     return;
   }
 
-  for (k=track->keyL; k->next!=0; k=k->next) {
-    if ((t>=k->tcb.frame) && (t<k->next->tcb.frame)) {
-      break;
-    }
-  }
-  if (!k->next) {
-    if (track->flags&LIB3DS_REPEAT) {
-      nt=(Lib3dsFloat)fmod(t - track->keyL->tcb.frame, k->tcb.frame - track->keyL->tcb.frame) + track->keyL->tcb.frame;
-      for (k=track->keyL; k->next!=0; k=k->next) {
-        if ((nt>=k->tcb.frame) && (nt<k->next->tcb.frame)) {
-          break;
-        }
-      }
-      ASSERT(k->next);
-    }
-    else {
-      lib3ds_quat_copy(q, k->q);
-      return;
-    }
+  if (!track_key_segment(track->keyL, track->keys, sizeof(Lib3dsQuatKey), track->flags, t, cursor, &i, &u)) {
+    lib3ds_quat_copy(q, track->keyL[track->keys-1].q);
+    return;
   }
-  else {
-    nt=t;
+  k=&track->keyL[i];
+  if (track->segL) {
+    lib3ds_quat_squad_fast(q, k[0].q, k[0].dd, k[1].ds, k[1].q, track->segL[i].ab, track->segL[i].pq, u);
+    return;
   }
-  u=nt - k->tcb.frame;
-  u/=(k->next->tcb.frame - k->tcb.frame);
 
   lib3ds_quat_squad(
     q,
-    k->q,
-    k->dd,
-    k->next->ds,
-    k->next->q,
+    k[0].q,
+    k[0].dd,
+    k[1].ds,
+    k[1].q,
     u
   );
 }
@@ -1174,24 +1432,40 @@ lib3ds_quat_track_read(Lib3dsQuatTrack *track, Lib3dsIo *io)
 {
   int keys;
   int i,j;
-  Lib3dsQuatKey *p,*k;
+  Lib3dsQuatKey *keyL,*k;
+  void *merged;
 
   track->flags=lib3ds_io_read_word(io);
   lib3ds_io_read_dword(io);
   lib3ds_io_read_dword(io);
   keys=lib3ds_io_read_intd(io);
+  if (keys<0) {
+    return(LIB3DS_FALSE);
+  }
 
-  for (p=0,i=0; i<keys; p=k,++i) {
-    k=lib3ds_quat_key_new();
+  keyL=(Lib3dsQuatKey*)calloc(sizeof(Lib3dsQuatKey), keys ? keys : 1);
+  if (!keyL) {
+    return(LIB3DS_FALSE);
+  }
+  for (i=0; i<keys; ++i) {
+    k=&keyL[i];
     if (!lib3ds_tcb_read(&k->tcb, io)) {
+      free(keyL);
       return(LIB3DS_FALSE);
     }
     k->angle=lib3ds_io_read_float(io);
     for (j=0; j<3; ++j) {
       k->axis[j]=lib3ds_io_read_float(io);
     }
-    lib3ds_quat_track_insert(track, k);
   }
+  if (track->segL) {
+    free(track->segL);
+    track->segL=0;
+  }
+  if (!track_key_merge(track->keyL, &track->keys, keyL, keys, sizeof(Lib3dsQuatKey), &merged)) {
+    return(LIB3DS_FALSE);
+  }
+  track->keyL=(Lib3dsQuatKey*)merged;
   lib3ds_quat_track_setup(track);
   return(LIB3DS_TRUE);
 }
@@ -1204,16 +1478,12 @@ Lib3dsBool
 lib3ds_quat_track_write(Lib3dsQuatTrack *track, Lib3dsIo *io)
 {
   Lib3dsQuatKey *k;
-  Lib3dsDword num=0;
-  for (k=track->keyL; k; k=k->next) {
-    ++num;
-  }
   lib3ds_io_write_word(io, (Lib3dsWord)track->flags);
   lib3ds_io_write_dword(io, 0);
   lib3ds_io_write_dword(io, 0);
-  lib3ds_io_write_dword(io, num);
+  lib3ds_io_write_dword(io, track->keys);
 
-  for (k=track->keyL; k; k=k->next) {
+  for (k=track->keyL; k<track->keyL+track->keys; ++k) {
     if (!lib3ds_tcb_write(&k->tcb,io)) {
       return(LIB3DS_FALSE);
     }
@@ -1253,13 +1523,12 @@ lib3ds_morph_key_free(Lib3dsMorphKey *key)
 void
 lib3ds_morph_track_free_keys(Lib3dsMorphTrack *track)
 {
-  Lib3dsMorphKey *p,*q;
-
   ASSERT(track);
-  for (p=track->keyL; p; p=q) {
-    q=p->next;
-    lib3ds_morph_key_free(p);
+  if (track->keyL) {
+    free(track->keyL);
   }
+  track->keyL=0;
+  track->keys=0;
 }
 
 
@@ -1269,36 +1538,18 @@ lib3ds_morph_track_free_keys(Lib3dsMorphTrack *track)
 void
 lib3ds_morph_track_insert(Lib3dsMorphTrack *track, Lib3dsMorphKey *key)
 {
+  Lib3dsDword index;
+  Lib3dsMorphKey *keyL;
+
   ASSERT(track);
   ASSERT(key);
-  ASSERT(!key->next);
-
-  if (!track->keyL) {
-    track->keyL=key;
-    key->next=0;
-  }
-  else {
-    Lib3dsMorphKey *k,*p;
-
-    for (p=0,k=track->keyL; k!=0; p=k, k=k->next) {
-      if (k->tcb.frame>key->tcb.frame) {
-        break;
-      }
-    }
-    if (!p) {
-      key->next=track->keyL;
-      track->keyL=key;
-    }
-    else {
-      key->next=k;
-      p->next=key;
-    }
- 
-    if (k && (key->tcb.frame==k->tcb.frame)) {
-      key->next=k->next;
-      lib3ds_morph_key_free(k);
-    }
+  keyL=(Lib3dsMorphKey*)track_key_insert(track->keyL, &track->keys,
+    sizeof(Lib3dsMorphKey), key->tcb.frame, &index);
+  if (keyL) {
+    track->keyL=keyL;
+    track->keyL[index]=*key;
   }
+  lib3ds_morph_key_free(key);
 }
 
 
@@ -1308,24 +1559,8 @@ lib3ds_morph_track_insert(Lib3dsMorphTrack *track, Lib3dsMorphKey *key)
 void
 lib3ds_morph_track_remove(Lib3dsMorphTrack *track, Lib3dsIntd frame)
 {
-  Lib3dsMorphKey *k,*p;
-  
   ASSERT(track);
-  if (!track->keyL) {
-    return;
-  }
-  for (p=0,k=track->keyL; k!=0; p=k, k=k->next) {
-    if (k->tcb.frame==frame) {
-      if (!p) {
-        track->keyL=track->keyL->next;
-      }
-      else {
-        p->next=k->next;
-      }
-      lib3ds_morph_key_free(k);
-      break;
-    }
-  }
+  track_key_remove(track->keyL, &track->keys, sizeof(Lib3dsMorphKey), frame);
 }
 
 
@@ -1335,38 +1570,86 @@ lib3ds_morph_track_remove(Lib3dsMorphTrack *track, Lib3dsIntd frame)
 void
 lib3ds_morph_track_eval(Lib3dsMorphTrack *track, char *p, Lib3dsFloat t)
 {
-  Lib3dsMorphKey *k;
-  char* result;
+  lib3ds_morph_track_eval_cursor(track, 0, p, t);
+}
+
+
+/*!
+ * Evaluates the track like lib3ds_morph_track_eval(), cursor remembers the
+ * key found for t to speed up the next evaluation at a nearby time.
+ *
+ * \ingroup tracks
+ */
+void
+lib3ds_morph_track_eval_cursor(Lib3dsMorphTrack *track, Lib3dsTrackCursor *cursor, char *p,
+  Lib3dsFloat t)
+{
+  int i;
 
   ASSERT(p);
-  if (!track->keyL) {
+  if (!track->keys) {
     strcpy(p,"");
     return;
   }
-  if (!track->keyL->next) {
-    strcpy(p,track->keyL->name);
-    return;
-  }
-
 
-  /* TODO: this function finds the mesh frame that corresponds to this
-   * timeframe.  It would be better to actually interpolate the mesh.
+  /* Finds the mesh frame that corresponds to this timeframe, see
+   * lib3ds_morph_track_eval_blend() for interpolating the meshes.
    */
+  i=track_key_locate(track->keyL, track->keys, sizeof(Lib3dsMorphKey), t, cursor);
+  if (i<0) {
+    i=0;
+  }
+  strcpy(p,track->keyL[i].name);
+}
 
-  result=0;
-
-  for(k = track->keyL;
-      k->next != NULL && t >= k->next->tcb.frame;
-      k = k->next);
 
-  result=k->name;
+/*!
+ * Finds the two morph targets surrounding t.
+ *
+ * The mesh at t is a + (b-a)*u, see lib3ds_mesh_lerp_points(). Outside
+ * the keys of a non repeating track, and for tracks with a single key,
+ * both names are the same and u is 0.
+ *
+ * \param track The morph track.
+ * \param cursor Optional, remembers the key found for t.
+ * \param a Returned name of the first target, 64 bytes.
+ * \param b Returned name of the second target, 64 bytes.
+ * \param u Returned blend factor between 0 and 1.
+ * \param t Time value.
+ *
+ * \return LIB3DS_FALSE if the track has no keys.
+ *
+ * \ingroup tracks
+ */
+Lib3dsBool
+lib3ds_morph_track_eval_blend(Lib3dsMorphTrack *track, Lib3dsTrackCursor *cursor,
+  char *a, char *b, Lib3dsFloat *u, Lib3dsFloat t)
+{
+  int i;
 
-  if (result) {
-    strcpy(p,result);
-  }
-  else {
-    strcpy(p,"");
-  }
+  ASSERT(a && b && u);
+  *u=0.0f;
+  if (!track->keys) {
+    strcpy(a,"");
+    strcpy(b,"");
+    return(LIB3DS_FALSE);
+  }
+  if (track->keys==1) {
+    strcpy(a,track->keyL[0].name);
+    strcpy(b,a);
+    return(LIB3DS_TRUE);
+  }
+  if (!track_key_segment(track->keyL, track->keys, sizeof(Lib3dsMorphKey), track->flags,
+    t, cursor, &i, u)) {
+    i=(t<(Lib3dsFloat)track->keyL[0].tcb.frame) ? 0 : track->keys-1;
+    strcpy(a,track->keyL[i].name);
+    strcpy(b,a);
+    *u=0.0f;
+    return(LIB3DS_TRUE);
+  }
+  strcpy(a,track->keyL[i].name);
+  strcpy(b,track->keyL[i+1].name);
+  return(LIB3DS_TRUE);
 }
 
 
@@ -1377,28 +1660,38 @@ Lib3dsBool
 lib3ds_morph_track_read(Lib3dsMorphTrack *track, Lib3dsIo *io)
 {
   /* This function was written by Stephane Denis on 5-18-04 */
-    int i;
-    Lib3dsMorphKey *k, *pk;
-    int keys;
-    track->flags=lib3ds_io_read_word(io);
-    lib3ds_io_read_dword(io);
-    lib3ds_io_read_dword(io);
-    keys=lib3ds_io_read_intd(io);
-
-    for (i=0; i<keys; ++i) {
-        k=lib3ds_morph_key_new();
-        if (!lib3ds_tcb_read(&k->tcb, io)) {
-            return(LIB3DS_FALSE);
-        }
-        if (!lib3ds_io_read_string(io, k->name, 11)) {
-            return(LIB3DS_FALSE);
-        }
-        if (!track->keyL)
-            track->keyL = k;
-        else
-            pk->next = k;
-        pk = k;
+  int keys;
+  int i;
+  Lib3dsMorphKey *keyL,*k;
+  void *merged;
+
+  track->flags=lib3ds_io_read_word(io);
+  lib3ds_io_read_dword(io);
+  lib3ds_io_read_dword(io);
+  keys=lib3ds_io_read_intd(io);
+  if (keys<0) {
+    return(LIB3DS_FALSE);
+  }
+
+  keyL=(Lib3dsMorphKey*)calloc(sizeof(Lib3dsMorphKey), keys ? keys : 1);
+  if (!keyL) {
+    return(LIB3DS_FALSE);
+  }
+  for (i=0; i<keys; ++i) {
+    k=&keyL[i];
+    if (!lib3ds_tcb_read(&k->tcb, io)) {
+      free(keyL);
+      return(LIB3DS_FALSE);
     }
+    if (!lib3ds_io_read_string(io, k->name, 11)) {
+      free(keyL);
+      return(LIB3DS_FALSE);
+    }
+  }
+  if (!track_key_merge(track->keyL, &track->keys, keyL, keys, sizeof(Lib3dsMorphKey), &merged)) {
+    return(LIB3DS_FALSE);
+  }
+  track->keyL=(Lib3dsMorphKey*)merged;
   return(LIB3DS_TRUE);
 }
 
@@ -1418,7 +1711,7 @@ lib3ds_boolTrack_dump(Lib3dsBoolTrack *track)
 {
   Lib3dsBoolKey *key;
   printf("flags: %08x, keys:\n", track->flags);
-  for( key = track->keyL; key != NULL; key = key->next)
+  for( key = track->keyL; key < track->keyL + track->keys; ++key)
   {
     tcb_dump(&key->tcb);
   }
@@ -1430,7 +1723,7 @@ lib3ds_lin1Track_dump(Lib3dsLin1Track *track)
 {
   Lib3dsLin1Key *key;
   printf("flags: %08x, keys:\n", track->flags);
-  for( key = track->keyL; key != NULL; key = key->next)
+  for( key = track->keyL; key < track->keyL + track->keys; ++key)
   {
     tcb_dump(&key->tcb);
     printf("    value = %g, dd=%g, ds=%g\n",
@@ -1444,7 +1737,7 @@ lib3ds_lin3Track_dump(Lib3dsLin3Track *track)
 {
   Lib3dsLin3Key *key;
   printf("flags: %08x, keys:\n", track->flags);
-  for( key = track->keyL; key != NULL; key = key->next)
+  for( key = track->keyL; key < track->keyL + track->keys; ++key)
   {
     tcb_dump(&key->tcb);
     printf("    value = %g,%g,%g, dd=%g,%g,%g, ds=%g,%g,%g\n",
@@ -1460,7 +1753,7 @@ lib3ds_quatTrack_dump(Lib3dsQuatTrack *track)
 {
   Lib3dsQuatKey *key;
   printf("flags: %08x, keys:\n", track->flags);
-  for( key = track->keyL; key != NULL; key = key->next)
+  for( key = track->keyL; key < track->keyL + track->keys; ++key)
   {
     tcb_dump(&key->tcb);
     printf("    axis = %g,%g,%g, angle=%g, q=%g,%g,%g,%g\n",
@@ -1478,7 +1771,7 @@ lib3ds_morphTrack_dump(Lib3dsMorphTrack *track)
 {
   Lib3dsMorphKey *key;
   printf("flags: %08x, keys:\n", track->flags);
-  for( key = track->keyL; key != NULL; key = key->next)
+  for( key = track->keyL; key < track->keyL + track->keys; ++key)
   {
     tcb_dump(&key->tcb);
     printf("    name = %s\n", key->name);
@@ -46,13 +46,50 @@ typedef enum {
   LIB3DS_UNLINK_Z  =0x0400
 } Lib3dsTrackFlags;
 
+/*
+ * The keys of a track are stored in an array sorted by frame, keys sharing
+ * a frame keep their insertion order. Every key structure starts with its
+ * Lib3dsTcb, the shared search functions of tracks.c rely on that.
+ */
+
+/*
+ * The segments between consecutive keys of scalar, vector and rotation
+ * tracks can be precomputed with lib3ds_*_track_precompute(), segL then
+ * holds keys-1 entries. The setup functions refresh them, inserting or
+ * removing keys drops them.
+ */
+
+/**
+ * Floating-point track segment, value = ((c[3]*u + c[2])*u + c[1])*u + c[0]
+ * \ingroup tracks
+ */
+struct Lib3dsLin1Segment {
+    Lib3dsFloat c[4];
+};
+
+/**
+ * Vector track segment, see Lib3dsLin1Segment
+ * \ingroup tracks
+ */
+struct Lib3dsLin3Segment {
+    Lib3dsVector c[4];
+};
+
+/**
+ * Rotation track segment, dot products of the quaternions slerped by squad
+ * \ingroup tracks
+ */
+struct Lib3dsQuatSegment {
+    Lib3dsFloat ab;
+    Lib3dsFloat pq;
+};
+
 /**
  * Boolean track key
  * \ingroup tracks
  */
 struct Lib3dsBoolKey {
     Lib3dsTcb tcb;
-    Lib3dsBoolKey *next;
 };
 
 /**
@@ -61,6 +98,7 @@ struct Lib3dsBoolKey {
  */
 struct Lib3dsBoolTrack {
     Lib3dsDword flags;
+    Lib3dsDword keys;
     Lib3dsBoolKey *keyL;
 };
 
@@ -70,7 +108,6 @@ struct Lib3dsBoolTrack {
  */
 struct Lib3dsLin1Key {
     Lib3dsTcb tcb;
-    Lib3dsLin1Key *next;
     Lib3dsFloat value;
     Lib3dsFloat dd;
     Lib3dsFloat ds;
@@ -82,7 +119,9 @@ struct Lib3dsLin1Key {
  */
 struct Lib3dsLin1Track {
     Lib3dsDword flags;
+    Lib3dsDword keys;
     Lib3dsLin1Key *keyL;
+    Lib3dsLin1Segment *segL;
 };
 
 /**
@@ -91,7 +130,6 @@ struct Lib3dsLin1Track {
  */
 struct Lib3dsLin3Key {
     Lib3dsTcb tcb;
-    Lib3dsLin3Key *next;  
     Lib3dsVector value;
     Lib3dsVector dd;
     Lib3dsVector ds;
@@ -103,7 +141,9 @@ struct Lib3dsLin3Key {
  */
 struct Lib3dsLin3Track {
     Lib3dsDword flags;
+    Lib3dsDword keys;
     Lib3dsLin3Key *keyL;
+    Lib3dsLin3Segment *segL;
 };
 
 /**
@@ -112,7 +152,6 @@ struct Lib3dsLin3Track {
  */
 struct Lib3dsQuatKey {
     Lib3dsTcb tcb;
-    Lib3dsQuatKey *next;  
     Lib3dsVector axis;
     Lib3dsFloat angle;
     Lib3dsQuat q;
@@ -126,7 +165,9 @@ struct Lib3dsQuatKey {
  */
 struct Lib3dsQuatTrack {
     Lib3dsDword flags;
+    Lib3dsDword keys;
     Lib3dsQuatKey *keyL;
+    Lib3dsQuatSegment *segL;
 };
 
 /**
@@ -135,7 +176,6 @@ struct Lib3dsQuatTrack {
  */
 struct Lib3dsMorphKey {
     Lib3dsTcb tcb;
-    Lib3dsMorphKey *next;  
     char name[64];
 };
   
@@ -145,15 +185,27 @@ struct Lib3dsMorphKey {
  */
 struct Lib3dsMorphTrack {
     Lib3dsDword flags;
+    Lib3dsDword keys;
     Lib3dsMorphKey *keyL;
 };
 
+/**
+ * Position of the last evaluation of a track. Tracks are shared, the cursors
+ * live with whoever evaluates them, a zeroed cursor is valid.
+ * \ingroup tracks
+ */
+struct Lib3dsTrackCursor {
+    Lib3dsIntd index;
+};
+
 extern LIB3DSAPI Lib3dsBoolKey* lib3ds_bool_key_new();
 extern LIB3DSAPI void lib3ds_bool_key_free(Lib3dsBoolKey* key);
 extern LIB3DSAPI void lib3ds_bool_track_free_keys(Lib3dsBoolTrack *track);
 extern LIB3DSAPI void lib3ds_bool_track_insert(Lib3dsBoolTrack *track, Lib3dsBoolKey* key);
 extern LIB3DSAPI void lib3ds_bool_track_remove(Lib3dsBoolTrack *track, Lib3dsIntd frame);
 extern LIB3DSAPI void lib3ds_bool_track_eval(Lib3dsBoolTrack *track, Lib3dsBool *p, Lib3dsFloat t);
+extern LIB3DSAPI void lib3ds_bool_track_eval_cursor(Lib3dsBoolTrack *track, Lib3dsTrackCursor *cursor,
+  Lib3dsBool *p, Lib3dsFloat t);
 extern LIB3DSAPI Lib3dsBool lib3ds_bool_track_read(Lib3dsBoolTrack *track, Lib3dsIo *io);
 extern LIB3DSAPI Lib3dsBool lib3ds_bool_track_write(Lib3dsBoolTrack *track, Lib3dsIo *io);
 
@@ -163,9 +215,12 @@ extern LIB3DSAPI void lib3ds_lin1_track_free_keys(Lib3dsLin1Track *track);
 extern LIB3DSAPI void lib3ds_lin1_key_setup(Lib3dsLin1Key *p, Lib3dsLin1Key *cp, Lib3dsLin1Key *c,
   Lib3dsLin1Key *cn, Lib3dsLin1Key *n);
 extern LIB3DSAPI void lib3ds_lin1_track_setup(Lib3dsLin1Track *track);
+extern LIB3DSAPI void lib3ds_lin1_track_precompute(Lib3dsLin1Track *track);
 extern LIB3DSAPI void lib3ds_lin1_track_insert(Lib3dsLin1Track *track, Lib3dsLin1Key *key);
 extern LIB3DSAPI void lib3ds_lin1_track_remove(Lib3dsLin1Track *track, Lib3dsIntd frame);
 extern LIB3DSAPI void lib3ds_lin1_track_eval(Lib3dsLin1Track *track, Lib3dsFloat *p, Lib3dsFloat t);
+extern LIB3DSAPI void lib3ds_lin1_track_eval_cursor(Lib3dsLin1Track *track, Lib3dsTrackCursor *cursor,
+  Lib3dsFloat *p, Lib3dsFloat t);
 extern LIB3DSAPI Lib3dsBool lib3ds_lin1_track_read(Lib3dsLin1Track *track, Lib3dsIo *io);
 extern LIB3DSAPI Lib3dsBool lib3ds_lin1_track_write(Lib3dsLin1Track *track, Lib3dsIo *io);
 
@@ -175,9 +230,12 @@ extern LIB3DSAPI void lib3ds_lin3_track_free_keys(Lib3dsLin3Track *track);
 extern LIB3DSAPI void lib3ds_lin3_key_setup(Lib3dsLin3Key *p, Lib3dsLin3Key *cp, Lib3dsLin3Key *c,
   Lib3dsLin3Key *cn, Lib3dsLin3Key *n);
 extern LIB3DSAPI void lib3ds_lin3_track_setup(Lib3dsLin3Track *track);
+extern LIB3DSAPI void lib3ds_lin3_track_precompute(Lib3dsLin3Track *track);
 extern LIB3DSAPI void lib3ds_lin3_track_insert(Lib3dsLin3Track *track, Lib3dsLin3Key *key);
 extern LIB3DSAPI void lib3ds_lin3_track_remove(Lib3dsLin3Track *track, Lib3dsIntd frame);
 extern LIB3DSAPI void lib3ds_lin3_track_eval(Lib3dsLin3Track *track, Lib3dsVector p, Lib3dsFloat t);
+extern LIB3DSAPI void lib3ds_lin3_track_eval_cursor(Lib3dsLin3Track *track, Lib3dsTrackCursor *cursor,
+  Lib3dsVector p, Lib3dsFloat t);
 extern LIB3DSAPI Lib3dsBool lib3ds_lin3_track_read(Lib3dsLin3Track *track, Lib3dsIo *io);
 extern LIB3DSAPI Lib3dsBool lib3ds_lin3_track_write(Lib3dsLin3Track *track, Lib3dsIo *io);
 
@@ -187,9 +245,12 @@ extern LIB3DSAPI void lib3ds_quat_track_free_keys(Lib3dsQuatTrack *track);
 extern LIB3DSAPI void lib3ds_quat_key_setup(Lib3dsQuatKey *p, Lib3dsQuatKey *cp, Lib3dsQuatKey *c,
   Lib3dsQuatKey *cn, Lib3dsQuatKey *n);
 extern LIB3DSAPI void lib3ds_quat_track_setup(Lib3dsQuatTrack *track);
+extern LIB3DSAPI void lib3ds_quat_track_precompute(Lib3dsQuatTrack *track);
 extern LIB3DSAPI void lib3ds_quat_track_insert(Lib3dsQuatTrack *track, Lib3dsQuatKey *key);
 extern LIB3DSAPI void lib3ds_quat_track_remove(Lib3dsQuatTrack *track, Lib3dsIntd frame);
 extern LIB3DSAPI void lib3ds_quat_track_eval(Lib3dsQuatTrack *track, Lib3dsQuat p, Lib3dsFloat t);
+extern LIB3DSAPI void lib3ds_quat_track_eval_cursor(Lib3dsQuatTrack *track, Lib3dsTrackCursor *cursor,
+  Lib3dsQuat p, Lib3dsFloat t);
 extern LIB3DSAPI Lib3dsBool lib3ds_quat_track_read(Lib3dsQuatTrack *track, Lib3dsIo *io);
 extern LIB3DSAPI Lib3dsBool lib3ds_quat_track_write(Lib3dsQuatTrack *track, Lib3dsIo *io);
 
@@ -199,6 +260,10 @@ extern LIB3DSAPI void lib3ds_morph_track_free_keys(Lib3dsMorphTrack *track);
 extern LIB3DSAPI void lib3ds_morph_track_insert(Lib3dsMorphTrack *track, Lib3dsMorphKey *key);
 extern LIB3DSAPI void lib3ds_morph_track_remove(Lib3dsMorphTrack *track, Lib3dsIntd frame);
 extern LIB3DSAPI void lib3ds_morph_track_eval(Lib3dsMorphTrack *track, char *p, Lib3dsFloat t);
+extern LIB3DSAPI void lib3ds_morph_track_eval_cursor(Lib3dsMorphTrack *track, Lib3dsTrackCursor *cursor,
+  char *p, Lib3dsFloat t);
+extern LIB3DSAPI Lib3dsBool lib3ds_morph_track_eval_blend(Lib3dsMorphTrack *track, Lib3dsTrackCursor *cursor,
+  char *a, char *b, Lib3dsFloat *u, Lib3dsFloat t);
 extern LIB3DSAPI Lib3dsBool lib3ds_morph_track_read(Lib3dsMorphTrack *track, Lib3dsIo *io);
 
 #ifdef __cplusplus
@@ -114,6 +114,10 @@ typedef struct Lib3dsQuatKey Lib3dsQuatKey;
 typedef struct Lib3dsQuatTrack Lib3dsQuatTrack;
 typedef struct Lib3dsMorphKey Lib3dsMorphKey;
 typedef struct Lib3dsMorphTrack Lib3dsMorphTrack;
+typedef struct Lib3dsTrackCursor Lib3dsTrackCursor;
+typedef struct Lib3dsLin1Segment Lib3dsLin1Segment;
+typedef struct Lib3dsLin3Segment Lib3dsLin3Segment;
+typedef struct Lib3dsQuatSegment Lib3dsQuatSegment;
                
 typedef enum Lib3dsNodeTypes {
   LIB3DS_UNKNOWN_NODE =0,
@@ -0,0 +1,225 @@
+/* -*- c -*- */
+#ifndef INCLUDED_LIB3DS_VECMATH_H
+#define INCLUDED_LIB3DS_VECMATH_H
+/*
+ * The 3D Studio File Format Library
+ * Copyright (C) 1996-2007 by Jan Eric Kyprianidis <www.kyprianidis.com>
+ * All rights reserved.
+ *
+ * This program is  free  software;  you can redistribute it and/or modify it
+ * under the terms of the  GNU Lesser General Public License  as published by
+ * the  Free Software Foundation;  either version 2.1 of the License,  or (at
+ * your option) any later version.
+ *
+ * This  program  is  distributed in  the  hope that it will  be useful,  but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or  FITNESS FOR A  PARTICULAR PURPOSE.  See the  GNU Lesser General Public
+ * License for more details.
+ *
+ * You should  have received  a copy of the GNU Lesser General Public License
+ * along with  this program;  if not, write to the  Free Software Foundation,
+ * Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/*!
+ * \defgroup vecmath Inline Vector Mathematics
+ *
+ * Inline versions of the vector and quaternion functions called in loops,
+ * the compiler can inline and vectorize them. The exported functions of
+ * vector.c and quat.c call them and return the same results.
+ */
+
+#ifndef INCLUDED_LIB3DS_TYPES_H
+#include <lib3ds/types.h>
+#endif
+#include <math.h>
+
+#if defined(_MSC_VER)
+#define LIB3DS_INLINE static __inline
+#elif defined(__GNUC__)
+#define LIB3DS_INLINE static __inline__
+#else
+#define LIB3DS_INLINE static
+#endif
+
+/*! \ingroup vecmath */
+LIB3DS_INLINE void
+lib3ds_vector_zero_inline(Lib3dsVector c)
+{
+  c[0]=c[1]=c[2]=0.0f;
+}
+
+/*! \ingroup vecmath */
+LIB3DS_INLINE void
+lib3ds_vector_copy_inline(Lib3dsVector dest, const Lib3dsVector src)
+{
+  dest[0]=src[0];
+  dest[1]=src[1];
+  dest[2]=src[2];
+}
+
+/*! \ingroup vecmath */
+LIB3DS_INLINE void
+lib3ds_vector_neg_inline(Lib3dsVector c)
+{
+  c[0]=-c[0];
+  c[1]=-c[1];
+  c[2]=-c[2];
+}
+
+/*! \ingroup vecmath */
+LIB3DS_INLINE void
+lib3ds_vector_add_inline(Lib3dsVector c, const Lib3dsVector a, const Lib3dsVector b)
+{
+  c[0]=a[0]+b[0];
+  c[1]=a[1]+b[1];
+  c[2]=a[2]+b[2];
+}
+
+/*! \ingroup vecmath */
+LIB3DS_INLINE void
+lib3ds_vector_sub_inline(Lib3dsVector c, const Lib3dsVector a, const Lib3dsVector b)
+{
+  c[0]=a[0]-b[0];
+  c[1]=a[1]-b[1];
+  c[2]=a[2]-b[2];
+}
+
+/*! \ingroup vecmath */
+LIB3DS_INLINE void
+lib3ds_vector_scalar_inline(Lib3dsVector c, Lib3dsFloat k)
+{
+  c[0]*=k;
+  c[1]*=k;
+  c[2]*=k;
+}
+
+/*! \ingroup vecmath */
+LIB3DS_INLINE void
+lib3ds_vector_cross_inline(Lib3dsVector c, const Lib3dsVector a, const Lib3dsVector b)
+{
+  c[0]=a[1]*b[2] - a[2]*b[1];
+  c[1]=a[2]*b[0] - a[0]*b[2];
+  c[2]=a[0]*b[1] - a[1]*b[0];
+}
+
+/*! \ingroup vecmath */
+LIB3DS_INLINE Lib3dsFloat
+lib3ds_vector_dot_inline(const Lib3dsVector a, const Lib3dsVector b)
+{
+  return(a[0]*b[0] + a[1]*b[1] + a[2]*b[2]);
+}
+
+/*! \ingroup vecmath */
+LIB3DS_INLINE Lib3dsFloat
+lib3ds_vector_squared_inline(const Lib3dsVector c)
+{
+  return(c[0]*c[0] + c[1]*c[1] + c[2]*c[2]);
+}
+
+/*! \ingroup vecmath */
+LIB3DS_INLINE Lib3dsFloat
+lib3ds_vector_length_inline(const Lib3dsVector c)
+{
+  return((Lib3dsFloat)sqrt(c[0]*c[0] + c[1]*c[1] + c[2]*c[2]));
+}
+
+/*!
+ * Vectors shorter than LIB3DS_EPSILON become the unit vector of their
+ * largest component.
+ * \ingroup vecmath
+ */
+LIB3DS_INLINE void
+lib3ds_vector_normalize_inline(Lib3dsVector c)
+{
+  Lib3dsFloat l,m;
+
+  l=(Lib3dsFloat)sqrt(c[0]*c[0] + c[1]*c[1] + c[2]*c[2]);
+  if (fabs(l)<LIB3DS_EPSILON) {
+    if ((c[0]>=c[1]) && (c[0]>=c[2])) {
+      c[0]=1.0f;
+      c[1]=c[2]=0.0f;
+    }
+    else
+    if (c[1]>=c[2]) {
+      c[1]=1.0f;
+      c[0]=c[2]=0.0f;
+    }
+    else {
+      c[2]=1.0f;
+      c[0]=c[1]=0.0f;
+    }
+  }
+  else {
+    m=1.0f/l;
+    c[0]*=m;
+    c[1]*=m;
+    c[2]*=m;
+  }
+}
+
+/*! \ingroup vecmath */
+LIB3DS_INLINE void
+lib3ds_vector_normal_inline(Lib3dsVector n, const Lib3dsVector a, const Lib3dsVector b,
+  const Lib3dsVector c)
+{
+  Lib3dsVector p,q;
+
+  lib3ds_vector_sub_inline(p,c,b);
+  lib3ds_vector_sub_inline(q,a,b);
+  lib3ds_vector_cross_inline(n,p,q);
+  lib3ds_vector_normalize_inline(n);
+}
+
+/*! \ingroup vecmath */
+LIB3DS_INLINE void
+lib3ds_vector_cubic_inline(Lib3dsVector c, const Lib3dsVector a, const Lib3dsVector p,
+  const Lib3dsVector q, const Lib3dsVector b, Lib3dsFloat t)
+{
+  Lib3dsDouble x,y,z,w;
+
+  x=2*t*t*t - 3*t*t + 1;
+  y=-2*t*t*t + 3*t*t;
+  z=t*t*t - 2*t*t + t;
+  w=t*t*t - t*t;
+  c[0]=(Lib3dsFloat)(x*a[0] + y*b[0] + z*p[0] + w*q[0]);
+  c[1]=(Lib3dsFloat)(x*a[1] + y*b[1] + z*p[1] + w*q[1]);
+  c[2]=(Lib3dsFloat)(x*a[2] + y*b[2] + z*p[2] + w*q[2]);
+}
+
+/*! \ingroup vecmath */
+LIB3DS_INLINE void
+lib3ds_vector_min_inline(Lib3dsVector c, const Lib3dsVector a)
+{
+  if (a[0]<c[0]) c[0]=a[0];
+  if (a[1]<c[1]) c[1]=a[1];
+  if (a[2]<c[2]) c[2]=a[2];
+}
+
+/*! \ingroup vecmath */
+LIB3DS_INLINE void
+lib3ds_vector_max_inline(Lib3dsVector c, const Lib3dsVector a)
+{
+  if (a[0]>c[0]) c[0]=a[0];
+  if (a[1]>c[1]) c[1]=a[1];
+  if (a[2]>c[2]) c[2]=a[2];
+}
+
+/*! \ingroup vecmath */
+LIB3DS_INLINE void
+lib3ds_quat_neg_inline(Lib3dsQuat c)
+{
+  c[0]=-c[0];
+  c[1]=-c[1];
+  c[2]=-c[2];
+  c[3]=-c[3];
+}
+
+/*! \ingroup vecmath */
+LIB3DS_INLINE Lib3dsFloat
+lib3ds_quat_dot_inline(const Lib3dsQuat a, const Lib3dsQuat b)
+{
+  return(a[0]*b[0] + a[1]*b[1] + a[2]*b[2] + a[3]*b[3]);
+}
+
+#endif
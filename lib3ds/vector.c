@@ -20,7 +20,10 @@
  * $Id: vector.c,v 1.12 2007/06/20 17:04:09 jeh Exp $
  */
 #include <lib3ds/vector.h>
+#include <lib3ds/simd.h>
+#include <lib3ds/vecmath.h>
 #include <math.h>
+#include <float.h>
 
 
 /*!
@@ -44,10 +47,7 @@
 void
 lib3ds_vector_zero(Lib3dsVector c)
 {
-  int i;
-  for (i=0; i<3; ++i) {
-    c[i]=0.0f;
-  }
+  lib3ds_vector_zero_inline(c);
 }
 
 
@@ -62,10 +62,7 @@ lib3ds_vector_zero(Lib3dsVector c)
 void
 lib3ds_vector_copy(Lib3dsVector dest, Lib3dsVector src)
 {
-  int i;
-  for (i=0; i<3; ++i) {
-    dest[i]=src[i];
-  }
+  lib3ds_vector_copy_inline(dest, src);
 }
 
 
@@ -79,10 +76,7 @@ lib3ds_vector_copy(Lib3dsVector dest, Lib3dsVector src)
 void
 lib3ds_vector_neg(Lib3dsVector c)
 {
-  int i;
-  for (i=0; i<3; ++i) {
-    c[i]=-c[i];
-  }
+  lib3ds_vector_neg_inline(c);
 }
 
 
@@ -98,10 +92,7 @@ lib3ds_vector_neg(Lib3dsVector c)
 void
 lib3ds_vector_add(Lib3dsVector c, Lib3dsVector a, Lib3dsVector b)
 {
-  int i;
-  for (i=0; i<3; ++i) {
-    c[i]=a[i]+b[i];
-  }
+  lib3ds_vector_add_inline(c, a, b);
 }
 
 
@@ -117,10 +108,7 @@ lib3ds_vector_add(Lib3dsVector c, Lib3dsVector a, Lib3dsVector b)
 void
 lib3ds_vector_sub(Lib3dsVector c, Lib3dsVector a, Lib3dsVector b)
 {
-  int i;
-  for (i=0; i<3; ++i) {
-    c[i]=a[i]-b[i];
-  }
+  lib3ds_vector_sub_inline(c, a, b);
 }
 
 
@@ -135,10 +123,7 @@ lib3ds_vector_sub(Lib3dsVector c, Lib3dsVector a, Lib3dsVector b)
 void
 lib3ds_vector_scalar(Lib3dsVector c, Lib3dsFloat k)
 {
-  int i;
-  for (i=0; i<3; ++i) {
-    c[i]*=k;
-  }
+  lib3ds_vector_scalar_inline(c, k);
 }
 
 
@@ -154,9 +139,7 @@ lib3ds_vector_scalar(Lib3dsVector c, Lib3dsFloat k)
 void
 lib3ds_vector_cross(Lib3dsVector c, Lib3dsVector a, Lib3dsVector b)
 {
-  c[0]=a[1]*b[2] - a[2]*b[1];
-  c[1]=a[2]*b[0] - a[0]*b[2];
-  c[2]=a[0]*b[1] - a[1]*b[0];
+  lib3ds_vector_cross_inline(c, a, b);
 }
 
 
@@ -173,7 +156,7 @@ lib3ds_vector_cross(Lib3dsVector c, Lib3dsVector a, Lib3dsVector b)
 Lib3dsFloat
 lib3ds_vector_dot(Lib3dsVector a, Lib3dsVector b)
 {
-  return(a[0]*b[0] + a[1]*b[1] + a[2]*b[2]);
+  return(lib3ds_vector_dot_inline(a, b));
 }
 
 
@@ -191,7 +174,7 @@ lib3ds_vector_dot(Lib3dsVector a, Lib3dsVector b)
 Lib3dsFloat
 lib3ds_vector_squared(Lib3dsVector c)
 {
-  return(c[0]*c[0] + c[1]*c[1] + c[2]*c[2]);
+  return(lib3ds_vector_squared_inline(c));
 }
 
 
@@ -209,7 +192,7 @@ lib3ds_vector_squared(Lib3dsVector c)
 Lib3dsFloat
 lib3ds_vector_length(Lib3dsVector c)
 {
-  return((Lib3dsFloat)sqrt(c[0]*c[0] + c[1]*c[1] + c[2]*c[2]));
+  return(lib3ds_vector_length_inline(c));
 }
 
 
@@ -225,30 +208,7 @@ lib3ds_vector_length(Lib3dsVector c)
 void
 lib3ds_vector_normalize(Lib3dsVector c)
 {
-  Lib3dsFloat l,m;
-
-  l=(Lib3dsFloat)sqrt(c[0]*c[0] + c[1]*c[1] + c[2]*c[2]);
-  if (fabs(l)<LIB3DS_EPSILON) {
-    if ((c[0]>=c[1]) && (c[0]>=c[2])) {
-      c[0]=1.0f;
-      c[1]=c[2]=0.0f;
-    }
-    else
-    if (c[1]>=c[2]) {
-      c[1]=1.0f;
-      c[0]=c[2]=0.0f;
-    }
-    else {
-      c[2]=1.0f;
-      c[0]=c[1]=0.0f;
-    }
-  }
-  else {
-    m=1.0f/l;
-    c[0]*=m;
-    c[1]*=m;
-    c[2]*=m;
-  }
+  lib3ds_vector_normalize_inline(c);
 }
 
 
@@ -267,12 +227,7 @@ lib3ds_vector_normalize(Lib3dsVector c)
 void
 lib3ds_vector_normal(Lib3dsVector n, Lib3dsVector a, Lib3dsVector b, Lib3dsVector c)
 {
-  Lib3dsVector p,q;
-
-  lib3ds_vector_sub(p,c,b);
-  lib3ds_vector_sub(q,a,b);
-  lib3ds_vector_cross(n,p,q);
-  lib3ds_vector_normalize(n);
+  lib3ds_vector_normal_inline(n, a, b, c);
 }
 
 
@@ -291,9 +246,146 @@ lib3ds_vector_normal(Lib3dsVector n, Lib3dsVector a, Lib3dsVector b, Lib3dsVecto
 void
 lib3ds_vector_transform(Lib3dsVector c, Lib3dsMatrix m, Lib3dsVector a)
 {
-  c[0]= m[0][0]*a[0] + m[1][0]*a[1] + m[2][0]*a[2] + m[3][0];
-  c[1]= m[0][1]*a[0] + m[1][1]*a[1] + m[2][1]*a[2] + m[3][1];
-  c[2]= m[0][2]*a[0] + m[1][2]*a[1] + m[2][2]*a[2] + m[3][2];
+  lib3ds_simd_vector_transform(c, m, a);
+}
+
+
+#define VECTOR_BLOCK 4096
+#define VECTOR_POINT(p, stride, i) ((Lib3dsFloat*)((char*)(p) + (size_t)(i)*(stride)))
+
+
+/*!
+ * Transform an array of points by a matrix.
+ *
+ * The points are three floats each, stride bytes apart, so that the
+ * positions can be read out of arrays of larger structures like
+ * Lib3dsPoint. out may be in if the strides are the same. The results are
+ * the same as those of lib3ds_vector_transform(). Arrays of at least
+ * LIB3DS_VECTOR_PARALLEL_MIN points are split among OpenMP threads.
+ *
+ * \param out Transformed points.
+ * \param out_stride Distance of the output points in bytes.
+ * \param m Transformation matrix.
+ * \param in Source points.
+ * \param in_stride Distance of the source points in bytes.
+ * \param count Number of points.
+ *
+ * \ingroup vector
+ */
+void
+lib3ds_vector_transform_array(Lib3dsFloat *out, size_t out_stride, Lib3dsMatrix m,
+  const Lib3dsFloat *in, size_t in_stride, Lib3dsDword count)
+{
+  int blocks=(int)((count+VECTOR_BLOCK-1)/VECTOR_BLOCK);
+  int b;
+
+#ifdef _OPENMP
+  #pragma omp parallel for if(count>=LIB3DS_VECTOR_PARALLEL_MIN)
+#endif
+  for (b=0; b<blocks; ++b) {
+    Lib3dsDword first=(Lib3dsDword)b*VECTOR_BLOCK;
+    Lib3dsDword n=(count-first<VECTOR_BLOCK) ? count-first : VECTOR_BLOCK;
+    lib3ds_simd_transform_array(VECTOR_POINT(out, out_stride, first), out_stride, m,
+      VECTOR_POINT(in, in_stride, first), in_stride, n);
+  }
+}
+
+
+/*!
+ * Grow a bounding box by an array of points transformed by a matrix.
+ *
+ * Same as transforming each point with lib3ds_vector_transform() and
+ * passing it to lib3ds_vector_min() and lib3ds_vector_max(), see
+ * lib3ds_vector_transform_array() for the layout of the points.
+ *
+ * \param m Transformation matrix.
+ * \param in Source points.
+ * \param in_stride Distance of the source points in bytes.
+ * \param count Number of points.
+ * \param bmin Bounding box minimum, updated.
+ * \param bmax Bounding box maximum, updated.
+ *
+ * \ingroup vector
+ */
+void
+lib3ds_vector_transform_bounds(Lib3dsMatrix m, const Lib3dsFloat *in, size_t in_stride,
+  Lib3dsDword count, Lib3dsVector bmin, Lib3dsVector bmax)
+{
+  int blocks=(int)((count+VECTOR_BLOCK-1)/VECTOR_BLOCK);
+
+#ifdef _OPENMP
+  #pragma omp parallel if(count>=LIB3DS_VECTOR_PARALLEL_MIN)
+#endif
+  {
+    Lib3dsVector lo={FLT_MAX, FLT_MAX, FLT_MAX};
+    Lib3dsVector hi={-FLT_MAX, -FLT_MAX, -FLT_MAX};
+    int b;
+
+#ifdef _OPENMP
+    #pragma omp for
+#endif
+    for (b=0; b<blocks; ++b) {
+      Lib3dsDword first=(Lib3dsDword)b*VECTOR_BLOCK;
+      Lib3dsDword n=(count-first<VECTOR_BLOCK) ? count-first : VECTOR_BLOCK;
+      lib3ds_simd_transform_bounds(m, VECTOR_POINT(in, in_stride, first), in_stride, n, lo, hi);
+    }
+#ifdef _OPENMP
+    #pragma omp critical
+#endif
+    {
+      lib3ds_vector_min(bmin, lo);
+      lib3ds_vector_max(bmax, hi);
+    }
+  }
+}
+
+
+/*!
+ * Transform an array of normals by the inverse transpose of the upper 3x3
+ * part of a matrix and normalize them.
+ *
+ * See lib3ds_vector_transform_array() for the layout of the normals.
+ *
+ * \param out Transformed normals.
+ * \param out_stride Distance of the output normals in bytes.
+ * \param m Transformation matrix of the points.
+ * \param in Source normals.
+ * \param in_stride Distance of the source normals in bytes.
+ * \param count Number of normals.
+ *
+ * \ingroup vector
+ */
+void
+lib3ds_vector_transform_normals(Lib3dsFloat *out, size_t out_stride, Lib3dsMatrix m,
+  const Lib3dsFloat *in, size_t in_stride, Lib3dsDword count)
+{
+  Lib3dsMatrix N;
+  Lib3dsFloat det;
+  Lib3dsDword i;
+  int j,k;
+
+  /* inverse transpose = cofactor matrix / determinant */
+  for (j=0; j<3; ++j) {
+    for (k=0; k<3; ++k) {
+      N[j][k]=m[(j+1)%3][(k+1)%3]*m[(j+2)%3][(k+2)%3] - m[(j+1)%3][(k+2)%3]*m[(j+2)%3][(k+1)%3];
+    }
+    N[j][3]=0.0f;
+    N[3][j]=0.0f;
+  }
+  N[3][3]=1.0f;
+  det=m[0][0]*N[0][0] + m[0][1]*N[0][1] + m[0][2]*N[0][2];
+  if (det<0.0f) {
+    for (j=0; j<3; ++j) {
+      for (k=0; k<3; ++k) {
+        N[j][k]=-N[j][k];
+      }
+    }
+  }
+
+  lib3ds_vector_transform_array(out, out_stride, N, in, in_stride, count);
+  for (i=0; i<count; ++i) {
+    lib3ds_vector_normalize(VECTOR_POINT(out, out_stride, i));
+  }
 }
 
 
@@ -315,15 +407,7 @@ void
 lib3ds_vector_cubic(Lib3dsVector c, Lib3dsVector a, Lib3dsVector p, Lib3dsVector q,
   Lib3dsVector b, Lib3dsFloat t)
 {
-  Lib3dsDouble x,y,z,w;   
-
-  x=2*t*t*t - 3*t*t + 1;
-  y=-2*t*t*t + 3*t*t;
-  z=t*t*t - 2*t*t + t;
-  w=t*t*t - t*t;
-  c[0]=(Lib3dsFloat)(x*a[0] + y*b[0] + z*p[0] + w*q[0]);
-  c[1]=(Lib3dsFloat)(x*a[1] + y*b[1] + z*p[1] + w*q[1]);
-  c[2]=(Lib3dsFloat)(x*a[2] + y*b[2] + z*p[2] + w*q[2]);
+  lib3ds_vector_cubic_inline(c, a, p, q, b, t);
 }
 
 
@@ -337,12 +421,7 @@ lib3ds_vector_cubic(Lib3dsVector c, Lib3dsVector a, Lib3dsVector p, Lib3dsVector
 void 
 lib3ds_vector_min(Lib3dsVector c, Lib3dsVector a)
 {
-  int i;
-  for (i=0; i<3; ++i) {
-    if (a[i]<c[i]) {
-      c[i] = a[i];
-    }
-  }
+  lib3ds_vector_min_inline(c, a);
 }
 
 
@@ -356,12 +435,7 @@ lib3ds_vector_min(Lib3dsVector c, Lib3dsVector a)
 void 
 lib3ds_vector_max(Lib3dsVector c, Lib3dsVector a)
 {
-  int i;
-  for (i=0; i<3; ++i) {
-    if (a[i]>c[i]) {
-      c[i] = a[i];
-    }
-  }
+  lib3ds_vector_max_inline(c, a);
 }
 
 
@@ -27,6 +27,15 @@
 #include <lib3ds/types.h>
 #endif
 
+#include <stddef.h>
+
+/*!
+ * Point arrays at least this long are transformed by several OpenMP
+ * threads.
+ * \ingroup vector
+ */
+#define LIB3DS_VECTOR_PARALLEL_MIN 65536
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -45,6 +54,12 @@ extern LIB3DSAPI void lib3ds_vector_normalize(Lib3dsVector c);
 extern LIB3DSAPI void lib3ds_vector_normal(Lib3dsVector n, Lib3dsVector a,
   Lib3dsVector b, Lib3dsVector c);
 extern LIB3DSAPI void lib3ds_vector_transform(Lib3dsVector c, Lib3dsMatrix m, Lib3dsVector a);
+extern LIB3DSAPI void lib3ds_vector_transform_array(Lib3dsFloat *out, size_t out_stride, Lib3dsMatrix m,
+  const Lib3dsFloat *in, size_t in_stride, Lib3dsDword count);
+extern LIB3DSAPI void lib3ds_vector_transform_bounds(Lib3dsMatrix m, const Lib3dsFloat *in, size_t in_stride,
+  Lib3dsDword count, Lib3dsVector bmin, Lib3dsVector bmax);
+extern LIB3DSAPI void lib3ds_vector_transform_normals(Lib3dsFloat *out, size_t out_stride, Lib3dsMatrix m,
+  const Lib3dsFloat *in, size_t in_stride, Lib3dsDword count);
 extern LIB3DSAPI void lib3ds_vector_cubic(Lib3dsVector c, Lib3dsVector a, Lib3dsVector p,
   Lib3dsVector q, Lib3dsVector b, Lib3dsFloat t);
 extern LIB3DSAPI void lib3ds_vector_min(Lib3dsVector c, Lib3dsVector a);
@@ -19,6 +19,14 @@ DEFINES += LIB3DS_QT_LIBRARY
 # deprecated API in order to know how to port your code away from it.
 DEFINES += QT_DEPRECATED_WARNINGS
 
+# OpenMP for lib3ds_node_table_eval_parallel(), runs serially without it
+win32-msvc* {
+    QMAKE_CFLAGS += -openmp
+} else {
+    QMAKE_CFLAGS += -fopenmp
+    QMAKE_LFLAGS += -fopenmp
+}
+
 # You can also make your code fail to compile if you use deprecated APIs.
 # In order to do so, uncomment the following line.
 # You can also select to disable deprecated APIs only up to a certain version of Qt.
@@ -26,8 +34,12 @@ DEFINES += QT_DEPRECATED_WARNINGS
 
 SOURCES += \
     model.cpp \
+    meshclusters.cpp \
+    meshbvh.cpp \
+    gpuarena.cpp \
     lib3ds/atmosphere.c \
     lib3ds/background.c \
+    lib3ds/bake.c \
     lib3ds/camera.c \
     lib3ds/chunk.c \
     lib3ds/ease.c \
@@ -38,8 +50,11 @@ SOURCES += \
     lib3ds/matrix.c \
     lib3ds/mesh.c \
     lib3ds/node.c \
+    lib3ds/nodetable.c \
+    lib3ds/pose.c \
     lib3ds/quat.c \
     lib3ds/shadow.c \
+    lib3ds/simd.c \
     lib3ds/tcb.c \
     lib3ds/tracks.c \
     lib3ds/vector.c \
@@ -47,8 +62,12 @@ SOURCES += \
 
 HEADERS += lib3ds_qt_global.h \
     model.h \
+    meshclusters.h \
+    meshbvh.h \
+    gpuarena.h \
     lib3ds/atmosphere.h \
     lib3ds/background.h \
+    lib3ds/bake.h \
     lib3ds/camera.h \
     lib3ds/chunk.h \
     lib3ds/chunktable.h \
@@ -61,11 +80,15 @@ HEADERS += lib3ds_qt_global.h \
     lib3ds/matrix.h \
     lib3ds/mesh.h \
     lib3ds/node.h \
+    lib3ds/nodetable.h \
+    lib3ds/pose.h \
     lib3ds/quat.h \
     lib3ds/shadow.h \
+    lib3ds/simd.h \
     lib3ds/tcb.h \
     lib3ds/tracks.h \
     lib3ds/types.h \
+    lib3ds/vecmath.h \
     lib3ds/vector.h \
     lib3ds/viewport.h \
     gl_check_macro.h
@@ -0,0 +1,568 @@
+/**
+\file meshbvh.cpp
+\brief The cpp file of meshbvh.h
+*/
+
+#include "meshbvh.h"
+
+#include <qmath.h>
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+using namespace lib3ds_qt;
+
+static const int kBinCount = 12;
+static const int kMaxLeafTriangles = 4;
+static const int kMaxDepth = 60; // the traversal stacks below hold 64 entries
+static const float kMiss = 1e30f;
+
+namespace {
+
+struct Bounds
+{
+    QVector3D min, max;
+
+    Bounds() : min(kMiss, kMiss, kMiss), max(-kMiss, -kMiss, -kMiss) {}
+
+    void grow(const QVector3D &point)
+    {
+        for (int k = 0; k < 3; ++k) {
+            min[k] = qMin(min[k], point[k]);
+            max[k] = qMax(max[k], point[k]);
+        }
+    }
+
+    void grow(const Bounds &other)
+    {
+        grow(other.min);
+        grow(other.max);
+    }
+
+    // half of the surface area, the factor cancels out in the cost ratios
+    float area() const
+    {
+        if (min[0] > max[0])
+            return 0;
+        QVector3D extent = max - min;
+        return extent[0] * extent[1] + extent[1] * extent[2] + extent[2] * extent[0];
+    }
+};
+
+struct Ray
+{
+    QVector3D origin;
+    QVector3D direction;
+    QVector3D inverseDirection;
+#ifdef __SSE__
+    __m128 origin4;
+    __m128 inverseDirection4;
+#endif
+
+    Ray(const QVector3D &o, const QVector3D &d)
+        : origin(o), direction(d)
+    {
+        for (int k = 0; k < 3; ++k)
+            inverseDirection[k] = 1.0f / d[k];
+#ifdef __SSE__
+        origin4 = _mm_setr_ps(o[0], o[1], o[2], 0);
+        inverseDirection4 = _mm_setr_ps(inverseDirection[0], inverseDirection[1], inverseDirection[2], 0);
+#endif
+    }
+};
+
+struct StackEntry
+{
+    int node;
+    float distance; /**< Ray entry distance or squared distance to the query point */
+};
+
+inline StackEntry stackEntry(int node, float distance)
+{
+    StackEntry entry;
+    entry.node = node;
+    entry.distance = distance;
+    return entry;
+}
+
+} // namespace
+
+// entry distance of the ray into the box of node, kMiss if it misses or enters beyond maxDistance
+static inline float intersectBox(const BvhNode &node, const Ray &ray, float maxDistance)
+{
+#ifdef __SSE__
+    // the fourth lanes hold leftFirst and triangleCount, they are never read back
+    __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.boundsMin), ray.origin4), ray.inverseDirection4);
+    __m128 t2 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.boundsMax), ray.origin4), ray.inverseDirection4);
+    __m128 near4 = _mm_min_ps(t1, t2);
+    __m128 far4 = _mm_max_ps(t1, t2);
+    __m128 nearXY = _mm_max_ss(near4, _mm_shuffle_ps(near4, near4, _MM_SHUFFLE(3, 3, 2, 1)));
+    __m128 farXY = _mm_min_ss(far4, _mm_shuffle_ps(far4, far4, _MM_SHUFFLE(3, 3, 2, 1)));
+    float tNear = _mm_cvtss_f32(_mm_max_ss(nearXY, _mm_movehl_ps(near4, near4)));
+    float tFar = _mm_cvtss_f32(_mm_min_ss(farXY, _mm_movehl_ps(far4, far4)));
+#else
+    float tNear = -kMiss;
+    float tFar = kMiss;
+    for (int k = 0; k < 3; ++k) {
+        float t1 = (node.boundsMin[k] - ray.origin[k]) * ray.inverseDirection[k];
+        float t2 = (node.boundsMax[k] - ray.origin[k]) * ray.inverseDirection[k];
+        tNear = qMax(tNear, qMin(t1, t2));
+        tFar = qMin(tFar, qMax(t1, t2));
+    }
+#endif
+    if (tFar < tNear || tFar < 0 || tNear > maxDistance)
+        return kMiss;
+    return tNear;
+}
+
+// Moller-Trumbore, both faces are hit
+static inline float intersectTriangle(const BvhTriangle &triangle, const Ray &ray)
+{
+    QVector3D edge1 = triangle.b - triangle.a;
+    QVector3D edge2 = triangle.c - triangle.a;
+    QVector3D p = QVector3D::crossProduct(ray.direction, edge2);
+    float det = QVector3D::dotProduct(edge1, p);
+    if (det == 0)
+        return kMiss;
+    float inverseDet = 1.0f / det;
+    QVector3D s = ray.origin - triangle.a;
+    float u = QVector3D::dotProduct(s, p) * inverseDet;
+    if (u < 0 || u > 1)
+        return kMiss;
+    QVector3D q = QVector3D::crossProduct(s, edge1);
+    float v = QVector3D::dotProduct(ray.direction, q) * inverseDet;
+    if (v < 0 || u + v > 1)
+        return kMiss;
+    float t = QVector3D::dotProduct(edge2, q) * inverseDet;
+    return t >= 0 ? t : kMiss;
+}
+
+static float squaredDistanceToBox(const BvhNode &node, const QVector3D &point)
+{
+    float result = 0;
+    for (int k = 0; k < 3; ++k) {
+        float d = qMax(qMax(node.boundsMin[k] - point[k], 0.0f), point[k] - node.boundsMax[k]);
+        result += d * d;
+    }
+    return result;
+}
+
+// Ericson, Real-Time Collision Detection, 5.1.5
+static QVector3D closestPointOnTriangle(const QVector3D &p, const BvhTriangle &triangle)
+{
+    const QVector3D &a = triangle.a;
+    const QVector3D &b = triangle.b;
+    const QVector3D &c = triangle.c;
+    QVector3D ab = b - a;
+    QVector3D ac = c - a;
+
+    QVector3D ap = p - a;
+    float d1 = QVector3D::dotProduct(ab, ap);
+    float d2 = QVector3D::dotProduct(ac, ap);
+    if (d1 <= 0 && d2 <= 0)
+        return a;
+
+    QVector3D bp = p - b;
+    float d3 = QVector3D::dotProduct(ab, bp);
+    float d4 = QVector3D::dotProduct(ac, bp);
+    if (d3 >= 0 && d4 <= d3)
+        return b;
+
+    float vc = d1 * d4 - d3 * d2;
+    if (vc <= 0 && d1 >= 0 && d3 <= 0)
+        return a + ab * (d1 / (d1 - d3));
+
+    QVector3D cp = p - c;
+    float d5 = QVector3D::dotProduct(ab, cp);
+    float d6 = QVector3D::dotProduct(ac, cp);
+    if (d6 >= 0 && d5 <= d6)
+        return c;
+
+    float vb = d5 * d2 - d1 * d6;
+    if (vb <= 0 && d2 >= 0 && d6 <= 0)
+        return a + ac * (d2 / (d2 - d6));
+
+    float va = d3 * d6 - d5 * d4;
+    if (va <= 0 && d4 - d3 >= 0 && d5 - d6 >= 0)
+        return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+
+    float denominator = 1.0f / (va + vb + vc);
+    return a + ab * (vb * denominator) + ac * (vc * denominator);
+}
+
+static QVector3D triangleNormal(const BvhTriangle &triangle)
+{
+    return QVector3D::crossProduct(triangle.b - triangle.a, triangle.c - triangle.a).normalized();
+}
+
+// smallest singular value of the linear part of transform: no distance shrinks by more than it.
+// Square root of the smallest eigenvalue of M^T M, Smith's closed form for symmetric 3x3 matrices.
+static float minimumScale(const QMatrix4x4 &transform)
+{
+    const float *m = transform.constData(); // column-major
+    double a[3][3];
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j)
+            a[i][j] = double(m[4 * i]) * m[4 * j] + double(m[4 * i + 1]) * m[4 * j + 1] + double(m[4 * i + 2]) * m[4 * j + 2];
+    }
+    double smallest;
+    const double offDiagonal = a[0][1] * a[0][1] + a[0][2] * a[0][2] + a[1][2] * a[1][2];
+    if (offDiagonal == 0) {
+        smallest = qMin(a[0][0], qMin(a[1][1], a[2][2]));
+    } else {
+        const double q = (a[0][0] + a[1][1] + a[2][2]) / 3;
+        const double p = qSqrt(((a[0][0] - q) * (a[0][0] - q) + (a[1][1] - q) * (a[1][1] - q)
+                                + (a[2][2] - q) * (a[2][2] - q) + 2 * offDiagonal) / 6);
+        double b[3][3];
+        for (int i = 0; i < 3; ++i) {
+            for (int j = 0; j < 3; ++j)
+                b[i][j] = (a[i][j] - (i == j ? q : 0)) / p;
+        }
+        double r = (b[0][0] * (b[1][1] * b[2][2] - b[1][2] * b[2][1])
+                    - b[0][1] * (b[1][0] * b[2][2] - b[1][2] * b[2][0])
+                    + b[0][2] * (b[1][0] * b[2][1] - b[1][1] * b[2][0])) / 2;
+        r = qBound(-1.0, r, 1.0);
+        smallest = q + 2 * p * qCos(qAcos(r) / 3 + 2 * M_PI / 3);
+    }
+    // rounding may overestimate a little, which would prune boxes at the edge of the query
+    return float(qSqrt(qMax(smallest, 0.0)) * 0.999);
+}
+
+static BvhTriangle transformedTriangle(const BvhTriangle &triangle, const QMatrix4x4 &transform)
+{
+    BvhTriangle result;
+    result.a = transform.map(triangle.a);
+    result.b = transform.map(triangle.b);
+    result.c = transform.map(triangle.c);
+    result.index = triangle.index;
+    return result;
+}
+
+void MeshBvh::build(const QVector<GLfloat> &vertices, const QVector<GLuint> &indices)
+{
+    clear();
+    const int count = indices.size() / 3;
+    if (count == 0)
+        return;
+
+    _triangles.resize(count);
+    QVector<QVector3D> centroids(count);
+    for (int t = 0; t < count; ++t)
+    {
+        BvhTriangle &triangle = _triangles[t];
+        QVector3D *corners[3] = { &triangle.a, &triangle.b, &triangle.c };
+        for (int i = 0; i < 3; ++i) {
+            int vertex = indices[3 * t + i];
+            *corners[i] = QVector3D(vertices[3 * vertex], vertices[3 * vertex + 1], vertices[3 * vertex + 2]);
+        }
+        triangle.index = t;
+        centroids[t] = (triangle.a + triangle.b + triangle.c) / 3;
+    }
+
+    // a binary tree with a triangle per leaf has 2n - 1 nodes: references stay valid while building
+    _nodes.reserve(2 * count - 1);
+    BvhNode root;
+    root.leftFirst = 0;
+    root.triangleCount = count;
+    _nodes << root;
+    updateBounds(_nodes[0]);
+    subdivide(0, centroids, 0);
+    _nodes.squeeze();
+}
+
+void MeshBvh::clear()
+{
+    _nodes.clear();
+    _triangles.clear();
+}
+
+bool MeshBvh::isEmpty() const
+{
+    return _nodes.isEmpty();
+}
+
+void MeshBvh::translate(const QVector3D &offset)
+{
+    for (int i = 0; i < _nodes.size(); ++i) {
+        for (int k = 0; k < 3; ++k) {
+            _nodes[i].boundsMin[k] += offset[k];
+            _nodes[i].boundsMax[k] += offset[k];
+        }
+    }
+    for (int i = 0; i < _triangles.size(); ++i) {
+        _triangles[i].a += offset;
+        _triangles[i].b += offset;
+        _triangles[i].c += offset;
+    }
+}
+
+void MeshBvh::updateBounds(BvhNode &node) const
+{
+    Bounds bounds;
+    for (int t = node.leftFirst; t < node.leftFirst + node.triangleCount; ++t) {
+        bounds.grow(_triangles[t].a);
+        bounds.grow(_triangles[t].b);
+        bounds.grow(_triangles[t].c);
+    }
+    for (int k = 0; k < 3; ++k) {
+        node.boundsMin[k] = bounds.min[k];
+        node.boundsMax[k] = bounds.max[k];
+    }
+}
+
+void MeshBvh::subdivide(int nodeIndex, QVector<QVector3D> &centroids, int depth)
+{
+    BvhNode &node = _nodes[nodeIndex];
+    const int first = node.leftFirst;
+    const int count = node.triangleCount;
+    if (count <= 1 || depth >= kMaxDepth)
+        return;
+
+    Bounds centroidBounds;
+    for (int t = first; t < first + count; ++t)
+        centroidBounds.grow(centroids[t]);
+
+    // binned SAH: cost of a split is leftCount * leftArea + rightCount * rightArea
+    float bestCost = kMiss;
+    int bestAxis = -1;
+    int bestSplit = 0;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        float extent = centroidBounds.max[axis] - centroidBounds.min[axis];
+        if (extent <= 0)
+            continue;
+        float scale = kBinCount / extent;
+
+        Bounds bins[kBinCount];
+        int binCounts[kBinCount] = { 0 };
+        for (int t = first; t < first + count; ++t) {
+            int bin = qMin(kBinCount - 1, int((centroids[t][axis] - centroidBounds.min[axis]) * scale));
+            bins[bin].grow(_triangles[t].a);
+            bins[bin].grow(_triangles[t].b);
+            bins[bin].grow(_triangles[t].c);
+            ++binCounts[bin];
+        }
+
+        float leftCosts[kBinCount];
+        Bounds sweep;
+        int sweepCount = 0;
+        for (int split = 1; split < kBinCount; ++split) {
+            sweep.grow(bins[split - 1]);
+            sweepCount += binCounts[split - 1];
+            leftCosts[split] = sweepCount ? sweepCount * sweep.area() : -1;
+        }
+        sweep = Bounds();
+        sweepCount = 0;
+        for (int split = kBinCount - 1; split > 0; --split) {
+            sweep.grow(bins[split]);
+            sweepCount += binCounts[split];
+            if (sweepCount == 0 || leftCosts[split] < 0)
+                continue;
+            float cost = leftCosts[split] + sweepCount * sweep.area();
+            if (cost < bestCost) {
+                bestCost = cost;
+                bestAxis = axis;
+                bestSplit = split;
+            }
+        }
+    }
+    if (bestAxis < 0)
+        return; // all centroids coincide
+
+    // a node traversal costs about as much as a triangle test
+    Bounds nodeBounds;
+    nodeBounds.grow(QVector3D(node.boundsMin[0], node.boundsMin[1], node.boundsMin[2]));
+    nodeBounds.grow(QVector3D(node.boundsMax[0], node.boundsMax[1], node.boundsMax[2]));
+    float nodeArea = nodeBounds.area();
+    float splitCost = 1 + (nodeArea > 0 ? bestCost / nodeArea : count);
+    if (count <= kMaxLeafTriangles && splitCost >= count)
+        return;
+
+    float scale = kBinCount / (centroidBounds.max[bestAxis] - centroidBounds.min[bestAxis]);
+    int i = first;
+    int j = first + count - 1;
+    while (i <= j) {
+        int bin = qMin(kBinCount - 1, int((centroids[i][bestAxis] - centroidBounds.min[bestAxis]) * scale));
+        if (bin < bestSplit) {
+            ++i;
+        } else {
+            qSwap(_triangles[i], _triangles[j]);
+            qSwap(centroids[i], centroids[j]);
+            --j;
+        }
+    }
+    int leftCount = i - first;
+    if (leftCount == 0 || leftCount == count)
+        return;
+
+    int left = _nodes.size();
+    BvhNode child;
+    child.leftFirst = first;
+    child.triangleCount = leftCount;
+    _nodes << child;
+    child.leftFirst = i;
+    child.triangleCount = count - leftCount;
+    _nodes << child;
+    updateBounds(_nodes[left]);
+    updateBounds(_nodes[left + 1]);
+
+    node.leftFirst = left;
+    node.triangleCount = 0;
+    subdivide(left, centroids, depth + 1);
+    subdivide(left + 1, centroids, depth + 1);
+}
+
+bool MeshBvh::raycast(const QVector3D &origin, const QVector3D &direction, float maxDistance, SurfaceHit &hit) const
+{
+    if (_nodes.isEmpty())
+        return false;
+    Ray ray(origin, direction);
+    float best = maxDistance;
+    int bestTriangle = -1;
+
+    StackEntry stack[64];
+    int stackSize = 0;
+    float rootDistance = intersectBox(_nodes[0], ray, best);
+    if (rootDistance == kMiss)
+        return false;
+    stack[stackSize++] = stackEntry(0, rootDistance);
+
+    while (stackSize > 0)
+    {
+        StackEntry entry = stack[--stackSize];
+        if (entry.distance > best)
+            continue;
+        const BvhNode *node = &_nodes[entry.node];
+        while (node->triangleCount == 0)
+        {
+            int left = node->leftFirst;
+            float leftDistance = intersectBox(_nodes[left], ray, best);
+            float rightDistance = intersectBox(_nodes[left + 1], ray, best);
+            int nearChild = left;
+            if (rightDistance < leftDistance) {
+                qSwap(leftDistance, rightDistance);
+                nearChild = left + 1;
+            }
+            if (leftDistance == kMiss) {
+                node = 0;
+                break;
+            }
+            if (rightDistance != kMiss)
+                stack[stackSize++] = stackEntry(nearChild == left ? left + 1 : left, rightDistance);
+            node = &_nodes[nearChild];
+        }
+        if (!node)
+            continue;
+
+        for (int t = node->leftFirst; t < node->leftFirst + node->triangleCount; ++t) {
+            float distance = intersectTriangle(_triangles[t], ray);
+            if (distance != kMiss && distance <= best) {
+                best = distance;
+                bestTriangle = t;
+            }
+        }
+    }
+
+    if (bestTriangle < 0)
+        return false;
+    const BvhTriangle &triangle = _triangles[bestTriangle];
+    hit.distance = best;
+    hit.triangle = triangle.index;
+    hit.point = origin + direction * best;
+    hit.normal = triangleNormal(triangle);
+    return true;
+}
+
+bool MeshBvh::intersectsSphere(const QVector3D &center, float radius, const QMatrix4x4 &transform) const
+{
+    if (_nodes.isEmpty())
+        return false;
+    const bool isTransformed = !transform.isIdentity();
+    const QVector3D localCenter = isTransformed ? transform.inverted().map(center) : center;
+    const float scale = isTransformed ? minimumScale(transform) : 1.0f;
+    const float scaleSquared = scale * scale;
+    const float radiusSquared = radius * radius;
+
+    int stack[64];
+    int stackSize = 0;
+    stack[stackSize++] = 0;
+    while (stackSize > 0)
+    {
+        const BvhNode &node = _nodes[stack[--stackSize]];
+        if (squaredDistanceToBox(node, localCenter) * scaleSquared > radiusSquared)
+            continue;
+        if (node.triangleCount == 0) {
+            stack[stackSize++] = node.leftFirst;
+            stack[stackSize++] = node.leftFirst + 1;
+            continue;
+        }
+        for (int t = node.leftFirst; t < node.leftFirst + node.triangleCount; ++t) {
+            const BvhTriangle triangle = isTransformed ? transformedTriangle(_triangles[t], transform) : _triangles[t];
+            if ((closestPointOnTriangle(center, triangle) - center).lengthSquared() <= radiusSquared)
+                return true;
+        }
+    }
+    return false;
+}
+
+bool MeshBvh::closestPoint(const QVector3D &point, float maxDistance, SurfaceHit &hit, const QMatrix4x4 &transform) const
+{
+    if (_nodes.isEmpty())
+        return false;
+    const bool isTransformed = !transform.isIdentity();
+    const QMatrix4x4 inverse = isTransformed ? transform.inverted() : QMatrix4x4();
+    const QVector3D localPoint = isTransformed ? inverse.map(point) : point;
+    const float scale = isTransformed ? minimumScale(transform) : 1.0f;
+    const float scaleSquared = scale * scale;
+    float best = maxDistance * maxDistance;
+    int bestTriangle = -1;
+    QVector3D bestPoint;
+
+    // the boxes are in mesh coordinates, scaleSquared turns their distances into lower bounds of the
+    // distances in the query coordinates. The triangles are compared in the query coordinates.
+    StackEntry stack[64];
+    int stackSize = 0;
+    stack[stackSize++] = stackEntry(0, squaredDistanceToBox(_nodes[0], localPoint));
+    while (stackSize > 0)
+    {
+        StackEntry entry = stack[--stackSize];
+        if (entry.distance * scaleSquared > best)
+            continue;
+        const BvhNode &node = _nodes[entry.node];
+        if (node.triangleCount == 0) {
+            // push the farther child first so that the nearer one shrinks 'best' before it's popped
+            int left = node.leftFirst;
+            float leftDistance = squaredDistanceToBox(_nodes[left], localPoint);
+            float rightDistance = squaredDistanceToBox(_nodes[left + 1], localPoint);
+            if (leftDistance < rightDistance) {
+                stack[stackSize++] = stackEntry(left + 1, rightDistance);
+                stack[stackSize++] = stackEntry(left, leftDistance);
+            } else {
+                stack[stackSize++] = stackEntry(left, leftDistance);
+                stack[stackSize++] = stackEntry(left + 1, rightDistance);
+            }
+            continue;
+        }
+        for (int t = node.leftFirst; t < node.leftFirst + node.triangleCount; ++t) {
+            const BvhTriangle triangle = isTransformed ? transformedTriangle(_triangles[t], transform) : _triangles[t];
+            QVector3D candidate = closestPointOnTriangle(point, triangle);
+            float distance = (candidate - point).lengthSquared();
+            if (distance <= best) {
+                best = distance;
+                bestTriangle = t;
+                bestPoint = candidate;
+            }
+        }
+    }
+
+    if (bestTriangle < 0)
+        return false;
+    hit.distance = qSqrt(best);
+    hit.triangle = _triangles[bestTriangle].index;
+    hit.point = bestPoint;
+    hit.normal = triangleNormal(_triangles[bestTriangle]);
+    if (isTransformed)
+        hit.normal = inverse.transposed().mapVector(hit.normal).normalized();
+    return true;
+}
@@ -0,0 +1,79 @@
+#ifndef MESHBVH_H
+#define MESHBVH_H
+
+/**
+\file meshbvh.h
+\brief Bounding volume hierarchy over the triangles of a mesh
+
+The hierarchy answers ray, sphere and closest point queries in time
+logarithmic in the triangle count. It keeps its own copy of the triangles,
+so it stays valid when the vertex arrays of the mesh are packed or released.
+*/
+
+#include "lib3ds_qt_global.h"
+
+#include <GL/gl.h>
+
+#include <QVector>
+#include <QVector3D>
+#include <QMatrix4x4>
+
+namespace lib3ds_qt {
+
+/// 32 bytes node of the flattened hierarchy, the children of an inner node are stored side by side
+struct BvhNode
+{
+    float boundsMin[3];
+    qint32 leftFirst; /**< First child for inner nodes, first triangle for leaves */
+    float boundsMax[3];
+    qint32 triangleCount; /**< 0 for inner nodes */
+};
+
+struct BvhTriangle
+{
+    QVector3D a, b, c;
+    int index; /**< Position of the triangle in the index array of the mesh, i.e. firstIndex / 3 */
+};
+
+/// Result of the ray and closest point queries
+struct SurfaceHit
+{
+    float distance; /**< Ray parameter, or distance to the query point */
+    int mesh; /**< Index of the mesh in the model, -1 if nothing was hit */
+    int triangle; /**< See BvhTriangle::index */
+    QVector3D point;
+    QVector3D normal; /**< Unit geometric normal, oriented by the winding of the triangle */
+
+    SurfaceHit() : distance(0), mesh(-1), triangle(-1) {}
+};
+
+class LIB3DS_QTSHARED_EXPORT MeshBvh
+{
+public:
+    /// Builds the hierarchy with the surface area heuristic. Vertices are packed as x, y, z triples.
+    void build(const QVector<GLfloat> &vertices, const QVector<GLuint> &indices);
+    void clear();
+    bool isEmpty() const;
+    /// Moves the whole hierarchy, used when the model is recentered
+    void translate(const QVector3D &offset);
+
+    /// Nearest hit with a ray parameter in [0, maxDistance], the direction needn't be normalized
+    bool raycast(const QVector3D &origin, const QVector3D &direction, float maxDistance, SurfaceHit &hit) const;
+    /// True if a triangle placed by transform is at most radius away from center.
+    /// The query is in the coordinates transform maps the mesh into, it may scale non-uniformly.
+    bool intersectsSphere(const QVector3D &center, float radius, const QMatrix4x4 &transform = QMatrix4x4()) const;
+    /// Closest point of the triangles placed by transform which is nearer than maxDistance, in the same coordinates
+    bool closestPoint(const QVector3D &point, float maxDistance, SurfaceHit &hit,
+                      const QMatrix4x4 &transform = QMatrix4x4()) const;
+
+private:
+    void subdivide(int nodeIndex, QVector<QVector3D> &centroids, int depth);
+    void updateBounds(BvhNode &node) const;
+
+    QVector<BvhNode> _nodes; /**< The root is _nodes[0] */
+    QVector<BvhTriangle> _triangles; /**< Leaves reference contiguous ranges of this array */
+};
+
+} // namespace lib3ds_qt
+
+#endif // MESHBVH_H
@@ -0,0 +1,304 @@
+/**
+\file meshclusters.cpp
+\brief The cpp file of meshclusters.h
+*/
+
+#include "meshclusters.h"
+
+#include <qmath.h>
+
+#include <algorithm>
+
+using namespace lib3ds_qt;
+
+static const int kMinClusterTriangles = 64;
+static const int kMaxClusterTriangles = 128;
+
+// spreads the lower 10 bits of v so that there are two zero bits between each of them
+static quint32 expandBits(quint32 v)
+{
+    v = (v * 0x00010001u) & 0xFF0000FFu;
+    v = (v * 0x00000101u) & 0x0F00F00Fu;
+    v = (v * 0x00000011u) & 0xC30C30C3u;
+    v = (v * 0x00000005u) & 0x49249249u;
+    return v;
+}
+
+static int highestBit(quint32 v)
+{
+    int bit = -1;
+    while (v) {
+        v >>= 1;
+        ++bit;
+    }
+    return bit;
+}
+
+static QVector3D vertexAt(const QVector<GLfloat> &vertices, int index)
+{
+    return QVector3D(vertices[3 * index], vertices[3 * index + 1], vertices[3 * index + 2]);
+}
+
+static void computeClusterBounds(const QVector<GLfloat> &vertices, const GLuint *indices,
+                                 MeshCluster &cluster)
+{
+    QVector3D minValue = vertexAt(vertices, indices[0]);
+    QVector3D maxValue = minValue;
+    QVector3D normalSum;
+    QVector<QVector3D> normals;
+    normals.reserve(cluster.indexCount / 3);
+
+    for (int i = 0; i < cluster.indexCount; i += 3)
+    {
+        QVector3D a = vertexAt(vertices, indices[i]);
+        QVector3D b = vertexAt(vertices, indices[i + 1]);
+        QVector3D c = vertexAt(vertices, indices[i + 2]);
+        for (int k = 0; k < 3; ++k) {
+            minValue[k] = qMin(minValue[k], qMin(a[k], qMin(b[k], c[k])));
+            maxValue[k] = qMax(maxValue[k], qMax(a[k], qMax(b[k], c[k])));
+        }
+
+        QVector3D normal = QVector3D::crossProduct(b - a, c - a);
+        if (normal.lengthSquared() > 0) {
+            normal.normalize();
+            normals << normal;
+            normalSum += normal;
+        }
+    }
+
+    cluster.center = (minValue + maxValue) / 2;
+    float radiusSquared = 0;
+    for (int i = 0; i < cluster.indexCount; ++i)
+        radiusSquared = qMax(radiusSquared, (vertexAt(vertices, indices[i]) - cluster.center).lengthSquared());
+    cluster.radius = qSqrt(radiusSquared);
+
+    // a cone wider than a hemisphere can't be backface culled
+    cluster.coneCutoff = 2;
+    if (normals.isEmpty() || normalSum.lengthSquared() == 0)
+        return;
+    cluster.coneAxis = normalSum.normalized();
+    float minDot = 1;
+    foreach (const QVector3D &normal, normals)
+        minDot = qMin(minDot, QVector3D::dotProduct(normal, cluster.coneAxis));
+    if (minDot > 0)
+        cluster.coneCutoff = qSqrt(qMax(0.0f, 1 - minDot * minDot));
+}
+
+quint32 lib3ds_qt::mortonCode(const QVector3D &point, const QVector3D &minValue, const QVector3D &maxValue)
+{
+    QVector3D extent = maxValue - minValue;
+    quint32 code = 0;
+    for (int k = 0; k < 3; ++k) {
+        float relative = extent[k] > 0 ? (point[k] - minValue[k]) / extent[k] : 0;
+        quint32 cell = quint32(qBound(0.0f, relative * 1023.0f, 1023.0f));
+        code |= expandBits(cell) << (2 - k);
+    }
+    return code;
+}
+
+void lib3ds_qt::buildMeshClusters(const QVector<GLfloat> &vertices, QVector<GLuint> &indices,
+                                  int firstIndex, int indexCount, QVector<MeshCluster> &clusters)
+{
+    Q_ASSERT(indexCount % 3 == 0);
+    Q_ASSERT(firstIndex + indexCount <= indices.size());
+    const int triangles = indexCount / 3;
+    if (triangles == 0)
+        return;
+
+    // order the triangles along a Morton curve through their centroids
+    QVector<QVector3D> centroids(triangles);
+    QVector3D minValue(+1e30f, +1e30f, +1e30f), maxValue(-1e30f, -1e30f, -1e30f);
+    for (int t = 0; t < triangles; ++t)
+    {
+        const GLuint *triangle = indices.constData() + firstIndex + 3 * t;
+        QVector3D centroid = (vertexAt(vertices, triangle[0])
+                + vertexAt(vertices, triangle[1])
+                + vertexAt(vertices, triangle[2])) / 3;
+        centroids[t] = centroid;
+        for (int k = 0; k < 3; ++k) {
+            minValue[k] = qMin(minValue[k], centroid[k]);
+            maxValue[k] = qMax(maxValue[k], centroid[k]);
+        }
+    }
+
+    QVector<QPair<quint32, int> > order(triangles);
+    for (int t = 0; t < triangles; ++t)
+        order[t] = qMakePair(mortonCode(centroids[t], minValue, maxValue), t);
+    std::sort(order.begin(), order.end());
+
+    QVector<GLuint> sorted(indexCount);
+    for (int t = 0; t < triangles; ++t)
+    {
+        const GLuint *triangle = indices.constData() + firstIndex + 3 * order[t].second;
+        sorted[3 * t + 0] = triangle[0];
+        sorted[3 * t + 1] = triangle[1];
+        sorted[3 * t + 2] = triangle[2];
+    }
+    std::copy(sorted.begin(), sorted.end(), indices.begin() + firstIndex);
+
+    // cut the curve at the biggest octree cell boundary within the allowed cluster sizes
+    int start = 0;
+    while (start < triangles)
+    {
+        int end = triangles;
+        if (triangles - start > kMaxClusterTriangles) {
+            int bestBit = -2;
+            for (int t = start + kMinClusterTriangles; t <= start + kMaxClusterTriangles; ++t) {
+                int bit = highestBit(order[t - 1].first ^ order[t].first);
+                if (bit >= bestBit) {
+                    bestBit = bit;
+                    end = t;
+                }
+            }
+        }
+
+        MeshCluster cluster;
+        cluster.firstIndex = firstIndex + 3 * start;
+        cluster.indexCount = 3 * (end - start);
+        computeClusterBounds(vertices, indices.constData() + cluster.firstIndex, cluster);
+        clusters << cluster;
+        start = end;
+    }
+}
+
+ViewFrustum::ViewFrustum()
+    : _hasEye(false)
+{
+    for (int i = 0; i < 6; ++i) {
+        _planes[i][0] = _planes[i][1] = _planes[i][2] = 0;
+        _planes[i][3] = 1;
+    }
+}
+
+ViewFrustum ViewFrustum::fromCurrentMatrices()
+{
+    GLfloat projection[16];
+    GLfloat modelview[16];
+    GL_CHECK( glGetFloatv(GL_PROJECTION_MATRIX, projection));
+    GL_CHECK( glGetFloatv(GL_MODELVIEW_MATRIX, modelview));
+    return fromMatrices(projection, modelview);
+}
+
+ViewFrustum ViewFrustum::fromMatrices(const GLfloat projection[16], const GLfloat modelview[16])
+{
+    ViewFrustum frustum;
+
+    GLfloat clip[16];
+    for (int column = 0; column < 4; ++column) {
+        for (int row = 0; row < 4; ++row) {
+            GLfloat value = 0;
+            for (int k = 0; k < 4; ++k)
+                value += projection[k * 4 + row] * modelview[column * 4 + k];
+            clip[column * 4 + row] = value;
+        }
+    }
+
+    // Gribb-Hartmann: the planes are sums and differences of the rows of the clip matrix
+    for (int axis = 0; axis < 3; ++axis) {
+        for (int side = 0; side < 2; ++side) {
+            GLfloat *plane = frustum._planes[2 * axis + side];
+            GLfloat sign = side == 0 ? 1 : -1;
+            for (int column = 0; column < 4; ++column)
+                plane[column] = clip[column * 4 + 3] + sign * clip[column * 4 + axis];
+            GLfloat length = qSqrt(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+            if (length > 0) {
+                for (int column = 0; column < 4; ++column)
+                    plane[column] /= length;
+            }
+        }
+    }
+
+    // the eye is the preimage of the origin: eye = -A^-1 * t for modelview = [A|t]
+    frustum._hasEye = false;
+    if (projection[11] != 0) {
+        const GLfloat *m = modelview;
+        GLfloat c00 = m[5] * m[10] - m[9] * m[6];
+        GLfloat c01 = m[9] * m[2] - m[1] * m[10];
+        GLfloat c02 = m[1] * m[6] - m[5] * m[2];
+        GLfloat det = m[0] * c00 + m[4] * c01 + m[8] * c02;
+        if (qAbs(det) > 1e-12f) {
+            GLfloat c10 = m[8] * m[6] - m[4] * m[10];
+            GLfloat c11 = m[0] * m[10] - m[8] * m[2];
+            GLfloat c12 = m[4] * m[2] - m[0] * m[6];
+            GLfloat c20 = m[4] * m[9] - m[8] * m[5];
+            GLfloat c21 = m[8] * m[1] - m[0] * m[9];
+            GLfloat c22 = m[0] * m[5] - m[4] * m[1];
+            const GLfloat *t = m + 12;
+            frustum._eye = QVector3D(c00 * t[0] + c10 * t[1] + c20 * t[2],
+                                     c01 * t[0] + c11 * t[1] + c21 * t[2],
+                                     c02 * t[0] + c12 * t[1] + c22 * t[2]) / -det;
+            frustum._hasEye = true;
+        }
+    }
+    return frustum;
+}
+
+// rotations combined with a uniform positive scale, which preserve the angles of the normal cones
+static bool isSimilarity(const QMatrix4x4 &transform)
+{
+    QVector3D x = transform.mapVector(QVector3D(1, 0, 0));
+    QVector3D y = transform.mapVector(QVector3D(0, 1, 0));
+    QVector3D z = transform.mapVector(QVector3D(0, 0, 1));
+    float scale = x.lengthSquared();
+    float tolerance = 1e-3f * scale;
+    return qAbs(y.lengthSquared() - scale) <= tolerance && qAbs(z.lengthSquared() - scale) <= tolerance
+            && qAbs(QVector3D::dotProduct(x, y)) <= tolerance && qAbs(QVector3D::dotProduct(y, z)) <= tolerance
+            && qAbs(QVector3D::dotProduct(z, x)) <= tolerance
+            && QVector3D::dotProduct(QVector3D::crossProduct(x, y), z) > 0;
+}
+
+ViewFrustum ViewFrustum::transformed(const QMatrix4x4 &transform) const
+{
+    ViewFrustum frustum;
+
+    // the mesh point x is inside the plane p if p . (M x) >= 0: the plane is p^T M in mesh coordinates
+    for (int i = 0; i < 6; ++i) {
+        GLfloat *plane = frustum._planes[i];
+        for (int column = 0; column < 4; ++column) {
+            plane[column] = 0;
+            for (int row = 0; row < 4; ++row)
+                plane[column] += _planes[i][row] * transform(row, column);
+        }
+        GLfloat length = qSqrt(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+        if (length > 0) {
+            for (int column = 0; column < 4; ++column)
+                plane[column] /= length;
+        }
+    }
+
+    frustum._hasEye = false;
+    if (_hasEye && isSimilarity(transform)) {
+        bool isInvertible = false;
+        QMatrix4x4 inverse = transform.inverted(&isInvertible);
+        if (isInvertible) {
+            frustum._eye = inverse.map(_eye);
+            frustum._hasEye = true;
+        }
+    }
+    return frustum;
+}
+
+bool ViewFrustum::isSphereVisible(const QVector3D &center, float radius) const
+{
+    for (int i = 0; i < 6; ++i) {
+        const GLfloat *plane = _planes[i];
+        if (plane[0] * center.x() + plane[1] * center.y() + plane[2] * center.z() + plane[3] < -radius)
+            return false;
+    }
+    return true;
+}
+
+bool ViewFrustum::isClusterVisible(const MeshCluster &cluster) const
+{
+    if (!isSphereVisible(cluster.center, cluster.radius))
+        return false;
+    if (!_hasEye || cluster.coneCutoff > 1)
+        return true;
+
+    // all normals are within asin(coneCutoff) of the axis: the cluster is back facing
+    // if every point of the bounding sphere sees the axis pointing away from the eye
+    QVector3D view = cluster.center - _eye;
+    float distance = view.length();
+    return QVector3D::dotProduct(view, cluster.coneAxis)
+            < cluster.coneCutoff * distance + cluster.radius * (1 + cluster.coneCutoff);
+}
@@ -0,0 +1,72 @@
+#ifndef MESHCLUSTERS_H
+#define MESHCLUSTERS_H
+
+/**
+\file meshclusters.h
+\brief Partitioning of meshes into small triangle clusters
+
+Large meshes are split into clusters of 64-128 spatially close triangles,
+so that parts of a mesh outside the view or facing away from the viewer
+can be skipped before the draw calls are issued.
+*/
+
+#include "lib3ds_qt_global.h"
+
+#include <GL/gl.h>
+
+#include <QVector>
+#include <QVector3D>
+#include <QMatrix4x4>
+
+namespace lib3ds_qt {
+
+/// A group of spatially close triangles stored contiguously in the index array of a mesh
+struct MeshCluster
+{
+    int firstIndex; /**< Offset of the first index of the cluster */
+    int indexCount; /**< Number of indices of the cluster, 3 per triangle */
+    QVector3D center; /**< Center of the bounding sphere */
+    float radius; /**< Radius of the bounding sphere */
+    QVector3D coneAxis; /**< Average normal of the triangles */
+    float coneCutoff; /**< Sine of the normal cone half-angle, greater than 1 if the cone can't be culled */
+
+    MeshCluster() : firstIndex(0), indexCount(0), radius(0), coneCutoff(2) {}
+};
+
+/// The view volume of the current GL matrices, expressed in model coordinates
+class LIB3DS_QTSHARED_EXPORT ViewFrustum
+{
+public:
+    ViewFrustum();
+
+    /// Reads GL_PROJECTION_MATRIX and GL_MODELVIEW_MATRIX of the current context
+    static ViewFrustum fromCurrentMatrices();
+    /// Builds the frustum from column-major projection and modelview matrices
+    static ViewFrustum fromMatrices(const GLfloat projection[16], const GLfloat modelview[16]);
+    /// The same volume in the coordinates of a mesh placed by transform
+    ViewFrustum transformed(const QMatrix4x4 &transform) const;
+
+    bool isSphereVisible(const QVector3D &center, float radius) const;
+    /// Returns false if the cluster is outside the frustum or all of its triangles face away from the viewer
+    bool isClusterVisible(const MeshCluster &cluster) const;
+
+private:
+    GLfloat _planes[6][4]; /**< Normalized plane equations, inside is positive */
+    QVector3D _eye; /**< Viewer position in model coordinates */
+    bool _hasEye; /**< False for orthographic projections, normal cone culling is disabled then */
+};
+
+/// Reorders the triangles of indices [firstIndex, firstIndex + indexCount) into clusters
+/// and appends the clusters to 'clusters'. Vertices are packed as x, y, z triples.
+LIB3DS_QTSHARED_EXPORT void buildMeshClusters(const QVector<GLfloat> &vertices,
+                                              QVector<GLuint> &indices,
+                                              int firstIndex, int indexCount,
+                                              QVector<MeshCluster> &clusters);
+
+/// 30-bit Morton code of point, quantized to a 1024^3 grid over the given bounds
+LIB3DS_QTSHARED_EXPORT quint32 mortonCode(const QVector3D &point,
+                                          const QVector3D &minValue, const QVector3D &maxValue);
+
+} // namespace lib3ds_qt
+
+#endif // MESHCLUSTERS_H
@@ -29,11 +29,23 @@ This is the place were all the functions are 'defined'
 
 #include <QImage>
 #include <QGLWidget>
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+#include <QOpenGLShaderProgram>
+#include <QOpenGLVertexArrayObject>
 #include <qmath.h>
 
 #include <QDebug>
 #include <QDir>
 
+#include <string.h>
+
+#include <algorithm>
+
+#ifndef GL_HALF_FLOAT
+#define GL_HALF_FLOAT 0x140B
+#endif
+
 using namespace lib3ds_qt;
 
 static void do_light_adjust(QImage *image, int factor)
@@ -103,17 +115,678 @@ static GLuint generateTextureStatic(const QString &name, int lightFactor)
     return result;
 }
 
+// GL_HALF_FLOAT vertex data is core since OpenGL 3.0
+static bool isHalfFloatVertexSupported()
+{
+    const char *version = reinterpret_cast<const char *>(glGetString(GL_VERSION));
+    if (version && version[0] >= '3' && version[0] <= '9')
+        return true;
+    const char *extensions = reinterpret_cast<const char *>(glGetString(GL_EXTENSIONS));
+    return extensions && strstr(extensions, "GL_ARB_half_float_vertex");
+}
+
+typedef void (QOPENGLF_APIENTRYP DrawElementsInstancedFunction)(GLenum mode, GLsizei count, GLenum type,
+                                                                const GLvoid *indices, GLsizei instanceCount);
+typedef void (QOPENGLF_APIENTRYP VertexAttribDivisorFunction)(GLuint index, GLuint divisor);
+
+// the instance matrix takes the attributes 4 to 7, which the fixed-function arrays enabled by
+// renderModel() don't alias on any driver
+static const GLuint kInstanceMatrixLocation = 4;
+// visible instances below which a draw per instance, with its clusters culled, is used
+static const int kMinInstancedDraw = 4;
+
+// the unlit GL_REPLACE texturing of renderModel(), with the placement of the instance read from an attribute
+static const char kInstanceVertexShader[] =
+        "#version 120\n"
+        "attribute mat4 instanceMatrix;\n"
+        "uniform mat4 meshMatrix;\n"
+        "varying vec2 texCoord;\n"
+        "void main()\n"
+        "{\n"
+        "    texCoord = gl_MultiTexCoord0.st;\n"
+        "    gl_FrontColor = gl_Color;\n"
+        "    gl_Position = gl_ModelViewProjectionMatrix * (instanceMatrix * (meshMatrix * gl_Vertex));\n"
+        "}\n";
+
+static const char kInstanceFragmentShader[] =
+        "#version 120\n"
+        "uniform sampler2D colorMap;\n"
+        "uniform bool isTextured;\n"
+        "varying vec2 texCoord;\n"
+        "void main()\n"
+        "{\n"
+        "    gl_FragColor = isTextured ? texture2D(colorMap, texCoord) : gl_Color;\n"
+        "}\n";
+
+namespace lib3ds_qt {
+
+struct InstancingState
+{
+    bool isSupported; /**< False if the context can't draw instanced, meshes are then drawn once per instance */
+    QOpenGLShaderProgram program;
+    int meshMatrixLocation;
+    int isTexturedLocation;
+    GLuint buffer; /**< Matrices of the visible instances, rewritten for each instanced draw */
+    QVector<GLfloat> matrices; /**< Scratch buffer of the visible instance matrices */
+    DrawElementsInstancedFunction drawElementsInstanced;
+    VertexAttribDivisorFunction vertexAttribDivisor;
+
+    InstancingState() : isSupported(false), meshMatrixLocation(-1), isTexturedLocation(-1), buffer(0),
+        drawElementsInstanced(0), vertexAttribDivisor(0) {}
+};
+
+} // namespace lib3ds_qt
+
+// instanced arrays are core since OpenGL 3.3, GL_ARB_instanced_arrays before
+static InstancingState *createInstancingState()
+{
+    InstancingState *state = new InstancingState;
+    QOpenGLContext *context = QOpenGLContext::currentContext();
+    if (!context)
+        return state;
+    if (context->format().version() >= qMakePair(3, 3)) {
+        state->drawElementsInstanced = reinterpret_cast<DrawElementsInstancedFunction>(
+                    context->getProcAddress("glDrawElementsInstanced"));
+        state->vertexAttribDivisor = reinterpret_cast<VertexAttribDivisorFunction>(
+                    context->getProcAddress("glVertexAttribDivisor"));
+    } else if (context->hasExtension("GL_ARB_instanced_arrays") && context->hasExtension("GL_ARB_draw_instanced")) {
+        state->drawElementsInstanced = reinterpret_cast<DrawElementsInstancedFunction>(
+                    context->getProcAddress("glDrawElementsInstancedARB"));
+        state->vertexAttribDivisor = reinterpret_cast<VertexAttribDivisorFunction>(
+                    context->getProcAddress("glVertexAttribDivisorARB"));
+    }
+    if (!state->drawElementsInstanced || !state->vertexAttribDivisor)
+        return state;
+
+    state->program.addShaderFromSourceCode(QOpenGLShader::Vertex, kInstanceVertexShader);
+    state->program.addShaderFromSourceCode(QOpenGLShader::Fragment, kInstanceFragmentShader);
+    state->program.bindAttributeLocation("instanceMatrix", kInstanceMatrixLocation);
+    if (!state->program.link()) {
+        qDebug() << "instanced drawing disabled:" << state->program.log();
+        return state;
+    }
+    state->meshMatrixLocation = state->program.uniformLocation("meshMatrix");
+    state->isTexturedLocation = state->program.uniformLocation("isTextured");
+    GL_CHECK( context->functions()->glGenBuffers(1, &state->buffer));
+    state->isSupported = true;
+    return state;
+}
+
+// IEEE 754 binary16, rounded to nearest even
+static quint16 toHalfFloat(float value)
+{
+    quint32 bits;
+    memcpy(&bits, &value, sizeof(bits));
+    quint32 sign = (bits >> 16) & 0x8000;
+    int exponent = int((bits >> 23) & 0xFF) - 127 + 15;
+    quint32 mantissa = bits & 0x7FFFFF;
+
+    if (exponent >= 31) { // overflow, infinity or NaN
+        bool isNaN = ((bits >> 23) & 0xFF) == 0xFF && mantissa;
+        return quint16(sign | 0x7C00 | (isNaN ? 0x200 : 0));
+    }
+    int shift = 13;
+    quint32 half = (quint32(qMax(exponent, 0)) << 10);
+    if (exponent <= 0) { // subnormal
+        if (exponent < -10)
+            return quint16(sign);
+        mantissa |= 0x800000;
+        shift = 14 - exponent;
+    }
+    half |= mantissa >> shift;
+    quint32 rest = mantissa & ((1u << shift) - 1);
+    quint32 halfway = 1u << (shift - 1);
+    if (rest > halfway || (rest == halfway && (half & 1)))
+        ++half; // a carry into the exponent is still the correctly rounded value
+    return quint16(sign | half);
+}
+
+static void packMesh(Mesh &mesh, VertexFormat format, bool halfFloatTexCoords)
+{
+    const int count = mesh.vertexCount();
+    if (format == FloatVertexFormat || mesh._format != FloatVertexFormat || count == 0)
+        return;
+    if (mesh._morphNode)
+        return; // the streamed positions are floats
+
+    QVector3D minValue = mesh.vertex(0);
+    QVector3D maxValue = minValue;
+    for (int i = 1; i < count; ++i) {
+        QVector3D vertex = mesh.vertex(i);
+        for (int k = 0; k < 3; ++k) {
+            minValue[k] = qMin(minValue[k], vertex[k]);
+            maxValue[k] = qMax(maxValue[k], vertex[k]);
+        }
+    }
+    QVector3D center = (minValue + maxValue) / 2;
+    QVector3D halfExtent = (maxValue - minValue) / 2;
+    for (int k = 0; k < 3; ++k) {
+        if (halfExtent[k] <= 0)
+            halfExtent[k] = 1; // flat along this axis, every coordinate quantizes to 0
+    }
+
+    memset(mesh._dequantization, 0, sizeof(mesh._dequantization));
+    for (int k = 0; k < 3; ++k) {
+        mesh._dequantization[5 * k] = halfExtent[k] / 32767;
+        mesh._dequantization[12 + k] = center[k];
+    }
+    mesh._dequantization[15] = 1;
+
+    mesh._packedVertices.resize(3 * count);
+    for (int i = 0; i < 3 * count; ++i) {
+        int k = i % 3;
+        float relative = (mesh._vertices[i] - center[k]) / halfExtent[k];
+        mesh._packedVertices[i] = GLshort(qRound(qBound(-1.0f, relative, 1.0f) * 32767));
+    }
+
+    // GL transforms normals by the inverse transpose of the modelview, which includes the
+    // dequantization scale S: store S * n so that the lit normal is n again after GL_NORMALIZE
+    const bool isShort = format == Packed16VertexFormat;
+    const float normalScale = isShort ? 32767 : 127;
+    mesh._normalType = isShort ? GL_SHORT : GL_BYTE;
+    mesh._packedNormals.resize(3 * count * (isShort ? sizeof(GLshort) : sizeof(GLbyte)));
+    GLshort *shortNormals = reinterpret_cast<GLshort *>(mesh._packedNormals.data());
+    GLbyte *byteNormals = reinterpret_cast<GLbyte *>(mesh._packedNormals.data());
+    for (int i = 0; i < count; ++i) {
+        QVector3D normal(mesh._normals[3 * i] * halfExtent[0],
+                         mesh._normals[3 * i + 1] * halfExtent[1],
+                         mesh._normals[3 * i + 2] * halfExtent[2]);
+        normal.normalize();
+        for (int k = 0; k < 3; ++k) {
+            int value = qRound(qBound(-1.0f, normal[k], 1.0f) * normalScale);
+            if (isShort)
+                shortNormals[3 * i + k] = GLshort(value);
+            else
+                byteNormals[3 * i + k] = GLbyte(value);
+        }
+    }
+
+    if (halfFloatTexCoords) {
+        mesh._packedTextureVertices.resize(mesh._textureVertices.size());
+        for (int i = 0; i < mesh._textureVertices.size(); ++i)
+            mesh._packedTextureVertices[i] = toHalfFloat(mesh._textureVertices[i]);
+        mesh._textureVertices.clear();
+    }
+
+    mesh._vertices.clear();
+    mesh._normals.clear();
+    mesh._format = format;
+}
+
+// vertices of the meshes worth merging, and of the merged buffers
+static const int kSmallMeshVertices = 4096;
+static const int kMaxMergedVertices = 1 << 18;
+
+// box and sphere around the float vertices, they bound the mesh once its client arrays are released
+// and cull whole instances
+static void computeBounds(Mesh &mesh)
+{
+    const int count = mesh.vertexCount();
+    if (count == 0)
+        return;
+    QVector3D minValue = mesh.vertex(0);
+    QVector3D maxValue = minValue;
+    for (int i = 1; i < count; ++i) {
+        QVector3D vertex = mesh.vertex(i);
+        for (int k = 0; k < 3; ++k) {
+            minValue[k] = qMin(minValue[k], vertex[k]);
+            maxValue[k] = qMax(maxValue[k], vertex[k]);
+        }
+    }
+    mesh._boundsMin = minValue;
+    mesh._boundsMax = maxValue;
+    mesh._boundsCenter = (minValue + maxValue) / 2;
+    mesh._boundsRadius = 0;
+    for (int i = 0; i < count; ++i)
+        mesh._boundsRadius = qMax(mesh._boundsRadius, (mesh.vertex(i) - mesh._boundsCenter).length());
+}
+
+// 16-bit indices halve the index memory of the meshes that allow them
+static void compactIndices(Mesh &mesh)
+{
+    if (mesh._indexType == GL_UNSIGNED_SHORT || mesh.vertexCount() > 65536)
+        return;
+    mesh._shortIndices.resize(mesh._indices.size());
+    for (int i = 0; i < mesh._indices.size(); ++i)
+        mesh._shortIndices[i] = GLushort(mesh._indices[i]);
+    mesh._indices.clear();
+    mesh._indexType = GL_UNSIGNED_SHORT;
+}
+
+static void appendMesh(Mesh &target, const Mesh &source)
+{
+    const GLuint offset = target.vertexCount();
+    target._vertices += source._vertices;
+    target._normals += source._normals;
+    target._textureVertices += source._textureVertices;
+    target._indices.reserve(target._indices.size() + source._indices.size());
+    foreach (GLuint index, source._indices)
+        target._indices << offset + index;
+    target._ranges.last().indexCount = target._indices.size();
+}
+
+// true if the placement of the node or of one of its ancestors changes over time
+static bool isNodeAnimated(const Lib3dsNode *node)
+{
+    for (; node != 0; node = node->parent) {
+        if (node->type != LIB3DS_OBJECT_NODE)
+            continue;
+        const Lib3dsObjectData &data = node->data.object;
+        if (data.pos_track.keys > 1 || data.rot_track.keys > 1 || data.scl_track.keys > 1)
+            return true;
+    }
+    return false;
+}
+
+static QMatrix4x4 toMatrix(const Lib3dsMatrix m)
+{
+    QMatrix4x4 result;
+    for (int column = 0; column < 4; ++column) {
+        for (int row = 0; row < 4; ++row)
+            result(row, column) = m[column][row];
+    }
+    return result;
+}
+
+// lib3ds places the points of mesh by node matrix * T(-pivot) * inverse mesh matrix
+static bool nodeToMeshMatrix(const Lib3dsNode *node, Lib3dsMesh *mesh, QMatrix4x4 &result)
+{
+    Lib3dsMatrix inverse;
+    lib3ds_matrix_copy(inverse, mesh->matrix);
+    if (!lib3ds_matrix_inv_affine(inverse))
+        return false;
+    const Lib3dsFloat *pivot = node->data.object.pivot;
+    result.setToIdentity();
+    result.translate(-QVector3D(pivot[0], pivot[1], pivot[2]));
+    result *= toMatrix(inverse);
+    return true;
+}
+
+// the mesh of an object node, looked up like lib3ds_file_bounding_box_of_nodes() does
+static Lib3dsMesh *meshOfNode(Lib3dsFile *file, Lib3dsNode *node)
+{
+    Lib3dsMesh *mesh = 0;
+    if (node->type == LIB3DS_OBJECT_NODE && node->data.object.instance[0])
+        mesh = lib3ds_file_mesh_by_name(file, node->data.object.instance);
+    if (!mesh)
+        mesh = lib3ds_file_mesh_by_name(file, node->name);
+    return mesh;
+}
+
+int Mesh::vertexCount() const
+{
+    if (_format == FloatVertexFormat)
+        return _vertices.size() / 3;
+    return _packedVertices.size() / 3;
+}
+
+bool Mesh::hasTextureVertices() const
+{
+    return !_textureVertices.isEmpty() || !_packedTextureVertices.isEmpty() || _texCoordOffset >= 0;
+}
+
+const GLvoid *Mesh::indexData(int firstIndex) const
+{
+    if (_indexBuffer) {
+        const int indexSize = _indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+        return reinterpret_cast<const GLvoid *>((_indexBlock.offset + firstIndex) * indexSize);
+    }
+    if (_indexType == GL_UNSIGNED_SHORT)
+        return _shortIndices.constData() + firstIndex;
+    return _indices.constData() + firstIndex;
+}
+
+int Mesh::placementCount() const
+{
+    return _instances.isEmpty() ? 1 : _instances.size();
+}
+
+const QMatrix4x4 &Mesh::placement(int index) const
+{
+    return _instances.isEmpty() ? _transform : _instances[index].transform;
+}
+
+QVector3D Mesh::vertex(int index) const
+{
+    if (_format == FloatVertexFormat)
+        return QVector3D(_vertices[3 * index], _vertices[3 * index + 1], _vertices[3 * index + 2]);
+    QVector3D result;
+    for (int k = 0; k < 3; ++k)
+        result[k] = _packedVertices[3 * index + k] * _dequantization[5 * k] + _dequantization[12 + k];
+    return result;
+}
+
+// points the enabled arrays at the interleaved vertex buffer of mesh
+static void setBufferPointers(const Mesh &mesh)
+{
+    QOpenGLFunctions *gl = QOpenGLContext::currentContext()->functions();
+    const char *base = 0;
+    GL_CHECK( gl->glBindBuffer(GL_ARRAY_BUFFER, mesh._vertexBuffer));
+    GL_CHECK( glVertexPointer(3, mesh._format == FloatVertexFormat ? GL_FLOAT : GL_SHORT, mesh._stride, base));
+    GL_CHECK( glNormalPointer(mesh._normalType, mesh._stride, base + mesh._normalOffset));
+    if (mesh._texCoordOffset >= 0) {
+        GL_CHECK( glEnableClientState(GL_TEXTURE_COORD_ARRAY));
+        GL_CHECK( glTexCoordPointer(2, mesh._texCoordType, mesh._stride, base + mesh._texCoordOffset));
+    } else {
+        GL_CHECK( glDisableClientState(GL_TEXTURE_COORD_ARRAY));
+    }
+    GL_CHECK( gl->glBindBuffer(GL_ARRAY_BUFFER, 0));
+}
+
+// offset rounded up to a multiple of alignment, a power of two
+static int alignOffset(int offset, int alignment)
+{
+    return (offset + alignment - 1) & ~(alignment - 1);
+}
+
+// interleaves the client arrays of mesh and sets the attribute offsets and the stride of the result
+static QByteArray interleaveMesh(Mesh &mesh)
+{
+    const int count = mesh.vertexCount();
+    const bool isFloat = mesh._format == FloatVertexFormat;
+    const char *positions = isFloat ? reinterpret_cast<const char *>(mesh._vertices.constData())
+                                    : reinterpret_cast<const char *>(mesh._packedVertices.constData());
+    const char *normals = isFloat ? reinterpret_cast<const char *>(mesh._normals.constData())
+                                  : mesh._packedNormals.constData();
+    const char *texCoords = 0;
+    int texCoordSize = 0;
+    if (!mesh._packedTextureVertices.isEmpty()) {
+        texCoords = reinterpret_cast<const char *>(mesh._packedTextureVertices.constData());
+        texCoordSize = 2 * sizeof(quint16);
+        mesh._texCoordType = GL_HALF_FLOAT;
+    } else if (!mesh._textureVertices.isEmpty()) {
+        texCoords = reinterpret_cast<const char *>(mesh._textureVertices.constData());
+        texCoordSize = 2 * sizeof(GLfloat);
+        mesh._texCoordType = GL_FLOAT;
+    }
+    const int positionSize = 3 * (isFloat ? sizeof(GLfloat) : sizeof(GLshort));
+    const int normalSize = isFloat ? 3 * sizeof(GLfloat) : mesh._packedNormals.size() / count;
+
+    // every attribute is aligned to the size of its components only, the stride to the largest of them, so
+    // the packed formats take 16 or 14 bytes with texture coordinates, 12 or 10 without
+    mesh._normalOffset = alignOffset(positionSize, normalSize / 3);
+    int end = mesh._normalOffset + normalSize;
+    int alignment = qMax(positionSize, normalSize) / 3;
+    mesh._texCoordOffset = -1;
+    if (texCoords) {
+        mesh._texCoordOffset = alignOffset(end, texCoordSize / 2);
+        end = mesh._texCoordOffset + texCoordSize;
+        alignment = qMax(alignment, texCoordSize / 2);
+    }
+    mesh._stride = alignOffset(end, alignment);
+
+    QByteArray vertices(mesh._stride * count, 0);
+    for (int i = 0; i < count; ++i) {
+        char *vertex = vertices.data() + i * mesh._stride;
+        memcpy(vertex, positions + i * positionSize, positionSize);
+        memcpy(vertex + mesh._normalOffset, normals + i * normalSize, normalSize);
+        if (texCoords)
+            memcpy(vertex + mesh._texCoordOffset, texCoords + i * texCoordSize, texCoordSize);
+    }
+    return vertices;
+}
+
+// identifies the attribute types and offsets of the interleaved vertices, only meshes of the same
+// layout share the vertex pages of an arena
+static quint32 vertexLayout(const Mesh &mesh)
+{
+    return quint32(mesh._stride) | quint32(mesh._normalOffset) << 8 | quint32(mesh._texCoordOffset + 1) << 16
+            | quint32(mesh._format == FloatVertexFormat) << 24 | quint32(mesh._normalType == GL_SHORT) << 25
+            | quint32(mesh._normalType == GL_BYTE) << 26 | quint32(mesh._texCoordType == GL_HALF_FLOAT) << 27;
+}
+
+// records the layout of the buffers of mesh in a vertex array object, 0 if the context has none
+static QOpenGLVertexArrayObject *createVertexArray(const Mesh &mesh)
+{
+    QOpenGLVertexArrayObject *vertexArray = new QOpenGLVertexArrayObject;
+    if (!vertexArray->create()) {
+        delete vertexArray;
+        return 0;
+    }
+    QOpenGLFunctions *gl = QOpenGLContext::currentContext()->functions();
+    vertexArray->bind();
+    GL_CHECK( glEnableClientState(GL_VERTEX_ARRAY));
+    GL_CHECK( glEnableClientState(GL_NORMAL_ARRAY));
+    setBufferPointers(mesh);
+    GL_CHECK( gl->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh._indexBuffer));
+    vertexArray->release();
+    GL_CHECK( gl->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0));
+    return vertexArray;
+}
+
+// copies the geometry of mesh into blocks of arena, or into buffers of its own with their vertex array
+// object if arena is 0. Morphed meshes stream their positions and keep the client arrays.
+static void uploadMesh(Mesh &mesh, GpuArena *arena)
+{
+    const QByteArray vertices = interleaveMesh(mesh);
+    const bool isShort = mesh._indexType == GL_UNSIGNED_SHORT;
+    const int indexCount = isShort ? mesh._shortIndices.size() : mesh._indices.size();
+    const GLvoid *indices = isShort ? static_cast<const GLvoid *>(mesh._shortIndices.constData())
+                                    : static_cast<const GLvoid *>(mesh._indices.constData());
+    if (arena) {
+        // the vertex array object is shared by the meshes of the same pages, see Model::arenaArray()
+        mesh._arena = arena;
+        mesh._vertexBlock = arena->allocateVertices(vertexLayout(mesh), mesh._stride, vertices.constData(),
+                                                    mesh.vertexCount());
+        mesh._indexBlock = arena->allocateIndices(mesh._indexType, indices, indexCount);
+        mesh._vertexBuffer = mesh._vertexBlock.buffer;
+        mesh._indexBuffer = mesh._indexBlock.buffer;
+        return;
+    }
+
+    QOpenGLFunctions *gl = QOpenGLContext::currentContext()->functions();
+    GL_CHECK( gl->glGenBuffers(1, &mesh._vertexBuffer));
+    GL_CHECK( gl->glBindBuffer(GL_ARRAY_BUFFER, mesh._vertexBuffer));
+    GL_CHECK( gl->glBufferData(GL_ARRAY_BUFFER, vertices.size(), vertices.constData(), GL_STATIC_DRAW));
+    GL_CHECK( gl->glBindBuffer(GL_ARRAY_BUFFER, 0));
+
+    const GLsizeiptr indexBytes = indexCount * (isShort ? sizeof(GLushort) : sizeof(GLuint));
+    GL_CHECK( gl->glGenBuffers(1, &mesh._indexBuffer));
+    GL_CHECK( gl->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh._indexBuffer));
+    GL_CHECK( gl->glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBytes, indices, GL_STATIC_DRAW));
+    GL_CHECK( gl->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0));
+    mesh._vertexArray = createVertexArray(mesh);
+}
+
+// the buffers hold the geometry from now on
+static void releaseClientGeometry(Mesh &mesh)
+{
+    mesh._vertices.clear();
+    mesh._normals.clear();
+    mesh._textureVertices.clear();
+    mesh._packedVertices.clear();
+    mesh._packedNormals.clear();
+    mesh._packedTextureVertices.clear();
+    mesh._indices.clear();
+    mesh._shortIndices.clear();
+}
+
+// the vertex array objects of arena meshes belong to the model, see Model::releaseArenaArrays()
+static void releaseMeshBuffers(Mesh &mesh, QOpenGLContext *context)
+{
+    if (mesh._arena) {
+        mesh._arena->release(mesh._vertexBlock);
+        mesh._arena->release(mesh._indexBlock);
+        mesh._vertexBlock = mesh._indexBlock = GpuArenaBlock();
+        mesh._arena = 0;
+    } else {
+        if (context && mesh._vertexBuffer) {
+            GL_CHECK( context->functions()->glDeleteBuffers(1, &mesh._vertexBuffer));
+            GL_CHECK( context->functions()->glDeleteBuffers(1, &mesh._indexBuffer));
+        }
+        delete mesh._vertexArray;
+    }
+    mesh._vertexArray = 0;
+    mesh._vertexBuffer = mesh._indexBuffer = 0;
+    mesh._texCoordOffset = -1;
+}
+
+namespace lib3ds_qt {
+
+/// Bindings kept across the meshes of a pass, between beginModelState() and endModelState(). Each draw call
+/// of a Model has its own, in the current context.
+struct ModelPass
+{
+    bool isActive;
+    QOpenGLVertexArrayObject *boundArray; /**< Left bound after a mesh, the next meshes of the same arena pages reuse it */
+    int boundTexture; /**< Texture ID of the last material range, -2 if unknown */
+
+    ModelPass() : isActive(false), boundArray(0), boundTexture(-2) {}
+};
+
+} // namespace lib3ds_qt
+
+// selects the vertex data of mesh: its vertex array object, its buffers or its client arrays.
+// Meshes without texture coordinates disable the texture coordinate array until releaseMeshArrays().
+static void bindMeshArrays(ModelPass &pass, const Mesh &mesh)
+{
+    GL_CHECK( glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE));
+    if (!pass.isActive)
+        pass.boundTexture = -2; // the caller may have bound any texture since the last mesh
+    if (pass.boundArray && pass.boundArray != mesh._vertexArray) {
+        pass.boundArray->release();
+        pass.boundArray = 0;
+    }
+    if (mesh._vertexArray) {
+        if (!pass.boundArray)
+            mesh._vertexArray->bind();
+        pass.boundArray = mesh._vertexArray;
+        return;
+    }
+    QOpenGLFunctions *gl = QOpenGLContext::currentContext()->functions();
+    if (mesh._vertexBuffer) {
+        setBufferPointers(mesh);
+        GL_CHECK( gl->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh._indexBuffer));
+        return;
+    }
+    if (mesh._morphBuffers[0]) {
+        GL_CHECK( gl->glBindBuffer(GL_ARRAY_BUFFER, mesh._morphBuffers[mesh._morphBuffer]));
+        GL_CHECK( glVertexPointer(3, GL_FLOAT, 0, 0));
+        GL_CHECK( gl->glBindBuffer(GL_ARRAY_BUFFER, 0));
+        GL_CHECK( glNormalPointer(GL_FLOAT, 0, mesh._normals.data()));
+    } else if (mesh._format == FloatVertexFormat) {
+        GL_CHECK( glVertexPointer(3, GL_FLOAT, 0, mesh._vertices.data()));
+        GL_CHECK( glNormalPointer(GL_FLOAT, 0, mesh._normals.data()));
+    } else {
+        GL_CHECK( glVertexPointer(3, GL_SHORT, 0, mesh._packedVertices.data()));
+        GL_CHECK( glNormalPointer(mesh._normalType, 0, mesh._packedNormals.data()));
+    }
+    if (!mesh.hasTextureVertices())
+        GL_CHECK( glDisableClientState(GL_TEXTURE_COORD_ARRAY));
+    else if (mesh._packedTextureVertices.isEmpty())
+        GL_CHECK( glTexCoordPointer(2, GL_FLOAT, 0, mesh._textureVertices.data()));
+    else
+        GL_CHECK( glTexCoordPointer(2, GL_HALF_FLOAT, 0, mesh._packedTextureVertices.data()));
+}
+
+// within a pass the vertex array object stays bound for the next mesh
+static void releaseMeshArrays(ModelPass &pass, const Mesh &mesh)
+{
+    if (mesh._vertexArray) {
+        if (!pass.isActive) {
+            mesh._vertexArray->release();
+            pass.boundArray = 0;
+        }
+        return;
+    }
+    if (mesh._vertexBuffer)
+        GL_CHECK( QOpenGLContext::currentContext()->functions()->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0));
+    GL_CHECK( glEnableClientState(GL_TEXTURE_COORD_ARRAY));
+}
+
+ModelInstanceBuffer::ModelInstanceBuffer()
+    : _buffer(0), _capacity(0)
+{
+}
+
+ModelInstanceBuffer::~ModelInstanceBuffer()
+{
+    QOpenGLContext *context = QOpenGLContext::currentContext();
+    if (_buffer && context)
+        GL_CHECK( context->functions()->glDeleteBuffers(1, &_buffer));
+}
+
+void ModelInstanceBuffer::setMatrices(const QVector<QMatrix4x4> &matrices)
+{
+    _matrices = matrices;
+    // QMatrix4x4 carries flags besides its floats: pack the columns
+    _data.resize(16 * matrices.size());
+    for (int i = 0; i < matrices.size(); ++i)
+        memcpy(_data.data() + 16 * i, matrices[i].constData(), 16 * sizeof(GLfloat));
+
+    QOpenGLContext *context = QOpenGLContext::currentContext();
+    if (!context)
+        return;
+    QOpenGLFunctions *gl = context->functions();
+
+    if (!_buffer)
+        GL_CHECK( gl->glGenBuffers(1, &_buffer));
+    GL_CHECK( gl->glBindBuffer(GL_ARRAY_BUFFER, _buffer));
+    if (matrices.size() > _capacity) {
+        _capacity = matrices.size();
+        GL_CHECK( gl->glBufferData(GL_ARRAY_BUFFER, _data.size() * sizeof(GLfloat), _data.constData(), GL_DYNAMIC_DRAW));
+    } else {
+        // orphan the storage the GPU may still read from
+        GL_CHECK( gl->glBufferData(GL_ARRAY_BUFFER, 16 * _capacity * sizeof(GLfloat), 0, GL_DYNAMIC_DRAW));
+        GL_CHECK( gl->glBufferSubData(GL_ARRAY_BUFFER, 0, _data.size() * sizeof(GLfloat), _data.constData()));
+    }
+    GL_CHECK( gl->glBindBuffer(GL_ARRAY_BUFFER, 0));
+}
+
+void ModelInstanceBuffer::updateMatrices(int first, const QVector<QMatrix4x4> &matrices)
+{
+    Q_ASSERT(first >= 0 && first + matrices.size() <= _matrices.size());
+    for (int i = 0; i < matrices.size(); ++i) {
+        _matrices[first + i] = matrices[i];
+        memcpy(_data.data() + 16 * (first + i), matrices[i].constData(), 16 * sizeof(GLfloat));
+    }
+    QOpenGLContext *context = QOpenGLContext::currentContext();
+    if (!_buffer || !context || matrices.isEmpty())
+        return;
+    QOpenGLFunctions *gl = context->functions();
+    GL_CHECK( gl->glBindBuffer(GL_ARRAY_BUFFER, _buffer));
+    GL_CHECK( gl->glBufferSubData(GL_ARRAY_BUFFER, 16 * first * sizeof(GLfloat), 16 * matrices.size() * sizeof(GLfloat),
+                                  _data.constData() + 16 * first));
+    GL_CHECK( gl->glBindBuffer(GL_ARRAY_BUFFER, 0));
+}
+
+int ModelInstanceBuffer::count() const
+{
+    return _matrices.size();
+}
+
+const QVector<QMatrix4x4> &ModelInstanceBuffer::matrices() const
+{
+    return _matrices;
+}
+
+GLuint ModelInstanceBuffer::bufferId() const
+{
+    return _buffer;
+}
+
 
 // constructor, enables and set properties of texture coordinate generation and set the current frame
 Model::Model()
 {
+    _nodeTable = 0;
+    _instancing = 0;
+    _instanceBuffer = 0;
+    _arena = 0;
+    _keepClientGeometry = true;
+    _isGeometryUploaded = false;
     _isValid = false;
     _meshRadius = -1;
+    _vertexFormat = FloatVertexFormat;
 }
 
 // destructor, free up memory and disable texture generation
 Model::~Model()
 {
+    releaseBuffers();
+    delete _instanceBuffer;
+    if (_nodeTable)
+        lib3ds_node_table_free(_nodeTable);
     if(_file3ds) // if the file isn't freed yet
         lib3ds_file_free(_file3ds); //free up memory
      //disable texture generation
@@ -124,6 +797,36 @@ Model::~Model()
     }
 }
 
+void Model::setVertexFormat(VertexFormat format)
+{
+    _vertexFormat = format;
+}
+
+VertexFormat Model::vertexFormat() const
+{
+    return _vertexFormat;
+}
+
+void Model::setKeepClientGeometry(bool keep)
+{
+    _keepClientGeometry = keep;
+}
+
+bool Model::keepClientGeometry() const
+{
+    return _keepClientGeometry;
+}
+
+void Model::setArena(GpuArena *arena)
+{
+    _arena = arena;
+}
+
+GpuArena *Model::arena() const
+{
+    return _arena;
+}
+
 // load the model, and if the texture has textures, then apply them on the geometric primitives
 void Model::loadFile(const QString &name, const QString &pathToFile)
 {
@@ -145,6 +848,9 @@ void Model::loadFile(const QString &name, const QString &pathToFile)
         Q_ASSERT(false);
     }
     lib3ds_file_eval(_file3ds, 0); // set current frame to 0
+    if (_nodeTable)
+        lib3ds_node_table_free(_nodeTable);
+    _nodeTable = lib3ds_node_table_new(_file3ds);
     // apply texture to all meshes that have texels
     Lib3dsMesh *mesh;
     for(mesh = _file3ds->meshes; mesh != 0;mesh = mesh->next)
@@ -156,15 +862,204 @@ void Model::loadFile(const QString &name, const QString &pathToFile)
     prepareNodes();
 }
 
+void Model::setFrame(float frame)
+{
+    if (!_nodeTable)
+        return;
+    lib3ds_node_table_eval(_nodeTable, frame);
+    updateTransforms();
+}
+
+void Model::updateTransforms()
+{
+    // the vertices are centered: a transform is T(-center) * world matrix * T(center)
+    QMatrix4x4 toCenter;
+    QMatrix4x4 fromCenter;
+    toCenter.translate(-_center);
+    fromCenter.translate(_center);
+    for (int i = 0; i < _meshes.size(); ++i)
+    {
+        Mesh &mesh = _meshes[i];
+        if (mesh._node)
+            mesh._transform = toCenter * toMatrix(mesh._node->matrix) * mesh._nodeToMesh * fromCenter;
+        for (int k = 0; k < mesh._instances.size(); ++k) {
+            MeshInstance &instance = mesh._instances[k];
+            instance.transform = toCenter * toMatrix(instance.node->matrix) * instance.nodeToMesh * fromCenter;
+        }
+    }
+}
+
+void Model::setMorphFrame(float frame)
+{
+    QOpenGLContext *context = QOpenGLContext::currentContext();
+    if (!_file3ds || !context)
+        return;
+    QOpenGLFunctions *gl = context->functions();
+
+    for (int i = 0; i < _meshes.size(); ++i)
+    {
+        Mesh &mesh = _meshes[i];
+        if (!mesh._morphNode)
+            continue;
+        const int count = mesh.vertexCount();
+        if (_morphPoints.size() < count)
+            _morphPoints.resize(count);
+        Lib3dsPoint *points = _morphPoints.data();
+        if (!lib3ds_file_morph_node(_file3ds, mesh._morphNode, frame, points, count))
+            continue;
+        for (int v = 0; v < count; ++v) {
+            points[v].pos[0] -= _center.x();
+            points[v].pos[1] -= _center.y();
+            points[v].pos[2] -= _center.z();
+        }
+
+        const GLsizeiptr size = 3 * count * sizeof(GLfloat);
+        if (!mesh._morphBuffers[0]) {
+            GL_CHECK( gl->glGenBuffers(2, mesh._morphBuffers));
+            for (int b = 0; b < 2; ++b) {
+                GL_CHECK( gl->glBindBuffer(GL_ARRAY_BUFFER, mesh._morphBuffers[b]));
+                GL_CHECK( gl->glBufferData(GL_ARRAY_BUFFER, size, mesh._vertices.constData(), GL_STREAM_DRAW));
+            }
+        }
+        // the GPU may still read the buffer of the previous frame, overwrite the other one
+        mesh._morphBuffer ^= 1;
+        GL_CHECK( gl->glBindBuffer(GL_ARRAY_BUFFER, mesh._morphBuffers[mesh._morphBuffer]));
+        GL_CHECK( gl->glBufferSubData(GL_ARRAY_BUFFER, 0, size, points));
+    }
+    GL_CHECK( gl->glBindBuffer(GL_ARRAY_BUFFER, 0));
+}
+
+void Model::releaseBuffers()
+{
+    QOpenGLContext *context = QOpenGLContext::currentContext();
+    for (int i = 0; i < _meshes.size(); ++i)
+    {
+        Mesh &mesh = _meshes[i];
+        if (!mesh._morphBuffers[0])
+            continue;
+        if (context)
+            GL_CHECK( context->functions()->glDeleteBuffers(2, mesh._morphBuffers));
+        mesh._morphBuffers[0] = mesh._morphBuffers[1] = 0;
+    }
+    for (int i = 0; i < _meshes.size(); ++i)
+        releaseMeshBuffers(_meshes[i], context);
+    releaseArenaArrays();
+    _isGeometryUploaded = false;
+    if (_instancing) {
+        if (context && _instancing->buffer)
+            GL_CHECK( context->functions()->glDeleteBuffers(1, &_instancing->buffer));
+        delete _instancing;
+        _instancing = 0;
+    }
+}
+
+/// Orders the meshes by vertex and index buffer, then by the texture of their first material
+struct DrawOrderLess
+{
+    const QList<Mesh> &meshes;
+
+    explicit DrawOrderLess(const QList<Mesh> &meshes) : meshes(meshes) {}
+    bool operator()(int a, int b) const
+    {
+        const Mesh &first = meshes[a];
+        const Mesh &second = meshes[b];
+        if (first._vertexBuffer != second._vertexBuffer)
+            return first._vertexBuffer < second._vertexBuffer;
+        if (first._indexBuffer != second._indexBuffer)
+            return first._indexBuffer < second._indexBuffer;
+        const int firstTexture = first._ranges.isEmpty() ? -1 : first._ranges.first().textureID;
+        const int secondTexture = second._ranges.isEmpty() ? -1 : second._ranges.first().textureID;
+        return firstTexture < secondTexture;
+    }
+};
+
+void Model::uploadGeometry()
+{
+    _drawOrder.resize(_meshes.size());
+    for (int i = 0; i < _drawOrder.size(); ++i)
+        _drawOrder[i] = i;
+    if (!QOpenGLContext::currentContext())
+        return;
+    GpuArena *arena = _arena && _arena->isSupported() ? _arena : 0;
+    for (int i = 0; i < _meshes.size(); ++i)
+    {
+        Mesh &mesh = _meshes[i];
+        if (mesh._morphNode || mesh._vertexBuffer || mesh.vertexCount() == 0)
+            continue;
+        uploadMesh(mesh, arena);
+        if (!_keepClientGeometry)
+            releaseClientGeometry(mesh);
+    }
+    for (int i = 0; i < _meshes.size(); ++i)
+    {
+        Mesh &mesh = _meshes[i];
+        if (mesh._arena && !mesh._vertexArray)
+            mesh._vertexArray = arenaArray(mesh);
+    }
+    std::stable_sort(_drawOrder.begin(), _drawOrder.end(), DrawOrderLess(_meshes));
+    _isGeometryUploaded = true;
+}
+
+QOpenGLVertexArrayObject *Model::arenaArray(const Mesh &mesh)
+{
+    // a vertex page holds a single layout, so the pages identify the vertex array object
+    const quint64 key = quint64(mesh._vertexBuffer) << 32 | mesh._indexBuffer;
+    QHash<quint64, QOpenGLVertexArrayObject*>::const_iterator it = _arenaArrays.constFind(key);
+    if (it != _arenaArrays.constEnd())
+        return it.value();
+    QOpenGLVertexArrayObject *vertexArray = createVertexArray(mesh);
+    _arenaArrays.insert(key, vertexArray);
+    return vertexArray;
+}
+
+void Model::releaseArenaArrays()
+{
+    for (int i = 0; i < _meshes.size(); ++i)
+    {
+        if (_meshes[i]._arena)
+            _meshes[i]._vertexArray = 0;
+    }
+    qDeleteAll(_arenaArrays);
+    _arenaArrays.clear();
+}
+
 void Model::prepareNodes()
 {
+    releaseBuffers();
     _nodes.clear();
     _meshes.clear();
+    _sharedMeshes.clear();
+    _center = QVector3D();
 
     for(Lib3dsNode *node = _file3ds->nodes; node != 0; node = node->next) // Render all nodes
         prepareNode(node);
+    _sharedMeshes.clear();
 
+    updateTransforms(); // the bounds of the model depend on the placement of the instances
+    mergeSmallMeshes();
     centerModel();
+
+    for (int i = 0; i < _meshes.size(); ++i)
+    {
+        Mesh &mesh = _meshes[i];
+        mesh._clusters.clear();
+        for (int r = 0; r < mesh._ranges.size(); ++r)
+        {
+            MaterialRange &range = mesh._ranges[r];
+            range.firstCluster = mesh._clusters.size();
+            buildMeshClusters(mesh._vertices, mesh._indices, range.firstIndex, range.indexCount, mesh._clusters);
+            range.clusterCount = mesh._clusters.size() - range.firstCluster;
+        }
+        mesh._bvh.build(mesh._vertices, mesh._indices);
+        computeBounds(mesh);
+        compactIndices(mesh);
+    }
+
+    if (_vertexFormat != FloatVertexFormat) {
+        bool halfFloatTexCoords = isHalfFloatVertexSupported();
+        for (int i = 0; i < _meshes.size(); ++i)
+            packMesh(_meshes[i], _vertexFormat, halfFloatTexCoords);
+    }
     _isValid = true;
 }
 
@@ -175,13 +1070,40 @@ void Model::prepareNode(Lib3dsNode *node)
     for(Lib3dsNode *childNode = node->childs; childNode != 0; childNode = childNode->next)
         prepareNode(childNode); //prepare all child nodes of this note
 
-    Lib3dsMesh *mesh = lib3ds_file_mesh_by_name(_file3ds, node->name); //get all the meshes of the current node
+    Lib3dsMesh *mesh = meshOfNode(_file3ds, node); //get all the meshes of the current node
     if(! mesh)
         return;
 
+    // nodes referencing the same Lib3dsMesh share its geometry, each one adds an instance.
+    // Morphed meshes get their own copy, their vertices change per node.
+    const bool isShareable = node->type == LIB3DS_OBJECT_NODE && node->data.object.morph_track.keys == 0;
+    if (isShareable && _sharedMeshes.contains(mesh)) {
+        const int index = _sharedMeshes.value(mesh);
+        MeshInstance instance;
+        instance.node = node;
+        if (nodeToMeshMatrix(node, mesh, instance.nodeToMesh)) {
+            Mesh &sharedMesh = _meshes[index];
+            if (sharedMesh._instances.isEmpty()) {
+                MeshInstance first;
+                first.node = _nodes[index];
+                nodeToMeshMatrix(first.node, mesh, first.nodeToMesh);
+                sharedMesh._instances << first;
+                sharedMesh._node = 0;
+            }
+            sharedMesh._instances << instance;
+            return;
+        }
+    }
+
     _meshes.push_back(Mesh());
     _nodes << node;
+    if (isShareable)
+        _sharedMeshes.insert(mesh, _meshes.size() - 1);
     Mesh &meshData = _meshes.last();
+    if (node->type == LIB3DS_OBJECT_NODE && node->data.object.morph_track.keys > 0)
+        meshData._morphNode = node;
+    if (node->type == LIB3DS_OBJECT_NODE && isNodeAnimated(node) && nodeToMeshMatrix(node, mesh, meshData._nodeToMesh))
+        meshData._node = node;
 
     meshData._vertices.reserve(3 * mesh->points); // optimization
     meshData._normals.reserve(3 * mesh->points); // optimization
@@ -212,34 +1134,119 @@ void Model::prepareNode(Lib3dsNode *node)
         }
     }
 
+    // counting sort of the faces by material, slot 0 collects the faces without texture
+    QMap<QString, int> materialSlots;
+    QVector<int> slotTextures;
+    slotTextures << -1;
+    QVector<int> faceSlots(mesh->faces);
     for(unsigned p = 0;p < mesh->faces;p++)
     {
         Lib3dsFace *f = &mesh->faceL[p];
         Q_ASSERT(f);
-        Lib3dsMaterial *mat = lib3ds_file_material_by_name(_file3ds, f->material);
-        bool isTextureValid = mat && mesh->texels;
-
-        if(isTextureValid)
+        int slot = 0;
+        if (mesh->texels && f->material[0])
         {
-            QString textureName = mat->texture1_map.name;
-            Q_ASSERT(_textureFilenamesIndexes.contains(textureName));
-            GLuint tmp = _textureFilenamesIndexes[textureName];
-            Q_ASSERT(meshData._textureID == -1 || meshData._textureID == (int)tmp);
-            meshData._textureID = tmp;
+            QString materialName = f->material;
+            if (!materialSlots.contains(materialName))
+            {
+                Lib3dsMaterial *mat = lib3ds_file_material_by_name(_file3ds, f->material);
+                int textureID = -1;
+                if (mat) {
+                    QString textureName = mat->texture1_map.name;
+                    Q_ASSERT(_textureFilenamesIndexes.contains(textureName));
+                    textureID = _textureFilenamesIndexes.value(textureName, GLuint(-1));
+                }
+                materialSlots.insert(materialName, slotTextures.size());
+                slotTextures << textureID;
+            }
+            slot = materialSlots.value(materialName);
         }
+        faceSlots[p] = slot;
+    }
 
-        for(int i = 0;i < 3;i++)
-        {
-            Lib3dsWord verticeIndex = f->points[i];
+    QVector<int> slotOffsets(slotTextures.size() + 1, 0);
+    foreach (int slot, faceSlots)
+        slotOffsets[slot + 1] += 3;
+    for (int slot = 0; slot < slotTextures.size(); ++slot)
+        slotOffsets[slot + 1] += slotOffsets[slot];
 
-            meshData._indices << verticeIndex;
-        }
+    for (int slot = 0; slot < slotTextures.size(); ++slot)
+    {
+        if (slotOffsets[slot + 1] == slotOffsets[slot])
+            continue;
+        MaterialRange range;
+        range.textureID = slotTextures[slot];
+        range.firstIndex = slotOffsets[slot];
+        range.indexCount = slotOffsets[slot + 1] - slotOffsets[slot];
+        meshData._ranges << range;
+    }
+
+    meshData._indices.resize(3 * mesh->faces);
+    for(unsigned p = 0;p < mesh->faces;p++)
+    {
+        int &offset = slotOffsets[faceSlots[p]];
+        for(int i = 0;i < 3;i++)
+            meshData._indices[offset++] = mesh->faceL[p].points[i];
     }
     glEnd();
     glEndList(); // end of list
 
 }
 
+void Model::mergeSmallMeshes()
+{
+    // meshes of a batch must agree on the texture and on having texture coordinates
+    typedef QPair<int, bool> BatchKey;
+    QMap<BatchKey, QList<int> > batches;
+    QVector3D minValue = getMin();
+    QVector3D maxValue = getMax();
+    QList<Mesh> meshes;
+    for (int i = 0; i < _meshes.size(); ++i)
+    {
+        const Mesh &mesh = _meshes[i];
+        if (mesh._morphNode || mesh._node || !mesh._instances.isEmpty() || mesh._ranges.size() != 1 || mesh.vertexCount() >= kSmallMeshVertices) {
+            meshes << mesh;
+            continue;
+        }
+        batches[qMakePair(mesh._ranges[0].textureID, !mesh._textureVertices.isEmpty())] << i;
+    }
+
+    for (QMap<BatchKey, QList<int> >::iterator it = batches.begin(); it != batches.end(); ++it)
+    {
+        // Morton order of the mesh centers keeps every merged buffer spatially compact
+        QVector<QPair<quint32, int> > order;
+        foreach (int i, it.value()) {
+            const Mesh &mesh = _meshes[i];
+            QVector3D center;
+            for (int v = 0; v < mesh.vertexCount(); ++v)
+                center += mesh.vertex(v);
+            if (mesh.vertexCount() > 0)
+                center /= mesh.vertexCount();
+            order << qMakePair(mortonCode(center, minValue, maxValue), i);
+        }
+        std::sort(order.begin(), order.end());
+
+        Mesh batch;
+        for (int k = 0; k < order.size(); ++k)
+        {
+            const Mesh &mesh = _meshes[order[k].second];
+            if (batch._ranges.isEmpty()) {
+                batch = mesh;
+                continue;
+            }
+            if (batch.vertexCount() + mesh.vertexCount() > kMaxMergedVertices) {
+                meshes << batch;
+                batch = mesh;
+                continue;
+            }
+            appendMesh(batch, mesh);
+        }
+        if (!batch._ranges.isEmpty())
+            meshes << batch;
+    }
+    _meshes = meshes;
+}
+
 // what is basicly does is, set the properties of the texture for our mesh
 void Model::ApplyTexture(Lib3dsMesh *mesh, const QString &extraPath)
 {
@@ -266,44 +1273,282 @@ void Model::ApplyTexture(Lib3dsMesh *mesh, const QString &extraPath)
     }
 }
 
-// this function actually renders the model at place (x, y, z) and then rotated around the y axis by 'angle' degrees
-void Model::renderModel()
+// enables culling, texturing and the vertex arrays of a pass and pushes the attributes endModelState() restores
+static void beginModelState(ModelPass &pass, VertexFormat format)
 {
-    Q_ASSERT(_file3ds);
-    glPushAttrib(GL_POLYGON_BIT);
+    glPushAttrib(GL_POLYGON_BIT | GL_TRANSFORM_BIT);
     glEnable(GL_CULL_FACE);
     glCullFace(GL_BACK);
+    if (format != FloatVertexFormat)
+        glEnable(GL_NORMALIZE); // packed normals are prescaled, see packMesh()
 
     glEnable(GL_TEXTURE_2D);
     glEnableClientState(GL_VERTEX_ARRAY);
     glEnableClientState(GL_TEXTURE_COORD_ARRAY);
     glEnableClientState(GL_NORMAL_ARRAY);
+    pass.isActive = true;
+    pass.boundTexture = -2;
+}
+
+static void endModelState(ModelPass &pass)
+{
+    if (pass.boundArray) {
+        pass.boundArray->release();
+        pass.boundArray = 0;
+    }
+    pass.isActive = false;
+    glDisable(GL_TEXTURE_2D);
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+    glDisableClientState(GL_NORMAL_ARRAY);
+    glPopAttrib();
+}
+
+// this function actually renders the model at place (x, y, z) and then rotated around the y axis by 'angle' degrees
+void Model::renderModel()
+{
+    Q_ASSERT(_file3ds);
+    if (!_isGeometryUploaded)
+        uploadGeometry();
+    ModelPass pass;
+    beginModelState(pass, _vertexFormat);
 
 //    loadStaticMaterials();
 
 //    enableLightSources();
 
-    foreach (const Mesh &mesh, _meshes)
-        renderMesh(mesh);
+    ViewFrustum frustum = ViewFrustum::fromCurrentMatrices();
+    foreach (int i, _drawOrder)
+        renderMesh(_meshes[i], frustum, pass);
 
 //    disableLightSources();
 
-    glDisable(GL_TEXTURE_2D);
-    glDisableClientState(GL_VERTEX_ARRAY);
-    glDisableClientState(GL_TEXTURE_COORD_ARRAY);
-    glDisableClientState(GL_NORMAL_ARRAY);
-    glPopAttrib();
+    endModelState(pass);
 }
 
 void Model::renderMesh(const Mesh &mesh)
 {
-    GL_CHECK( glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE));
-    GL_CHECK( glBindTexture(GL_TEXTURE_2D, mesh._textureID));
-    GL_CHECK( glVertexPointer(3, GL_FLOAT, 0, mesh._vertices.data()));
-    GL_CHECK( glTexCoordPointer(2, GL_FLOAT, 0, mesh._textureVertices.data()));
-    GL_CHECK( glNormalPointer(GL_FLOAT, 0, mesh._normals.data()));
+    renderMesh(mesh, ViewFrustum::fromCurrentMatrices());
+}
+
+// the clusters of morphed meshes are bounded for the rest pose only
+static bool isClusterDrawn(const Mesh &mesh, int cluster, const ViewFrustum &frustum)
+{
+    return mesh._morphBuffers[0] || frustum.isClusterVisible(mesh._clusters[cluster]);
+}
+
+// binds the texture of a material range, skipped if it is bound already
+static void bindRangeTexture(ModelPass &pass, int textureID)
+{
+    if (textureID == pass.boundTexture)
+        return;
+    // texture 0 is incomplete, which disables texturing for untextured faces
+    GL_CHECK( glBindTexture(GL_TEXTURE_2D, textureID < 0 ? 0 : textureID));
+    pass.boundTexture = textureID;
+}
+
+// draws count indices of mesh from firstIndex, offset by the base vertex of its arena block
+static void drawElements(const Mesh &mesh, int firstIndex, GLsizei count)
+{
+    if (mesh._vertexBlock.offset)
+        mesh._arena->drawElementsBaseVertex(GL_TRIANGLES, count, mesh._indexType, mesh.indexData(firstIndex),
+                                            mesh._vertexBlock.offset);
+    else
+        GL_CHECK( glDrawElements(GL_TRIANGLES, count, mesh._indexType, mesh.indexData(firstIndex)));
+}
+
+// draws the clusters of mesh placed by transform which are inside the frustum, given in model coordinates
+static void renderPlacedMesh(ModelPass &pass, const Mesh &mesh, const QMatrix4x4 &transform,
+                             const ViewFrustum &modelFrustum)
+{
+    const bool isTransformed = !transform.isIdentity();
+    const bool isPacked = mesh._format != FloatVertexFormat;
+    // clusters are culled in mesh coordinates
+    const ViewFrustum frustum = isTransformed ? modelFrustum.transformed(transform) : modelFrustum;
+    bool isStateSet = false;
+    foreach (const MaterialRange &range, mesh._ranges)
+    {
+        int cluster = range.firstCluster;
+        const int lastCluster = range.firstCluster + range.clusterCount;
+        while (cluster < lastCluster)
+        {
+            if (!isClusterDrawn(mesh, cluster, frustum)) {
+                ++cluster;
+                continue;
+            }
+            // neighbouring visible clusters are contiguous in _indices: draw them at once
+            int firstIndex = mesh._clusters[cluster].firstIndex;
+            int indexCount = 0;
+            while (cluster < lastCluster && isClusterDrawn(mesh, cluster, frustum))
+                indexCount += mesh._clusters[cluster++].indexCount;
+
+            if (!isStateSet) {
+                bindMeshArrays(pass, mesh);
+                if (isTransformed || isPacked)
+                    GL_CHECK( glPushMatrix());
+                if (isTransformed)
+                    GL_CHECK( glMultMatrixf(transform.constData()));
+                if (isPacked)
+                    GL_CHECK( glMultMatrixf(mesh._dequantization));
+                isStateSet = true;
+            }
+            bindRangeTexture(pass, range.textureID);
+            drawElements(mesh, firstIndex, indexCount);
+        }
+    }
+    if (!isStateSet)
+        return;
+    releaseMeshArrays(pass, mesh);
+    if (isTransformed || isPacked)
+        GL_CHECK( glPopMatrix());
+}
+
+// sources the instance matrix attribute from buffer, one matrix per instance
+static void bindInstanceMatrices(const InstancingState &state, GLuint buffer)
+{
+    QOpenGLFunctions *gl = QOpenGLContext::currentContext()->functions();
+    GL_CHECK( gl->glBindBuffer(GL_ARRAY_BUFFER, buffer));
+    for (int column = 0; column < 4; ++column) {
+        const GLuint location = kInstanceMatrixLocation + column;
+        GL_CHECK( gl->glEnableVertexAttribArray(location));
+        GL_CHECK( gl->glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, 16 * sizeof(GLfloat),
+                                            reinterpret_cast<const GLvoid *>(4 * column * sizeof(GLfloat))));
+        GL_CHECK( state.vertexAttribDivisor(location, 1));
+    }
+    GL_CHECK( gl->glBindBuffer(GL_ARRAY_BUFFER, 0));
+}
+
+static void unbindInstanceMatrices(const InstancingState &state)
+{
+    QOpenGLFunctions *gl = QOpenGLContext::currentContext()->functions();
+    for (int column = 0; column < 4; ++column) {
+        const GLuint location = kInstanceMatrixLocation + column;
+        GL_CHECK( state.vertexAttribDivisor(location, 0));
+        GL_CHECK( gl->glDisableVertexAttribArray(location));
+    }
+}
+
+// draws instanceCount copies of the whole mesh placed by placement, with the instance matrices of
+// instanceBuffer. The program must be bound. The instance attributes are set after the vertex array
+// object of the mesh is bound, which would hide them otherwise.
+static void drawInstanced(ModelPass &pass, const InstancingState &state, const Mesh &mesh,
+                          const QMatrix4x4 &placement, GLuint instanceBuffer, int instanceCount)
+{
+    QMatrix4x4 meshMatrix = placement;
+    if (mesh._format != FloatVertexFormat)
+        meshMatrix *= QMatrix4x4(mesh._dequantization).transposed(); // the constructor reads rows
+    QOpenGLFunctions *gl = QOpenGLContext::currentContext()->functions();
+    GL_CHECK( gl->glUniformMatrix4fv(state.meshMatrixLocation, 1, GL_FALSE, meshMatrix.constData()));
+
+    const bool hasTextureVertices = mesh.hasTextureVertices();
+    bindMeshArrays(pass, mesh);
+    bindInstanceMatrices(state, instanceBuffer);
+    foreach (const MaterialRange &range, mesh._ranges)
+    {
+        const bool isTextured = hasTextureVertices && range.textureID >= 0;
+        bindRangeTexture(pass, isTextured ? range.textureID : -1);
+        GL_CHECK( gl->glUniform1i(state.isTexturedLocation, isTextured));
+        if (mesh._vertexBlock.offset)
+            mesh._arena->drawElementsInstancedBaseVertex(GL_TRIANGLES, range.indexCount, mesh._indexType,
+                                                         mesh.indexData(range.firstIndex), instanceCount,
+                                                         mesh._vertexBlock.offset);
+        else
+            GL_CHECK( state.drawElementsInstanced(GL_TRIANGLES, range.indexCount, mesh._indexType,
+                                                  mesh.indexData(range.firstIndex), instanceCount));
+    }
+    unbindInstanceMatrices(state);
+    releaseMeshArrays(pass, mesh);
+}
 
-    GL_CHECK( glDrawElements(GL_TRIANGLES, mesh._indices.size(), GL_UNSIGNED_SHORT, mesh._indices.data()));
+void Model::renderMesh(const Mesh &mesh, const ViewFrustum &frustum)
+{
+    ModelPass pass;
+    renderMesh(mesh, frustum, pass);
+}
+
+void Model::renderMesh(const Mesh &mesh, const ViewFrustum &frustum, ModelPass &pass)
+{
+    if (mesh._instances.isEmpty()) {
+        renderPlacedMesh(pass, mesh, mesh._transform, frustum);
+        return;
+    }
+    if (renderMeshInstanced(mesh, frustum, pass))
+        return;
+    foreach (const MeshInstance &instance, mesh._instances)
+        renderPlacedMesh(pass, mesh, instance.transform, frustum);
+}
+
+bool Model::renderMeshInstanced(const Mesh &mesh, const ViewFrustum &frustum, ModelPass &pass)
+{
+    if (!isInstancingSupported())
+        return false;
+
+    QVector<GLfloat> &matrices = _instancing->matrices;
+    matrices.clear();
+    foreach (const MeshInstance &instance, mesh._instances)
+    {
+        if (!frustum.transformed(instance.transform).isSphereVisible(mesh._boundsCenter, mesh._boundsRadius))
+            continue;
+        const GLfloat *data = instance.transform.constData();
+        for (int k = 0; k < 16; ++k)
+            matrices << data[k];
+    }
+    const int instanceCount = matrices.size() / 16;
+    if (instanceCount < kMinInstancedDraw)
+        return instanceCount == 0; // a few instances draw faster with their clusters culled
+
+    QOpenGLFunctions *gl = QOpenGLContext::currentContext()->functions();
+    GL_CHECK( gl->glBindBuffer(GL_ARRAY_BUFFER, _instancing->buffer));
+    GL_CHECK( gl->glBufferData(GL_ARRAY_BUFFER, matrices.size() * sizeof(GLfloat), matrices.constData(), GL_STREAM_DRAW));
+    _instancing->program.bind();
+    drawInstanced(pass, *_instancing, mesh, QMatrix4x4(), _instancing->buffer, instanceCount);
+    _instancing->program.release();
+    return true;
+}
+
+void Model::renderInstances(const QVector<QMatrix4x4> &matrices)
+{
+    if (!_instanceBuffer)
+        _instanceBuffer = new ModelInstanceBuffer;
+    _instanceBuffer->setMatrices(matrices);
+    renderInstances(*_instanceBuffer);
+}
+
+void Model::renderInstances(const ModelInstanceBuffer &instances)
+{
+    Q_ASSERT(_file3ds);
+    if (instances.count() == 0)
+        return;
+    if (!_isGeometryUploaded)
+        uploadGeometry();
+    if (!isInstancingSupported() || !instances.bufferId()) {
+        foreach (const QMatrix4x4 &matrix, instances.matrices()) {
+            GL_CHECK( glPushMatrix());
+            GL_CHECK( glMultMatrixf(matrix.constData()));
+            renderModel();
+            GL_CHECK( glPopMatrix());
+        }
+        return;
+    }
+
+    ModelPass pass;
+    beginModelState(pass, _vertexFormat);
+    _instancing->program.bind();
+    foreach (int i, _drawOrder)
+    {
+        const Mesh &mesh = _meshes[i];
+        for (int p = 0; p < mesh.placementCount(); ++p)
+            drawInstanced(pass, *_instancing, mesh, mesh.placement(p), instances.bufferId(), instances.count());
+    }
+    _instancing->program.release();
+    endModelState(pass);
+}
+
+bool Model::isInstancingSupported()
+{
+    if (!_instancing)
+        _instancing = createInstancingState();
+    return _instancing->isSupported;
 }
 
 Lib3dsFile * Model::get3DSPointer()
@@ -332,64 +1577,176 @@ double Model::meshRadius() const
 }
 
 
-QVector3D Model::getMin() const
+bool Model::raycast(const QVector3D &origin, const QVector3D &direction, SurfaceHit *hit) const
 {
-    QVector3D minValue(+100000, +100000, +100000);
-    foreach (const Mesh &mesh, _meshes)
+    if (direction.isNull())
+        return false;
+    const QVector3D unitDirection = direction.normalized();
+    SurfaceHit best;
+    best.distance = 1e30f;
+
+    for (int i = 0; i < _meshes.size(); ++i)
     {
-        const QVector<GLfloat> &vertices = mesh._vertices;
-        Q_ASSERT(vertices.size() % 3 == 0);
-        for (int i = 0; i < vertices.size(); i += 3)
+        const Mesh &mesh = _meshes[i];
+        for (int p = 0; p < mesh.placementCount(); ++p)
         {
-            QVector3D vertice(vertices[i], vertices[i+1], vertices[i+2]);
-
-            if (minValue.x() > vertice.x())
-                minValue.setX(vertice.x());
-            if (minValue.y() > vertice.y())
-                minValue.setY(vertice.y());
-            if (minValue.z() > vertice.z())
-                minValue.setZ(vertice.z());
+            const QMatrix4x4 &transform = mesh.placement(p);
+            SurfaceHit meshHit;
+            // the ray parameter is preserved by affine maps: hits of all meshes compare directly
+            if (transform.isIdentity()) {
+                if (!mesh._bvh.raycast(origin, unitDirection, best.distance, meshHit))
+                    continue;
+            } else {
+                QMatrix4x4 inverse = transform.inverted();
+                if (!mesh._bvh.raycast(inverse.map(origin), inverse.mapVector(unitDirection), best.distance, meshHit))
+                    continue;
+                meshHit.point = transform.map(meshHit.point);
+                meshHit.normal = inverse.transposed().mapVector(meshHit.normal).normalized();
+            }
+            meshHit.mesh = i;
+            best = meshHit;
         }
     }
-    return minValue;
+
+    if (best.mesh < 0)
+        return false;
+    if (hit)
+        *hit = best;
+    return true;
 }
 
-QVector3D Model::getMax() const
+bool Model::intersectsSphere(const QVector3D &center, float radius) const
 {
-    QVector3D maxValue(-100000, -100000, -100000);
     foreach (const Mesh &mesh, _meshes)
     {
-        const QVector<GLfloat> &vertices = mesh._vertices;
-        Q_ASSERT(vertices.size() % 3 == 0);
-        for (int i = 0; i < vertices.size(); i += 3)
+        for (int p = 0; p < mesh.placementCount(); ++p)
+        {
+            if (mesh._bvh.intersectsSphere(center, radius, mesh.placement(p)))
+                return true;
+        }
+    }
+    return false;
+}
+
+bool Model::closestPoint(const QVector3D &point, SurfaceHit *hit) const
+{
+    SurfaceHit best;
+    best.distance = 1e30f;
+
+    for (int i = 0; i < _meshes.size(); ++i)
+    {
+        const Mesh &mesh = _meshes[i];
+        for (int p = 0; p < mesh.placementCount(); ++p)
         {
-            QVector3D vertice(vertices[i], vertices[i+1], vertices[i+2]);
-
-            if (maxValue.x() < vertice.x())
-                maxValue.setX(vertice.x());
-            if (maxValue.y() < vertice.y())
-                maxValue.setY(vertice.y());
-            if (maxValue.z() < vertice.z())
-                maxValue.setZ(vertice.z());
+            // the distances are measured in model coordinates, whatever the scale of the placement
+            SurfaceHit meshHit;
+            if (!mesh._bvh.closestPoint(point, best.distance, meshHit, mesh.placement(p)))
+                continue;
+            if (meshHit.distance > best.distance)
+                continue;
+            meshHit.mesh = i;
+            best = meshHit;
         }
     }
+
+    if (best.mesh < 0)
+        return false;
+    if (hit)
+        *hit = best;
+    return true;
+}
+
+// extends the bounds by the vertices of every copy of mesh, in model coordinates
+static void extendBounds(const Mesh &mesh, QVector3D &minValue, QVector3D &maxValue)
+{
+    for (int p = 0; p < mesh.placementCount(); ++p)
+    {
+        const QMatrix4x4 &transform = mesh.placement(p);
+        const bool isTransformed = !transform.isIdentity();
+        if (mesh.vertexCount() == 0 && mesh._vertexBuffer) {
+            // the client arrays are released: the corners of the bounding box bound the vertices
+            for (int corner = 0; corner < 8; ++corner) {
+                QVector3D vertice((corner & 1) ? mesh._boundsMax.x() : mesh._boundsMin.x(),
+                                  (corner & 2) ? mesh._boundsMax.y() : mesh._boundsMin.y(),
+                                  (corner & 4) ? mesh._boundsMax.z() : mesh._boundsMin.z());
+                vertice = transform.map(vertice);
+                for (int k = 0; k < 3; ++k) {
+                    minValue[k] = qMin(minValue[k], vertice[k]);
+                    maxValue[k] = qMax(maxValue[k], vertice[k]);
+                }
+            }
+            continue;
+        }
+        for (int i = 0; i < mesh.vertexCount(); ++i)
+        {
+            QVector3D vertice = isTransformed ? transform.map(mesh.vertex(i)) : mesh.vertex(i);
+            for (int k = 0; k < 3; ++k) {
+                minValue[k] = qMin(minValue[k], vertice[k]);
+                maxValue[k] = qMax(maxValue[k], vertice[k]);
+            }
+        }
+    }
+}
+
+QVector3D Model::getMin() const
+{
+    QVector3D minValue(+100000, +100000, +100000);
+    QVector3D maxValue(-100000, -100000, -100000);
+    foreach (const Mesh &mesh, _meshes)
+        extendBounds(mesh, minValue, maxValue);
+    return minValue;
+}
+
+QVector3D Model::getMax() const
+{
+    QVector3D minValue(+100000, +100000, +100000);
+    QVector3D maxValue(-100000, -100000, -100000);
+    foreach (const Mesh &mesh, _meshes)
+        extendBounds(mesh, minValue, maxValue);
     return maxValue;
 }
 
 void Model::centerModel()
 {
+    // the float positions are moved in the client arrays, which the upload may have released
+    foreach (const Mesh &mesh, _meshes) {
+        if (mesh._format == FloatVertexFormat && mesh._vertexBuffer && mesh._vertices.isEmpty()) {
+            qWarning() << "centerModel: the client geometry is released, the model is left as is";
+            return;
+        }
+    }
+
     QVector3D bottomLeft = getMin();
     QVector3D topRight = getMax();
 
     _meshRadius = (topRight-bottomLeft).length() / 2.2;
 
     QVector3D center = (bottomLeft + topRight) / 2;
+    _center += center;
 
     for (int i = 0; i < _meshes.size(); ++i)
     {
         Mesh &mesh = _meshes[i];
+        for (int c = 0; c < mesh._clusters.size(); ++c)
+            mesh._clusters[c].center -= center;
+        mesh._bvh.translate(-center);
+        mesh._boundsCenter -= center;
+        mesh._boundsMin -= center;
+        mesh._boundsMax -= center;
+        if (mesh._format != FloatVertexFormat) {
+            mesh._dequantization[12] -= center.x();
+            mesh._dequantization[13] -= center.y();
+            mesh._dequantization[14] -= center.z();
+            continue;
+        }
         QVector<GLfloat> &vertices = mesh._vertices;
         Q_ASSERT(vertices.size() % 3 == 0);
+        if (mesh._vertexBuffer) {
+            // the buffer holds the old positions, upload again on the next draw
+            releaseMeshBuffers(mesh, QOpenGLContext::currentContext());
+            releaseArenaArrays(); // a freed arena page may give its buffer name to the next upload
+            _isGeometryUploaded = false;
+        }
         for (int i = 0; i < vertices.size(); i += 3)
         {
             vertices[i+0] -= center.x();
@@ -397,6 +1754,7 @@ void Model::centerModel()
             vertices[i+2] -= center.z();
         }
     }
+    updateTransforms();
 }
 
 void Model::enableLightSources()
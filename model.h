@@ -9,9 +9,13 @@ All models are loaded and renderd using this class
 */
 
 #include "lib3ds_qt_global.h"
+#include "meshclusters.h"
+#include "meshbvh.h"
+#include "gpuarena.h"
 
 #include <lib3ds/file.h>
 #include <lib3ds/node.h>
+#include <lib3ds/nodetable.h>
 #include <lib3ds/mesh.h>
 #include <lib3ds/vector.h>
 #include <lib3ds/matrix.h>
@@ -23,25 +27,140 @@ All models are loaded and renderd using this class
 #include <GL/gl.h>
 
 #include <QVector>
+#include <QHash>
+#include <QByteArray>
 #include <QMap>
 #include <QString>
 #include <QVector3D>
+#include <QMatrix4x4>
 
 #include <QPoint>
 
+class QOpenGLVertexArrayObject;
+
 using namespace std;
 
 namespace lib3ds_qt {
 
+/// Storage of the vertex attributes of the meshes
+enum VertexFormat
+{
+    FloatVertexFormat,    ///< 32 bytes per vertex: float positions, normals and texture coordinates
+    Packed16VertexFormat, ///< 16 bytes per vertex, half of FloatVertexFormat: 16-bit positions and normals,
+                          ///< half-float texture coordinates. 12 bytes without texture coordinates, instead of 24
+    Packed8VertexFormat   ///< 14 bytes per vertex, 44% of FloatVertexFormat: 16-bit positions, 8-bit normals,
+                          ///< half-float texture coordinates. 10 bytes without texture coordinates, instead of 24
+};
+
+/// Faces of a mesh sharing a material, stored contiguously in the index array
+struct MaterialRange
+{
+    int textureID; /**< -1 for the faces drawn without texture */
+    int firstIndex;
+    int indexCount;
+    int firstCluster; /**< The clusters of the range are [firstCluster, firstCluster + clusterCount) */
+    int clusterCount;
+
+    MaterialRange() : textureID(-1), firstIndex(0), indexCount(0), firstCluster(0), clusterCount(0) {}
+};
+
+/// Placement of a mesh shared by several object nodes
+struct MeshInstance
+{
+    Lib3dsNode *node;
+    QMatrix4x4 nodeToMesh; /**< See Mesh::_nodeToMesh */
+    QMatrix4x4 transform; /**< See Mesh::_transform */
+
+    MeshInstance() : node(0) {}
+};
+
 struct Mesh
 {
-    int _textureID;
+    QVector<MaterialRange> _ranges; /**< Ordered by material, they cover the whole _indices */
     QVector<GLfloat> _vertices;
-    QVector<GLushort> _indices;
+    QVector<GLuint> _indices; /**< Released after loading if the mesh fits 16-bit indices */
+    QVector<GLushort> _shortIndices;
+    GLenum _indexType; /**< GL_UNSIGNED_INT for _indices or GL_UNSIGNED_SHORT for _shortIndices */
     QVector<GLfloat> _normals;
     QVector<GLfloat> _textureVertices;
+    QVector<MeshCluster> _clusters; /**< Contiguous ranges of _indices, culled individually */
+    MeshBvh _bvh; /**< Triangle hierarchy for the picking and collision queries */
+    QMatrix4x4 _transform; /**< Maps the mesh into model coordinates, identity for the meshes drawn at their rest position */
+    Lib3dsNode *_node; /**< Object node with animated placement, 0 for the meshes drawn at their rest position */
+    QMatrix4x4 _nodeToMesh; /**< Pivot offset and inverse mesh matrix, the node matrix times it gives the world matrix */
+    QVector<MeshInstance> _instances; /**< One per node if several nodes share the geometry, _transform is unused then */
+    QVector3D _boundsCenter; /**< Bounding sphere of the vertices, in mesh coordinates */
+    float _boundsRadius;
+    QVector3D _boundsMin; /**< Bounding box of the vertices, in mesh coordinates */
+    QVector3D _boundsMax;
+
+    VertexFormat _format; /**< The float arrays are released once the mesh is packed */
+    QVector<GLshort> _packedVertices; /**< Positions mapped to [-32767, 32767] over the bounding box of the mesh */
+    QByteArray _packedNormals; /**< Normalized GL_SHORT or GL_BYTE triples, see _normalType */
+    GLenum _normalType;
+    QVector<quint16> _packedTextureVertices; /**< Half floats, empty if the driver can't source them */
+    GLfloat _dequantization[16]; /**< Column-major matrix mapping _packedVertices to model coordinates */
 
-    Mesh() : _textureID(-1) {}
+    Lib3dsNode *_morphNode; /**< Object node with morph keys, 0 for static meshes */
+    GLuint _morphBuffers[2]; /**< Streamed positions of the morphed mesh, 0 until the first Model::setMorphFrame() */
+    int _morphBuffer; /**< The buffer written last, drawn instead of _vertices */
+
+    GLuint _vertexBuffer; /**< Interleaved positions, normals and texture coordinates, 0 until the first draw */
+    GLuint _indexBuffer; /**< Copy of the index array selected by _indexType */
+    GLsizei _stride;
+    int _normalOffset; /**< Byte offsets of the attributes in a vertex of _vertexBuffer, positions come first */
+    int _texCoordOffset; /**< -1 without texture coordinates */
+    GLenum _texCoordType;
+    QOpenGLVertexArrayObject *_vertexArray; /**< Layout of the buffers, 0 if the context has no vertex array objects.
+                                                 Shared by the meshes of the same arena pages and owned by the Model then */
+    GpuArena *_arena; /**< Arena holding _vertexBlock and _indexBlock, 0 if the mesh owns its buffers */
+    GpuArenaBlock _vertexBlock; /**< _vertexBuffer and _indexBuffer are the pages of the blocks in an arena */
+    GpuArenaBlock _indexBlock;
+
+    Mesh() : _indexType(GL_UNSIGNED_INT), _node(0), _boundsRadius(0), _format(FloatVertexFormat), _normalType(GL_FLOAT),
+        _morphNode(0), _morphBuffer(0), _vertexBuffer(0), _indexBuffer(0), _stride(0), _normalOffset(0),
+        _texCoordOffset(-1), _texCoordType(GL_FLOAT), _vertexArray(0), _arena(0) { _morphBuffers[0] = _morphBuffers[1] = 0; }
+
+    /// Vertices of the client arrays, 0 once they are released after the upload
+    int vertexCount() const;
+    bool hasTextureVertices() const;
+    /// Address of the index firstIndex in the array selected by _indexType, or its offset in _indexBuffer, for glDrawElements
+    const GLvoid *indexData(int firstIndex) const;
+    QVector3D vertex(int index) const;
+    /// Number of copies of the mesh in the model, 1 unless it has instances
+    int placementCount() const;
+    /// Transform of the copy index, see _transform and _instances
+    const QMatrix4x4 &placement(int index) const;
+};
+
+struct InstancingState;
+struct ModelPass;
+
+/// Model matrices of the copies drawn by Model::renderInstances(), kept in a GL buffer between frames.
+/// The matrices are uploaded by setMatrices() and updateMatrices(), which need a current GL context.
+class LIB3DS_QTSHARED_EXPORT ModelInstanceBuffer
+{
+public:
+    ModelInstanceBuffer();
+    ~ModelInstanceBuffer();
+
+    /// Replaces all the matrices, the storage grows as needed and is orphaned otherwise
+    void setMatrices(const QVector<QMatrix4x4> &matrices);
+    /// Rewrites the matrices [first, first + matrices.size()), which must already exist
+    void updateMatrices(int first, const QVector<QMatrix4x4> &matrices);
+
+    int count() const;
+    const QVector<QMatrix4x4> &matrices() const;
+    /// 0 until the first upload
+    GLuint bufferId() const;
+
+private:
+    Q_DISABLE_COPY(ModelInstanceBuffer)
+
+    QVector<QMatrix4x4> _matrices; /**< Copy for the draws without instancing support */
+    QVector<GLfloat> _data; /**< Packed matrices of the last upload */
+    GLuint _buffer;
+    int _capacity; /**< Matrices the buffer storage can hold */
 };
 
 struct LightSource
@@ -60,13 +179,49 @@ public:
     Model();
     ~Model(); /// RAII -> free file, free textures
 
+    /// Packed formats take effect for the files loaded afterwards
+    void setVertexFormat(VertexFormat format);
+    VertexFormat vertexFormat() const;
+
+    /// The geometry is uploaded to buffer objects on the first draw. Unless kept, the client copies are
+    /// released then: getMin() and getMax() fall back to the mesh bounding boxes and centerModel() warns and
+    /// leaves a model with float meshes as is. Takes effect at the next upload, after loadFile().
+    void setKeepClientGeometry(bool keep);
+    bool keepClientGeometry() const;
+
+    /// Sub-allocates the geometry from arena, shared with the other models using it, instead of buffers per
+    /// mesh. The meshes are then drawn with base vertex draws, sorted to switch vertex arrays and textures
+    /// seldom. Ignored if the context can't draw with a base vertex. Takes effect at the next upload, after
+    /// loadFile(). The arena must outlive the buffers of the model.
+    void setArena(GpuArena *arena);
+    GpuArena *arena() const;
+
     /// It loads the file 'name', sets the current frame to 0 and if the model has textures, it will be applied to the model
     void loadFile(const QString &name, const QString &pathToFile = QString());
 
+    /// Evaluates the node hierarchy at frame and places the animated meshes with the resulting matrices.
+    /// The vertex data is left untouched, rendering applies the transforms.
+    void setFrame(float frame);
+
+    /// Interpolates the morph targets of the animated meshes at frame and uploads their positions.
+    /// Needs the GL context the model is rendered with to be current.
+    void setMorphFrame(float frame);
+
     void prepareNodes();
     void prepareNode(Lib3dsNode *node);
+    /// Concatenates the small single material meshes sharing a texture, nearby meshes first
+    void mergeSmallMeshes();
     void renderModel();
+    /// Draws a copy of the model for each matrix, the matrices are applied after the modelview.
+    /// Uses one instanced draw per mesh and material if supported, whole meshes are drawn without culling.
+    void renderInstances(const QVector<QMatrix4x4> &matrices);
+    /// Same with matrices that persist in a GL buffer across frames
+    void renderInstances(const ModelInstanceBuffer &instances);
+    /// True if the current context can draw instanced, creates the shader on the first call
+    bool isInstancingSupported();
     void renderMesh(const Mesh &mesh);
+    /// Draws the clusters of mesh which are inside frustum and not back facing, frustum is in model coordinates
+    void renderMesh(const Mesh &mesh, const ViewFrustum &frustum);
     /// It applies a texture to mesh ,according to the data that mesh contains
     void ApplyTexture(Lib3dsMesh *mesh, const QString &extraPath = QString());
     Lib3dsFile * get3DSPointer();
@@ -76,8 +231,17 @@ public:
     bool isValidRadius() const;
     double meshRadius() const;
 
+    /// Nearest intersection of the ray with the model, the direction needn't be normalized.
+    /// Queries are in model coordinates, the mesh transforms may scale non-uniformly.
+    bool raycast(const QVector3D &origin, const QVector3D &direction, SurfaceHit *hit = 0) const;
+    /// True if a triangle of the model is at most radius away from center
+    bool intersectsSphere(const QVector3D &center, float radius) const;
+    /// Closest point of the model surface, returns false for an empty model
+    bool closestPoint(const QVector3D &point, SurfaceHit *hit) const;
+
     QVector3D getMin() const;
     QVector3D getMax() const;
+    /// Moves the model center to the origin, see setKeepClientGeometry()
     void centerModel();
 
     void enableLightSources();
@@ -87,15 +251,41 @@ public:
 
     void updateLightSource(GLuint lightID, const QVector3D &newPosition);
 private:
+    void releaseBuffers();
+    /// Copies the vertices and indices of the meshes into buffer objects, needs a current GL context
+    void uploadGeometry();
+    /// Vertex array object of the arena pages of mesh, created on the first request
+    QOpenGLVertexArrayObject *arenaArray(const Mesh &mesh);
+    /// Deletes the vertex array objects of the arena pages, the meshes get them again at the next upload
+    void releaseArenaArrays();
+    /// Recomputes the transforms of the animated meshes and of the instances from the node matrices
+    void updateTransforms();
+    /// Same as the public overload, within pass
+    void renderMesh(const Mesh &mesh, const ViewFrustum &frustum, ModelPass &pass);
+    /// Draws the visible instances of mesh with one call per material, false if it falls back to a draw per instance
+    bool renderMeshInstanced(const Mesh &mesh, const ViewFrustum &frustum, ModelPass &pass);
+
     Lib3dsFile *_file3ds; /**< file holds the data of the model */
+    Lib3dsNodeTable *_nodeTable; /**< Flattened hierarchy evaluated by setFrame() */
     QString _fileName; /**< It's the filename of the model */
     QMap<QString, GLuint> _textureFilenamesIndexes;
     typedef QMap<QString, GLuint>::iterator MapIterator;
 
     QList<Mesh> _meshes;
-    QList<Lib3dsNode*> _nodes;
+    QList<Lib3dsNode*> _nodes; /**< The node each mesh was built for, parallel to _meshes until they are merged */
+    QHash<Lib3dsMesh*, int> _sharedMeshes; /**< Index in _meshes of the geometry built for a Lib3dsMesh, while preparing the nodes */
+    InstancingState *_instancing; /**< Shader and buffer of the instanced draws, 0 until the first instanced mesh is drawn */
+    ModelInstanceBuffer *_instanceBuffer; /**< Matrices of renderInstances(const QVector<QMatrix4x4> &) */
+    GpuArena *_arena;
+    QHash<quint64, QOpenGLVertexArrayObject*> _arenaArrays; /**< By vertex page and index page buffer */
+    QVector<int> _drawOrder; /**< Indices in _meshes grouped by buffers then texture, built by uploadGeometry() */
     QList<LightSource> _lightSources;
+    QVector<Lib3dsPoint> _morphPoints; /**< Scratch buffer of setMorphFrame(), sized for the largest morphed mesh */
+    QVector3D _center; /**< Offset subtracted from the vertices by centerModel() */
     double _meshRadius;
+    VertexFormat _vertexFormat;
+    bool _keepClientGeometry;
+    bool _isGeometryUploaded;
     bool _isValid;
 };
 
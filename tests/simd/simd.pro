@@ -0,0 +1,19 @@
+# Bit-exactness of the lib3ds SIMD kernels against the scalar ones,
+# run with "make check"
+
+TARGET = simd_test
+TEMPLATE = app
+CONFIG += console testcase
+CONFIG -= qt app_bundle
+
+# simd.c is linked in directly, define the export side of LIB3DSAPI
+DEFINES += LIB3DS_EXPORTS
+
+INCLUDEPATH += ../..
+
+SOURCES += \
+    simd_test.c \
+    ../../lib3ds/simd.c
+
+HEADERS += \
+    ../../lib3ds/simd.h
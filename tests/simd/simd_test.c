@@ -0,0 +1,160 @@
+/*
+ * The 3D Studio File Format Library
+ * Copyright (C) 1996-2007 by Jan Eric Kyprianidis <www.kyprianidis.com>
+ * All rights reserved.
+ *
+ * This program is  free  software;  you can redistribute it and/or modify it
+ * under the terms of the  GNU Lesser General Public License  as published by
+ * the  Free Software Foundation;  either version 2.1 of the License,  or (at
+ * your option) any later version.
+ *
+ * This  program  is  distributed in  the  hope that it will  be useful,  but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or  FITNESS FOR A  PARTICULAR PURPOSE.  See the  GNU Lesser General Public
+ * License for more details.
+ *
+ * You should  have received  a copy of the GNU Lesser General Public License
+ * along with  this program;  if not, write to the  Free Software Foundation,
+ * Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/*
+ * Checks that every SIMD level gives the same bits as the scalar kernels,
+ * for random inputs and point counts and strides that end in the scalar
+ * tails of the vector loops.
+ */
+#include <lib3ds/simd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TEST_ROUNDS 200
+#define TEST_MAX_COUNT 41
+#define TEST_MAX_STRIDE 32
+
+static const size_t test_strides[]={12, 16, 20, 28, 32};
+static const int test_stride_count=sizeof(test_strides)/sizeof(test_strides[0]);
+
+static unsigned long test_seed=1;
+static int test_failures=0;
+
+
+static Lib3dsFloat
+test_random()
+{
+  test_seed=test_seed*1103515245UL + 12345UL;
+  return((Lib3dsFloat)((test_seed>>8)&0xFFFF)/0xFFFF*200.0f - 100.0f);
+}
+
+
+static void
+test_random_array(Lib3dsFloat *a, int n)
+{
+  int i;
+  for (i=0; i<n; ++i) {
+    a[i]=test_random();
+  }
+}
+
+
+static void
+test_check(const void *a, const void *b, size_t size, const char *kernel, Lib3dsSimdLevel level)
+{
+  if (memcmp(a, b, size)!=0) {
+    if (test_failures<20) {
+      fprintf(stderr, "%s differs from the scalar kernel at level %d\n", kernel, (int)level);
+    }
+    ++test_failures;
+  }
+}
+
+
+static void
+test_level(Lib3dsSimdLevel level)
+{
+  static Lib3dsFloat in[TEST_MAX_COUNT*TEST_MAX_STRIDE/sizeof(Lib3dsFloat)];
+  static Lib3dsFloat out[2][TEST_MAX_COUNT*TEST_MAX_STRIDE/sizeof(Lib3dsFloat)];
+  Lib3dsMatrix a,b,m[2];
+  Lib3dsVector v,c[2],bmin[2],bmax[2];
+  Lib3dsQuat p,q,r[2];
+  Lib3dsDouble sa,sb;
+  int round,i,j,k,s,t;
+  Lib3dsDword count;
+
+  for (round=0; round<TEST_ROUNDS; ++round) {
+    test_random_array(&a[0][0], 16);
+    test_random_array(&b[0][0], 16);
+    test_random_array(v, 3);
+    test_random_array(p, 4);
+    test_random_array(q, 4);
+    sa=test_random()/100.0;
+    sb=test_random()/100.0;
+
+    for (i=0; i<2; ++i) {
+      lib3ds_simd_set_level(i ? level : LIB3DS_SIMD_NONE);
+      lib3ds_simd_matrix_mult(m[i], a, b);
+      lib3ds_simd_vector_transform(c[i], a, v);
+      lib3ds_simd_quat_blend(r[i], p, sa, q, sb);
+    }
+    test_check(m[0], m[1], sizeof(Lib3dsMatrix), "lib3ds_simd_matrix_mult", level);
+    test_check(c[0], c[1], sizeof(Lib3dsVector), "lib3ds_simd_vector_transform", level);
+    test_check(r[0], r[1], sizeof(Lib3dsQuat), "lib3ds_simd_quat_blend", level);
+  }
+
+  for (count=0; count<=TEST_MAX_COUNT; ++count) {
+    for (s=0; s<test_stride_count; ++s) {
+      for (t=0; t<test_stride_count; ++t) {
+        test_random_array(&a[0][0], 16);
+        test_random_array(in, sizeof(in)/sizeof(in[0]));
+        test_random_array(bmin[0], 3);
+        test_random_array(bmax[0], 3);
+        for (k=0; k<3; ++k) {
+          if (bmin[0][k]>bmax[0][k]) {
+            Lib3dsFloat x=bmin[0][k];
+            bmin[0][k]=bmax[0][k];
+            bmax[0][k]=x;
+          }
+          bmin[1][k]=bmin[0][k];
+          bmax[1][k]=bmax[0][k];
+        }
+
+        for (i=0; i<2; ++i) {
+          lib3ds_simd_set_level(i ? level : LIB3DS_SIMD_NONE);
+          /* the padding between the output points must stay untouched */
+          for (j=0; j<(int)(sizeof(out[i])/sizeof(out[i][0])); ++j) {
+            out[i][j]=-1.0f;
+          }
+          lib3ds_simd_transform_array(out[i], test_strides[t], a, in, test_strides[s], count);
+          lib3ds_simd_transform_bounds(a, in, test_strides[s], count, bmin[i], bmax[i]);
+        }
+        test_check(out[0], out[1], sizeof(out[0]), "lib3ds_simd_transform_array", level);
+        test_check(bmin[0], bmin[1], sizeof(Lib3dsVector), "lib3ds_simd_transform_bounds", level);
+        test_check(bmax[0], bmax[1], sizeof(Lib3dsVector), "lib3ds_simd_transform_bounds", level);
+      }
+    }
+  }
+}
+
+
+int
+main()
+{
+  static const Lib3dsSimdLevel levels[]={LIB3DS_SIMD_NONE, LIB3DS_SIMD_SSE2, LIB3DS_SIMD_AVX2};
+  int i;
+
+  for (i=0; i<(int)(sizeof(levels)/sizeof(levels[0])); ++i) {
+    if (lib3ds_simd_set_level(levels[i])!=levels[i]) {
+      printf("level %d not supported by the CPU, skipped\n", (int)levels[i]);
+      continue;
+    }
+    test_level(levels[i]);
+  }
+  lib3ds_simd_set_level(lib3ds_simd_detect());
+
+  if (test_failures) {
+    fprintf(stderr, "%d mismatches\n", test_failures);
+    return(EXIT_FAILURE);
+  }
+  printf("all levels match the scalar kernels\n");
+  return(EXIT_SUCCESS);
+}